@@ -21,11 +21,16 @@ Experimental script for automatic sorting of errors, basing on failed optimizati
 """
 ###############################################################################
 
+import collections
+import concurrent.futures
 import logging
 import os
 import re
+import shutil
+import threading
 
 
+import build_cache
 import common
 import gen_test_makefile
 import run_gen
@@ -54,6 +59,11 @@ compilers_opt_name_cutter = {"icc": [icc_opt_name_prefix, icc_opt_name_suffix],
 
 blame_test_makefile_name = "Blame_Makefile"
 
+# Number of concurrent probes of blame phase (see --blame-probes option of run_gen.py). Probes speculatively
+# evaluate the next steps of sequential binary search, so its result doesn't depend on the number of probes.
+blame_probes = 1
+probe_dir_prefix = "probe_"
+
 ###############################################################################
 
 
@@ -69,6 +79,39 @@ def get_next_step(start, end, current, fail_flag):
     return next_start, next_end, next_current
 
 
+# Binary search of the first failing optimization as a state machine. State is (start, end, current), where
+# current is the limit of optimizations to probe. Returns the next state or the result of the phase (int).
+def get_next_state(state, fail_flag):
+    start, end, current = state
+    eff = (start + 1) >= current  # Earliest fail was found
+    if fail_flag and eff:
+        return current
+    if not fail_flag and eff and current == (end - 1):
+        return end
+    return get_next_step(start, end, current, fail_flag)
+
+
+# Limits, which may be probed by sequential search starting from the state: the first num unknown ones
+# in breadth-first order of its decision tree
+def get_speculative_probes(state, known, num):
+    probes = []
+    queue = collections.deque([state])
+    while len(queue) > 0 and len(probes) < num:
+        state = queue.popleft()
+        limit = state[2]
+        if limit in known:
+            outcomes = [known[limit]]
+        else:
+            outcomes = [True, False]
+            if limit not in probes:
+                probes.append(limit)
+        for fail_flag in outcomes:
+            next_state = get_next_state(state, fail_flag)
+            if not isinstance(next_state, int):
+                queue.append(next_state)
+    return probes
+
+
 def dump_exec_output(msg, ret_code, output, err_output, time_expired, num):
     common.log_msg(logging.DEBUG, msg + " (process " + str(num) + ")")
     common.log_msg(logging.DEBUG, "Ret code: " + str(ret_code) + " | process " + str(num))
@@ -77,10 +120,106 @@ def dump_exec_output(msg, ret_code, output, err_output, time_expired, num):
     common.log_msg(logging.DEBUG, "Err output: " + str(err_output, "utf-8") + " | process " + str(num))
 
 
-def execute_blame_phase(valid_res, fail_target, inject_str, num, phase_num):
-    gen_test_makefile.gen_makefile(blame_test_makefile_name, True, None, fail_target, inject_str + "-1")
+# Build the test with blaming options. Compilers are invoked directly (with the same command lines, as in
+# Blame_Makefile), so the build cache is consulted.
+# Builds and runs are started from probe threads (see bisect()), so they don't set limits with preexec_fn.
+# Memory is limited by RLIMIT_AS of the worker (see run_gen.set_worker_mem_limit()), time is limited by timeout.
+def build_target(fail_target, blame_opts, num, work_dir="", cancel=None):
+    build_cmds = gen_test_makefile.get_build_cmds(fail_target, blame_opts=blame_opts, work_dir=work_dir)
+    ret_code, output, err_output, time_expired, usage, cache_hits, cache_misses = \
+        build_cache.run_build_cmds(build_cmds, run_gen.compiler_timeout, num, cancel=cancel, cpu_limit=False)
+    stat = run_gen.get_process_stat()
+    if stat is not None:
+        stat.update_build_cache(cache_hits, cache_misses)
+    return ret_code, output, err_output, time_expired
+
+
+def run_target(fail_target, num, work_dir=".", cancel=None):
     ret_code, output, err_output, time_expired, elapsed_time = \
-        common.run_cmd(["make", "-f", blame_test_makefile_name, fail_target.name], run_gen.compiler_timeout, num)
+        common.run_cmd(gen_test_makefile.get_run_cmd(fail_target, work_dir), run_gen.run_timeout, num, cancel=cancel)
+    return ret_code, output, err_output, time_expired
+
+
+# Build and run the test with blaming options in work_dir. Returns True, if the test fails.
+def run_probe(valid_res, fail_target, blame_opts, num, work_dir, cancel):
+    common.log_msg(logging.DEBUG, "Trying opts (process " + str(num) + "): " + blame_opts)
+    ret_code, output, err_output, time_expired = build_target(fail_target, blame_opts, num,
+                                                              work_dir, cancel)
+    if time_expired or ret_code != 0:
+        dump_exec_output("Compilation failed", ret_code, output, err_output, time_expired, num)
+        return True
+
+    ret_code, output, err_output, time_expired = run_target(fail_target, num, work_dir or ".", cancel)
+    if time_expired or ret_code != 0:
+        dump_exec_output("Execution failed", ret_code, output, err_output, time_expired, num)
+        return True
+
+    if str(output, "utf-8").split()[-1] != valid_res:
+        common.log_msg(logging.DEBUG, "Out differs (process " + str(num) + ")")
+        return True
+    return False
+
+
+# Sequential binary search, which is sped up with speculative probes. Every probe builds and runs the test
+# in its own directory (see get_probe_dirs()). Probes, which become useless, are cancelled.
+# Returns the result of the search and updates the counters of steps.
+def bisect(state, probe_func, probe_dirs, num, steps):
+    known = {}
+    # Future -> (limit, directory, cancel event)
+    running = {}
+    free_dirs = list(reversed(probe_dirs))
+    with concurrent.futures.ThreadPoolExecutor(max_workers=len(probe_dirs)) as executor:
+        try:
+            while True:
+                while not isinstance(state, int) and state[2] in known:
+                    state = get_next_state(state, known[state[2]])
+                    steps["path"] += 1
+                if isinstance(state, int):
+                    break
+                wanted = get_speculative_probes(state, known, len(probe_dirs))
+                for limit, probe_dir, cancel in running.values():
+                    if limit not in wanted and not cancel.is_set():
+                        cancel.set()
+                        steps["cancelled"] += 1
+                running_limits = [limit for limit, probe_dir, cancel in running.values() if not cancel.is_set()]
+                for limit in wanted:
+                    if len(free_dirs) == 0:
+                        break
+                    if limit in running_limits:
+                        continue
+                    probe_dir = free_dirs.pop()
+                    cancel = threading.Event()
+                    running[executor.submit(probe_func, limit, probe_dir, cancel)] = (limit, probe_dir, cancel)
+                    steps["probes"] += 1
+                done, not_done = concurrent.futures.wait(list(running),
+                                                         return_when=concurrent.futures.FIRST_COMPLETED)
+                for future in done:
+                    limit, probe_dir, cancel = running.pop(future)
+                    free_dirs.append(probe_dir)
+                    if not cancel.is_set():
+                        known[limit] = future.result()
+        finally:
+            for limit, probe_dir, cancel in running.values():
+                cancel.set()
+    return state
+
+
+# Directories of concurrent probes. Single probe works in current directory, others get copies of the test.
+def get_probe_dirs():
+    if blame_probes <= 1:
+        return [""]
+    probe_dirs = []
+    for i in range(blame_probes):
+        probe_dir = os.path.abspath(probe_dir_prefix + str(i))
+        common.check_dir_and_create(probe_dir)
+        for f in gen_test_makefile.sources.value.split() + gen_test_makefile.headers.value.split():
+            common.check_and_copy(f, probe_dir)
+        probe_dirs.append(probe_dir)
+    return probe_dirs
+
+
+def execute_blame_phase(valid_res, fail_target, inject_str, num, phase_num, probe_dirs, steps):
+    ret_code, output, err_output, time_expired = build_target(fail_target, inject_str + "-1", num)
     opt_num_regex = re.compile(compilers_blame_patterns[fail_target.specs.name][phase_num])
     try:
         matches = opt_num_regex.findall(str(err_output, "utf-8"))
@@ -98,79 +237,41 @@ def execute_blame_phase(valid_res, fail_target, inject_str, num, phase_num):
                        + " (process " + str(num) + "): ")
         raise
 
-    start_opt = 0
-    end_opt = max_opt_num
-    cur_opt = max_opt_num
-    failed_flag = True
-    time_to_finish = False
-    while not time_to_finish:
-        start_opt, end_opt, cur_opt = get_next_step(start_opt, end_opt, cur_opt, failed_flag)
-        common.log_msg(logging.DEBUG, "Previous failed (process " + str(num) + "): " + str(failed_flag))
-        failed_flag = False
-        eff = ((start_opt + 1) >= cur_opt)  # Earliest fail was found
-
-        common.log_msg(logging.DEBUG, "Trying opt (process " + str(num) + "): " + str(start_opt) + "/" + str(cur_opt) + "/" + str(end_opt))
-        gen_test_makefile.gen_makefile(blame_test_makefile_name, True, None, fail_target, inject_str + str(cur_opt))
-
-        ret_code, output, err_output, time_expired, elapsed_time = \
-            common.run_cmd(["make", "-f", blame_test_makefile_name, fail_target.name], run_gen.compiler_timeout, num)
-        if time_expired or ret_code != 0:
-            dump_exec_output("Compilation failed", ret_code, output, err_output, time_expired, num)
-            failed_flag = True
-            if not eff:
-                continue
-            else:
-                break
-
-        ret_code, output, err_output, time_expired, elapsed_time = \
-            common.run_cmd(["make", "-f", blame_test_makefile_name, "run_" + fail_target.name], run_gen.run_timeout, num)
-        if time_expired or ret_code != 0:
-            dump_exec_output("Execution failed", ret_code, output, err_output, time_expired, num)
-            failed_flag = True
-            if not eff:
-                continue
-            else:
-                break
-
-        if str(output, "utf-8").split()[-1] != valid_res:
-            common.log_msg(logging.DEBUG, "Out differs (process " + str(num) + ")")
-            failed_flag = True
-            if not eff:
-                continue
-            else:
-                break
-
-        time_to_finish = (eff and failed_flag) or (eff and not failed_flag and (cur_opt == (end_opt - 1)))
-        common.log_msg(logging.DEBUG, "Time to finish (process " + str(num) + "): " + str(time_to_finish))
-
-    if not failed_flag:
-        common.log_msg(logging.DEBUG, "Swapping current and end opt (process " + str(num) + ")")
-        cur_opt = end_opt
+    probe_func = lambda limit, probe_dir, cancel: \
+        run_probe(valid_res, fail_target, inject_str + str(limit), num, probe_dir, cancel)
+    cur_opt = bisect(get_next_step(0, max_opt_num, max_opt_num, True), probe_func, probe_dirs, num, steps)
 
     common.log_msg(logging.DEBUG, "Finished blame phase, result: " + str(inject_str) + str(cur_opt) + " (process " + str(num) + ")")
 
     return str(cur_opt)
 
 
-def blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace):
+def blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace, steps):
     blame_str = ""
     stdout = stderr = b""
     if not re.search("-O0", fail_target.args):
         blame_opts = compilers_blame_opts[fail_target.specs.name]
         phase_num = 0
+        probe_dirs = []
         try:
+            probe_dirs = get_probe_dirs()
             for i in blame_opts:
                 blame_str += i
-                blame_str += execute_blame_phase(valid_res, fail_target, blame_str, num, phase_num)
+                blame_str += execute_blame_phase(valid_res, fail_target, blame_str, num, phase_num, probe_dirs,
+                                                 steps)
                 blame_str += " "
                 phase_num += 1
         except:
             common.log_msg(logging.ERROR, "Something went wrong while executing bpame_opt.py on " + str(fail_dir))
             return False
+        finally:
+            for probe_dir in probe_dirs:
+                if probe_dir:
+                    shutil.rmtree(probe_dir, ignore_errors=True)
 
+        # Blame_Makefile is left for reproduction of the result
         gen_test_makefile.gen_makefile(blame_test_makefile_name, True, None, fail_target, blame_str)
-        ret_code, stdout, stderr, time_expired, elapsed_time = \
-            common.run_cmd(["make", "-f", blame_test_makefile_name, fail_target.name], run_gen.compiler_timeout, num)
+        ret_code, stdout, stderr, time_expired = build_target(fail_target, blame_str, num)
 
         opt_name_pattern = re.compile(compilers_opt_name_cutter[fail_target.specs.name][0] + ".*" +
                                       compilers_opt_name_cutter[fail_target.specs.name][1])
@@ -196,7 +297,9 @@ def blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace):
     with open(os.path.join(full_out_path, "log.txt"), "a") as log_file:
         log_file.write("\nBlaming for " + fail_target.name + " optset was done.\n")
         log_file.write("Optimization to blame: " + real_opt_name + "\n")
-        log_file.write("Blame opts: " + blame_str + "\n\n")
+        log_file.write("Blame opts: " + blame_str + "\n")
+        log_file.write("Blame steps: " + str(steps["probes"]) + " probes (" + str(steps["path"]) +
+                       " steps of sequential search, " + str(steps["cancelled"]) + " cancelled)\n\n")
         log_file.write("Details of blaming run:\n")
         log_file.write("=== Compiler log ==================================================\n")
         log_file.write(str(stdout, "utf-8"))
@@ -213,10 +316,13 @@ def blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace):
         return real_opt_name
 
 
-def prepare_env_and_blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace=False):
+# Numbers of probes and steps are added to steps counter, if it is given
+def prepare_env_and_blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace=False, steps=None):
     common.log_msg(logging.DEBUG, "Blaming target: " + fail_target.name + " | " + fail_target.specs.name)
     os.chdir(fail_dir)
     if fail_target.specs.name not in compilers_blame_opts:
         common.log_msg(logging.DEBUG, "We can't blame " + fail_target.name + " (process " + str(num) + ")")
         return False
-    return blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace)
+    if steps is None:
+        steps = collections.Counter()
+    return blame(fail_dir, valid_res, fail_target, out_dir, lock, num, inplace, steps)
@@ -0,0 +1,300 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Content-addressed cache of compiled objects and executables.
+Compilation is identified by hash of source and local headers, which it includes, identity of compiler binary
+and its system include directories and full list of flags, link - by hashes of linked objects, compiler and flags. Only successful builds are cached.
+Output of compiler is cached together with the artifact, because blaming parses it.
+Cache directory may be shared by several processes and runs: entries are published with atomic rename.
+Size of cache is bounded: least recently used entries are removed, when it exceeds the limit.
+"""
+###############################################################################
+
+import hashlib
+import logging
+import os
+import re
+import shutil
+import tempfile
+import time
+
+import common
+
+artifact_file_name = "artifact"
+stdout_file_name = "stdout"
+stderr_file_name = "stderr"
+
+version_timeout = 60
+
+# Local headers of the source. System headers are not hashed, they are considered a part of the compiler.
+include_pattern = re.compile(rb'^[ \t]*#[ \t]*include[ \t]*"([^"]+)"', re.MULTILINE)
+# Search list of system headers in verbose output of preprocessor (the same for gcc and clang)
+search_list_pattern = re.compile(r"#include <\.\.\.> search starts here:\n(.*?)\nEnd of search list\.", re.DOTALL)
+
+# Pruning of the cache starts, when entries, which were inserted by the process since the last pruning,
+# take this share of size limit. Least recently used entries are removed until the cache takes prune_target
+# share of the limit.
+prune_period = 0.1
+prune_target = 0.8
+# Temporary directories of entries, which are older than this (in seconds), were left by killed processes
+stale_tmp_age = 3600
+
+# Cache of current process. It is set up by the scripts (see --build-cache option of run_gen.py and rechecker.py)
+# and is inherited by their worker processes.
+cache = None
+
+
+# size_limit is in bytes, None means no limit
+def setup_cache(cache_dir, size_limit=None):
+    global cache
+    cache = BuildCache(cache_dir, size_limit) if cache_dir else None
+
+
+class BuildCache(object):
+    def __init__(self, cache_dir, size_limit=None):
+        self.cache_dir = os.path.abspath(cache_dir)
+        common.check_dir_and_create(self.cache_dir)
+        # Identities of compilers are computed once per process
+        self.compiler_ids = {}
+        self.size_limit = size_limit
+        self.inserted_size = 0
+        if self.size_limit is not None:
+            self.prune()
+
+    # Compiler is identified by its real path, size and modification time of the binary, its version output and
+    # system include directories (see get_system_include_id())
+    def get_compiler_id(self, compiler):
+        if compiler not in self.compiler_ids:
+            compiler_path = shutil.which(compiler)
+            if compiler_path is None:
+                return None
+            compiler_path = os.path.realpath(compiler_path)
+            compiler_stat = os.stat(compiler_path)
+            ret_code, output, err_output, time_expired, elapsed_time = \
+                common.run_cmd([compiler_path, "--version"], version_timeout)
+            self.compiler_ids[compiler] = " ".join([compiler_path, str(compiler_stat.st_size),
+                                                    str(compiler_stat.st_mtime_ns), str(output, "utf-8"),
+                                                    self.get_system_include_id(compiler_path)])
+        return self.compiler_ids[compiler]
+
+    # System headers (libstdc++, for example) may be upgraded separately from the compiler binary, so their
+    # search list for C and C++ and modification times of its directories are a part of compiler identity.
+    @staticmethod
+    def get_system_include_id(compiler_path):
+        include_id = []
+        for lang in ["c", "c++"]:
+            ret_code, output, err_output, time_expired, elapsed_time = \
+                common.run_cmd([compiler_path, "-E", "-v", "-x", lang, os.devnull], version_timeout)
+            match = search_list_pattern.search(str(err_output, "utf-8", "replace"))
+            if match is None:
+                continue
+            for line in match.group(1).splitlines():
+                include_dir = os.path.realpath(line.strip().replace(" (framework directory)", ""))
+                mtime = os.stat(include_dir).st_mtime_ns if os.path.isdir(include_dir) else None
+                include_id.append(include_dir + ":" + str(mtime))
+        return " ".join(include_id)
+
+    # Returns the key of build command (see gen_test_makefile.get_build_cmds() for its format) or None,
+    # if the command can't be cached.
+    def get_key(self, cmd):
+        compiler_id = self.get_compiler_id(cmd[0])
+        if compiler_id is None or "-o" not in cmd:
+            return None
+        key = hashlib.sha256()
+        key.update(compiler_id.encode("utf-8"))
+        out_pos = cmd.index("-o")
+        flags = cmd[1:out_pos] + cmd[out_pos + 2:]
+        if "-c" in flags:
+            # Compilation: source is replaced by its text and texts of local headers, so the same test
+            # in different directories has the same key.
+            source = flags[flags.index("-c") + 1]
+            flags.remove("-c")
+            flags.remove(source)
+            include_dirs = [f[2:] for f in flags if f.startswith("-I") and len(f) > 2]
+            key.update(b"\0compile\0" + " ".join(flags).encode("utf-8"))
+            if not self.hash_source(key, source, include_dirs, set()):
+                return None
+        else:
+            # Link: objects are replaced by hashes of their content
+            inputs = [f for f in flags if f.endswith(".o")]
+            flags = [f for f in flags if not f.endswith(".o")]
+            key.update(b"\0link\0" + " ".join(flags).encode("utf-8"))
+            for f in inputs:
+                with open(f, "rb") as input_file:
+                    key.update(b"\0" + hashlib.sha256(input_file.read()).digest())
+        return key.hexdigest()
+
+    # Hash text of the source and of its local headers (recursively). Headers are found the same way, as the
+    # compiler does it, but conditional compilation is ignored, so the key may depend on unused headers.
+    # Returns False, if the source can't be read.
+    def hash_source(self, key, source, include_dirs, visited):
+        try:
+            with open(source, "rb") as source_file:
+                text = source_file.read()
+        except OSError:
+            return False
+        visited.add(os.path.realpath(source))
+        key.update(b"\0" + hashlib.sha256(text).digest())
+        for header in include_pattern.findall(text):
+            header_name = header.decode("utf-8", "replace")
+            for include_dir in [os.path.dirname(source)] + include_dirs:
+                header_path = os.path.join(include_dir, header_name)
+                if os.path.isfile(header_path):
+                    break
+            else:
+                # Compiler will fail, so the build is not cached anyway
+                continue
+            key.update(b"\0include\0" + header)
+            if os.path.realpath(header_path) not in visited and \
+               not self.hash_source(key, header_path, include_dirs, visited):
+                return False
+        return True
+
+    def get_entry_dir(self, key):
+        return os.path.join(self.cache_dir, key[:2], key)
+
+    # Copy cached artifact to output file. Returns (stdout, stderr) of compiler or None.
+    def lookup(self, key, output_file):
+        entry_dir = self.get_entry_dir(key)
+        if not os.path.isdir(entry_dir):
+            return None
+        try:
+            shutil.copy2(os.path.join(entry_dir, artifact_file_name), output_file)
+            with open(os.path.join(entry_dir, stdout_file_name), "rb") as f:
+                stdout = f.read()
+            with open(os.path.join(entry_dir, stderr_file_name), "rb") as f:
+                stderr = f.read()
+        except OSError as e:
+            # Entry may be removed by pruning in another process
+            common.log_msg(logging.DEBUG, "Entry of build cache " + entry_dir + " can't be read: " + str(e))
+            return None
+        # Modification time of the entry is the time of its last use
+        try:
+            os.utime(entry_dir)
+        except OSError:
+            pass
+        return stdout, stderr
+
+    def insert(self, key, output_file, stdout, stderr):
+        entry_dir = self.get_entry_dir(key)
+        if os.path.isdir(entry_dir):
+            return
+        os.makedirs(os.path.dirname(entry_dir), exist_ok=True)
+        tmp_dir = tempfile.mkdtemp(prefix="tmp_", dir=self.cache_dir)
+        try:
+            shutil.copy2(output_file, os.path.join(tmp_dir, artifact_file_name))
+            with open(os.path.join(tmp_dir, stdout_file_name), "wb") as f:
+                f.write(stdout)
+            with open(os.path.join(tmp_dir, stderr_file_name), "wb") as f:
+                f.write(stderr)
+            os.rename(tmp_dir, entry_dir)
+        except OSError:
+            # Somebody has published the same entry first
+            shutil.rmtree(tmp_dir, ignore_errors=True)
+            return
+        if self.size_limit is not None:
+            self.inserted_size += common.get_dir_size(entry_dir)
+            if self.inserted_size >= self.size_limit * prune_period:
+                self.prune()
+
+    # Remove least recently used entries, if the cache exceeds size limit. Several processes may prune the cache
+    # at the same time, so every entry is renamed before removal and entries, which are gone, are skipped.
+    def prune(self):
+        self.inserted_size = 0
+        entries = []
+        for bucket in os.listdir(self.cache_dir):
+            bucket_dir = os.path.join(self.cache_dir, bucket)
+            try:
+                if bucket.startswith("tmp_") or bucket.startswith("del_"):
+                    if time.time() - os.stat(bucket_dir).st_mtime > stale_tmp_age:
+                        shutil.rmtree(bucket_dir, ignore_errors=True)
+                    continue
+                for key in os.listdir(bucket_dir):
+                    entry_dir = os.path.join(bucket_dir, key)
+                    entries.append((os.stat(entry_dir).st_mtime, common.get_dir_size(entry_dir), entry_dir))
+            except OSError:
+                continue
+        total_size = sum(size for mtime, size, entry_dir in entries)
+        if total_size <= self.size_limit:
+            return
+        entries.sort()
+        removed = 0
+        for mtime, size, entry_dir in entries:
+            if total_size <= self.size_limit * prune_target:
+                break
+            del_dir = os.path.join(self.cache_dir, "del_" + os.path.basename(entry_dir) + "_" + str(os.getpid()))
+            try:
+                os.rename(entry_dir, del_dir)
+            except OSError:
+                continue
+            shutil.rmtree(del_dir, ignore_errors=True)
+            total_size -= size
+            removed += 1
+        common.log_msg(logging.DEBUG, "Build cache is pruned: " + str(removed) + " entries are removed")
+
+    # Same as common.run_cmd_with_usage(), but consults the cache. Last element of returned tuple is
+    # True for cache hit, False for cache miss and None if the command can't be cached.
+    # Usage of cache hit is empty, it is not a measurement and shouldn't be recorded.
+    def run_cmd(self, cmd, time_out=None, num=-1, memory_limit=None, cpu_limit=None, cancel=None):
+        key = self.get_key(cmd)
+        output_file = cmd[cmd.index("-o") + 1] if key is not None else None
+        if key is not None:
+            cached_output = self.lookup(key, output_file)
+            if cached_output is not None:
+                common.log_msg(logging.DEBUG, "Build cache hit for " + str(cmd) + " in process " + str(num))
+                return 0, cached_output[0], cached_output[1], False, common.no_usage, True
+        ret_code, stdout, stderr, is_time_expired, usage = \
+            common.run_cmd_with_usage(cmd, time_out, num, memory_limit, cpu_limit, cancel)
+        if key is not None and ret_code == 0 and os.path.isfile(output_file):
+            self.insert(key, output_file, stdout, stderr)
+        return ret_code, stdout, stderr, is_time_expired, usage, False if key is not None else None
+
+
+# Run build commands one by one, until the first fail. Timeout and cpu limit are set for the whole build.
+# Returns ret_code, stdout, stderr, is_time_expired and usage of the build and numbers of cache hits and misses.
+# Usage of the build with any cache hit is partial, so it shouldn't be recorded as a measurement.
+# Builds, which produce something besides the artifacts (statistics, for example), shouldn't use cache.
+# Build is killed, when cancel event (threading.Event) is set. Limits are set in the child with preexec_fn,
+# which isn't safe, when the caller has other threads, so such callers pass no memory_limit and cpu_limit=False.
+def run_build_cmds(cmds, time_out, num=-1, memory_limit=None, use_cache=True, cancel=None, cpu_limit=True):
+    build_ret_code = 0
+    build_stdout = b""
+    build_stderr = b""
+    is_build_time_expired = False
+    build_usage = common.no_usage
+    hits = 0
+    misses = 0
+    for cmd in cmds:
+        time_left = max(time_out - int(build_usage.wall), 1)
+        cpu_time_left = time_left if cpu_limit else None
+        if cache is not None and use_cache:
+            ret_code, stdout, stderr, is_build_time_expired, usage, hit = \
+                cache.run_cmd(cmd, time_left, num, memory_limit, cpu_time_left, cancel)
+            hits += 1 if hit is True else 0
+            misses += 1 if hit is False else 0
+        else:
+            ret_code, stdout, stderr, is_build_time_expired, usage = \
+                common.run_cmd_with_usage(cmd, time_left, num, memory_limit, cpu_time_left, cancel)
+        build_stdout += stdout
+        build_stderr += stderr
+        build_usage = common.add_usage(build_usage, usage)
+        build_ret_code = ret_code
+        if is_build_time_expired or ret_code != 0:
+            break
+    return build_ret_code, build_stdout, build_stderr, is_build_time_expired, build_usage, hits, misses
@@ -0,0 +1,275 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+SQLite database of testing campaign.
+It keeps seeds, runs of generator and targets, blaming, reductions and saved tests of every run_gen.py run.
+Only the main process of run_gen.py writes to the database: workers send their records together with
+statistics updates and they are committed in batches.
+The script itself runs queries over the database.
+"""
+###############################################################################
+
+import argparse
+import logging
+import os
+import sqlite3
+import sys
+import time
+
+import common
+
+default_db_file_name = "campaign.db"
+
+# Records are kept and written again by the next commit, if the database can't be written (it may be locked by
+# another run, for example). Testing stops after this number of failed commits in a row.
+max_failed_commits = 10
+
+# Every table (except runs) has run_id and time columns, which are filled automatically
+schema = """
+CREATE TABLE IF NOT EXISTS runs (
+    run_id INTEGER PRIMARY KEY,
+    start_time REAL,
+    out_dir TEXT,
+    command_line TEXT
+);
+CREATE TABLE IF NOT EXISTS seeds (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    status TEXT,
+    campaign INTEGER,
+    shard INTEGER,
+    counter INTEGER
+);
+CREATE TABLE IF NOT EXISTS gen_runs (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    status TEXT,
+    user_time REAL,
+    sys_time REAL,
+    wall_time REAL,
+    max_rss INTEGER
+);
+CREATE TABLE IF NOT EXISTS target_runs (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    optset TEXT,
+    spec TEXT,
+    status TEXT,
+    build_user_time REAL,
+    build_sys_time REAL,
+    build_wall_time REAL,
+    build_max_rss INTEGER,
+    run_user_time REAL,
+    run_sys_time REAL,
+    run_wall_time REAL,
+    run_max_rss INTEGER,
+    checksum TEXT,
+    exe_hash TEXT,
+    run_dedup TEXT,
+    build_timeout INTEGER,
+    run_timeout INTEGER
+);
+CREATE TABLE IF NOT EXISTS blame (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    optset TEXT,
+    result TEXT,
+    phase TEXT,
+    steps INTEGER,
+    wall_time REAL
+);
+CREATE TABLE IF NOT EXISTS reductions (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    optset TEXT,
+    kind TEXT,
+    fingerprint TEXT,
+    wall_time REAL
+);
+CREATE TABLE IF NOT EXISTS saved_tests (
+    run_id INTEGER,
+    time REAL,
+    seed TEXT,
+    compiler TEXT,
+    fail_type TEXT,
+    classification TEXT,
+    fingerprint TEXT,
+    path TEXT
+);
+CREATE INDEX IF NOT EXISTS seeds_seed ON seeds (seed);
+CREATE INDEX IF NOT EXISTS seeds_shard ON seeds (campaign, shard, counter);
+CREATE INDEX IF NOT EXISTS gen_runs_seed ON gen_runs (seed);
+CREATE INDEX IF NOT EXISTS target_runs_seed ON target_runs (seed);
+CREATE INDEX IF NOT EXISTS target_runs_optset_status ON target_runs (optset, status, time);
+CREATE INDEX IF NOT EXISTS blame_seed ON blame (seed);
+CREATE INDEX IF NOT EXISTS reductions_seed ON reductions (seed);
+CREATE INDEX IF NOT EXISTS reductions_fingerprint ON reductions (fingerprint);
+CREATE INDEX IF NOT EXISTS saved_tests_seed ON saved_tests (seed);
+CREATE INDEX IF NOT EXISTS saved_tests_type ON saved_tests (compiler, fail_type, time);
+"""
+
+# Database of current process. It is set up by the main process of run_gen.py (see --campaign-db option).
+db = None
+
+
+def setup_db(db_file, out_dir, command_line):
+    global db
+    db = CampaignDB(db_file, out_dir, command_line) if db_file else None
+
+
+class CampaignDB(object):
+    def __init__(self, db_file, out_dir, command_line):
+        self.db_file = os.path.abspath(db_file)
+        self.conn = sqlite3.connect(self.db_file)
+        self.conn.executescript(schema)
+        cursor = self.conn.execute("INSERT INTO runs (start_time, out_dir, command_line) VALUES (?, ?, ?)",
+                                   (time.time(), out_dir, command_line))
+        self.run_id = cursor.lastrowid
+        self.conn.commit()
+        # Records, which are not committed yet: table -> list of rows
+        self.pending = {}
+        self.failed_commits = 0
+
+    def add(self, table, row):
+        row = dict(row, run_id=self.run_id, time=time.time())
+        self.pending.setdefault(table, []).append(row)
+
+    # Write all pending records in single transaction. If it fails, the transaction is rolled back and
+    # the records are kept for the next commit. Returns True, if all records are written.
+    def commit(self):
+        if len(self.pending) == 0:
+            return True
+        try:
+            with self.conn:
+                for table, rows in self.pending.items():
+                    columns = sorted(rows[0].keys())
+                    query = "INSERT INTO " + table + " (" + ", ".join(columns) + ") VALUES (" + \
+                            ", ".join("?" * len(columns)) + ")"
+                    self.conn.executemany(query, [[row.get(c) for c in columns] for row in rows])
+        except sqlite3.Error as e:
+            self.failed_commits += 1
+            common.log_msg(logging.ERROR, "Can't write to campaign database " + self.db_file + ": " + str(e) +
+                           " (" + str(sum(len(rows) for rows in self.pending.values())) +
+                           " records are kept for the next attempt)")
+            if self.failed_commits >= max_failed_commits:
+                common.print_and_exit("Campaign database " + self.db_file + " can't be written " +
+                                      str(self.failed_commits) + " times in a row")
+            return False
+        self.failed_commits = 0
+        self.pending = {}
+        return True
+
+    # Number of reductions per fingerprint of failure in all runs
+    def get_fingerprint_counts(self):
+        query = "SELECT fingerprint, COUNT(*) FROM reductions WHERE fingerprint IS NOT NULL GROUP BY fingerprint"
+        try:
+            return dict(self.conn.execute(query).fetchall())
+        except sqlite3.Error as e:
+            common.log_msg(logging.ERROR, "Can't read campaign database " + self.db_file + ": " + str(e))
+            return {}
+
+    def close(self):
+        if not self.commit():
+            common.print_and_exit("Records of campaign database " + self.db_file + " are lost")
+        self.conn.close()
+
+
+# Returns paths (relative to result directory) of saved tests, which satisfy the filters
+def get_saved_tests(db_file, compiler=None, fail_type=None, since=None):
+    conditions = []
+    params = []
+    for column, value in [("compiler", compiler), ("fail_type", fail_type)]:
+        if value is not None:
+            conditions.append(column + " = ?")
+            params.append(value)
+    if since is not None:
+        conditions.append("time >= ?")
+        params.append(since)
+    query = "SELECT DISTINCT path FROM saved_tests"
+    if conditions:
+        query += " WHERE " + " AND ".join(conditions)
+    conn = sqlite3.connect(db_file)
+    try:
+        return [row[0] for row in conn.execute(query, params)]
+    finally:
+        conn.close()
+
+
+# Coverage of seed space of campaigns: number of tested seeds and the range of counters per shard
+coverage_query = """
+SELECT campaign, shard, COUNT(DISTINCT counter), MIN(counter), MAX(counter)
+FROM seeds WHERE campaign IS NOT NULL GROUP BY campaign, shard ORDER BY campaign, shard
+"""
+
+
+# Failures per fingerprint: number of saved tests and reductions
+buckets_query = """
+SELECT s.fingerprint, s.fail_type, COUNT(*), (SELECT COUNT(*) FROM reductions r WHERE r.fingerprint = s.fingerprint)
+FROM saved_tests s WHERE s.fingerprint IS NOT NULL GROUP BY s.fingerprint, s.fail_type ORDER BY COUNT(*) DESC
+"""
+
+
+# Number of failed target runs and average build time per opt-set
+summary_query = """
+SELECT optset, status, COUNT(*), AVG(build_user_time + build_sys_time)
+FROM target_runs WHERE status != 'ok' GROUP BY optset, status ORDER BY optset, status
+"""
+
+
+###############################################################################
+
+if __name__ == '__main__':
+    description = 'Script for querying of campaign database of run_gen.py'
+    parser = argparse.ArgumentParser(description=description, formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+
+    requiredNamed = parser.add_argument_group('required named arguments')
+    requiredNamed.add_argument("-d", "--db", dest="db_file", type=str, required=True,
+                               help="Campaign database")
+    parser.add_argument("query", nargs="?", default=summary_query, type=str,
+                        help="SQL query. By default, failed target runs are summarized")
+    parser.add_argument("--coverage", dest="coverage", default=False, action="store_true",
+                        help="Report tested seeds of campaigns per shard (see --campaign option of run_gen.py)")
+    parser.add_argument("--buckets", dest="buckets", default=False, action="store_true",
+                        help="Report failures per fingerprint (see --reduce-per-fingerprint option of run_gen.py)")
+    args = parser.parse_args()
+    if args.coverage:
+        args.query = coverage_query
+    if args.buckets:
+        args.query = buckets_query
+
+    common.setup_logger(None, logging.INFO)
+    common.check_python_version()
+    if not os.path.isfile(args.db_file):
+        common.print_and_exit("Can't find campaign database " + args.db_file)
+    conn = sqlite3.connect(args.db_file)
+    try:
+        cursor = conn.execute(args.query)
+        if cursor.description is not None:
+            sys.stdout.write("|".join(column[0] for column in cursor.description) + "\n")
+        for row in cursor:
+            sys.stdout.write("|".join(str(value) for value in row) + "\n")
+    except sqlite3.Error as e:
+        common.print_and_exit("Query has failed: " + str(e))
+    finally:
+        conn.close()
@@ -26,6 +26,7 @@ import datetime
 import logging
 import multiprocessing
 import os
+import queue
 import shutil
 import sys
 import time
@@ -45,7 +46,7 @@ csmith_timeout = 30
 def form_statistics(stat, prev_len, task_threads=None):
     verbose_stat_str = ""
     for i in gen_test_makefile.CompilerTarget.all_targets:
-        if stat.is_stat_collected(i.name):
+        if stat.is_opt_stat_collected(i.name) or stat.is_stmt_stat_collected(i.name):
             verbose_stat_str += "\n=================================\n"
             verbose_stat_str += "Statistics for " + i.name + "\n"
             verbose_stat_str += "Optimization statistics: \n"
@@ -74,7 +75,18 @@ def form_statistics(stat, prev_len, task_threads=None):
     return stat_str, verbose_stat_str, prev_len
 
 
-def print_statistics(stat, task_threads, num_jobs):
+# Worker processes send batches of statistics updates (see run_gen.StatisticsBatch) through the queue,
+# and they are applied to statistics of the main process.
+def receive_updates(stat, updates_queue, time_out):
+    deadline = time.time() + time_out
+    while True:
+        try:
+            stat.apply_updates(updates_queue.get(timeout=max(deadline - time.time(), 0)))
+        except queue.Empty:
+            return
+
+
+def print_statistics(stat, updates_queue, task_threads, num_jobs):
     any_alive = True
     prev_len = 0
     while any_alive:
@@ -83,11 +95,13 @@ def print_statistics(stat, task_threads, num_jobs):
         sys.stdout.write(stat_str)
         sys.stdout.flush()
 
-        time.sleep(run_gen.stat_update_delay)
+        receive_updates(stat, updates_queue, run_gen.stat_update_delay)
 
         any_alive = False
         for num in range(num_jobs):
             any_alive |= task_threads[num].is_alive()
+    # Updates, which were sent right before exit of workers
+    receive_updates(stat, updates_queue, 0)
 
 
 def prepare_and_start(work_dir, config_file, timeout, num_jobs, csmith_bin_path, csmith_runtime, csmith_args, optsets):
@@ -138,8 +152,8 @@ def prepare_and_start(work_dir, config_file, timeout, num_jobs, csmith_bin_path,
     for i in range(num_jobs):
         common.check_dir_and_create(run_gen.process_dir + str(i))
 
-    manager_obj = run_gen.manager()
-    stat = manager_obj.Statistics()
+    stat = run_gen.Statistics()
+    updates_queue = multiprocessing.Queue()
 
     start_time = time.time()
     end_time = start_time + timeout * 60
@@ -149,10 +163,11 @@ def prepare_and_start(work_dir, config_file, timeout, num_jobs, csmith_bin_path,
     task_threads = [0] * num_jobs
     for num in range(num_jobs):
         task_threads[num] = multiprocessing.Process(target=run_csmith,
-                                                    args=(num, csmith_args, compiler_run_args, end_time, stat))
+                                                    args=(num, csmith_args, compiler_run_args, end_time,
+                                                          updates_queue))
         task_threads[num].start()
 
-    print_statistics(stat, task_threads, num_jobs)
+    print_statistics(stat, updates_queue, task_threads, num_jobs)
 
     sys.stdout.write("\n")
     for i in range(num_jobs):
@@ -164,8 +179,9 @@ def prepare_and_start(work_dir, config_file, timeout, num_jobs, csmith_bin_path,
     sys.stdout.flush()
 
 
-def run_csmith(num, csmith_args, compiler_run_args, end_time, stat):
+def run_csmith(num, csmith_args, compiler_run_args, end_time, updates_queue):
     common.log_msg(logging.DEBUG, "Job #" + str(num))
+    stat = run_gen.StatisticsBatch()
     os.chdir(run_gen.process_dir + str(num))
     work_dir = os.getcwd()
     inf = (end_time == -1)
@@ -196,6 +212,7 @@ def run_csmith(num, csmith_args, compiler_run_args, end_time, stat):
             stat.add_stats(opt_stats, optset_name, run_gen.StatsVault.opt_stats_id)
             stat.add_stats(stmt_stats, optset_name, run_gen.StatsVault.stmt_stats_id)
             stat.update_yarpgen_runs(run_gen.ok)
+        updates_queue.put(stat.flush())
 
 
 
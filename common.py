@@ -21,14 +21,26 @@ File for common data and functions, which are used in scripts
 """
 ###############################################################################
 
+import collections
 import datetime
 import errno
+import hashlib
 import logging
 import os
+import resource
 import shutil
 import signal
+import struct
 import subprocess
 import sys
+import tempfile
+import threading
+import time
+
+# Worker processes of run_gen.py are forked, so threads of the main process (heartbeat of agent, metrics server)
+# hold this lock, while they work. Otherwise, worker may inherit the lock (of logging, for example), which is held
+# by the thread at the moment of fork, and hang on it forever. Such threads are started after the first fork.
+fork_lock = threading.Lock()
 
 # $YARPGEN_HOME environment variable should be set to YARP Generator directory
 yarpgen_home = os.environ["YARPGEN_HOME"] if "YARPGEN_HOME" in os.environ else os.getcwd()
@@ -160,52 +172,123 @@ def check_dir_and_create(directory):
         print_and_exit("Can't use '" + norm_dir + "' directory")
 
 
-def run_cmd(cmd, time_out=None, num=-1, memory_limit=None):
-    is_time_expired = False
-    shell = False
-    if memory_limit is not None:
-        shell = True
-        new_cmd = "ulimit -v " + str(memory_limit) + " ; "
-        new_cmd += " ".join(i for i in cmd)
-        cmd = new_cmd
-    start_time = os.times()
-    with subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, start_new_session=True, shell=shell) as process:
+# Limits of child process are set with setrlimit() right before exec, so no shell is needed.
+# memory_limit is in kbytes (as for ulimit -v), cpu_limit is in seconds. Process, which exceeds
+# its cpu_limit, is treated in the same way as expired timeout.
+def set_child_limits(memory_limit, cpu_limit):
+    for res_id, limit in [(resource.RLIMIT_AS, memory_limit * 1024 if memory_limit is not None else None),
+                          (resource.RLIMIT_CPU, cpu_limit)]:
+        if limit is None:
+            continue
+        soft, hard = resource.getrlimit(res_id)
+        if hard != resource.RLIM_INFINITY:
+            limit = min(limit, hard)
+        resource.setrlimit(res_id, (limit, hard))
+
+
+# Resource usage of child process and all its descendants: user, system and wall time (in seconds)
+# and peak resident set size (in kbytes)
+ResourceUsage = collections.namedtuple("ResourceUsage", ["user", "sys", "wall", "max_rss"])
+no_usage = ResourceUsage(0.0, 0.0, 0.0, 0)
+
+
+# Usage of sequentially executed commands: times are summed up, memory is the peak of them
+def add_usage(usage_a, usage_b):
+    return ResourceUsage(usage_a.user + usage_b.user, usage_a.sys + usage_b.sys, usage_a.wall + usage_b.wall,
+                         max(usage_a.max_rss, usage_b.max_rss))
+
+
+# Returns cpu time (user + sys) as the last element for compatibility, see run_cmd_with_usage() for details
+def run_cmd(cmd, time_out=None, num=-1, memory_limit=None, cpu_limit=None, cancel=None):
+    ret_code, output, err_output, is_time_expired, usage = \
+        run_cmd_with_usage(cmd, time_out, num, memory_limit, cpu_limit, cancel)
+    return ret_code, output, err_output, is_time_expired, usage.user + usage.sys
+
+
+# Maximal delay (in seconds) between checks of exit of the process and of cancel event in wait_with_rusage()
+wait_poll_delay = 0.05
+
+
+# Waits until the process exits and reaps it with wait4(), which reports usage of exactly this child, while
+# deltas of os.times() include all children, which were reaped by other threads in the meantime. Popen would
+# reap the child with waitpid() and lose its usage, so the child is reaped here and Popen only gets returncode.
+# Process group is killed as soon as cancel event (threading.Event) is set.
+# Returns rusage (or None, if the child was reaped by somebody else) or raises subprocess.TimeoutExpired.
+def wait_with_rusage(process, time_out=None, cancel=None):
+    deadline = time.monotonic() + time_out if time_out is not None else None
+    delay = 0.0005
+    while True:
         try:
-            log_msg_str = "Running " + str(cmd)
-            if num != -1:
-                log_msg_str += " in process " + str(num)
-            if time_out is None:
-                log_msg_str += " without timeout"
-            else:
-                log_msg_str += " with " + str(time_out) + " timeout"
-            log_msg(logging.DEBUG, log_msg_str)
-            output, err_output = process.communicate(timeout=time_out)
-            ret_code = process.poll()
-        except subprocess.TimeoutExpired:
-            log_msg(logging.DEBUG, "Timeout triggered for proc num " + str(process.pid) + " sending kill signal to group")
-            # Sigterm is good enough here and compared to sigkill gives a chance to the processes
-            # to clean up after themselves.
-            os.killpg(os.getpgid(process.pid), signal.SIGTERM)
-            # once in a while stdout/stderr may not exist when the process is killed, so using try.
-            try:
-                output, err_output = process.communicate()
-            except ValueError:
-                output = b''
-                err_output = b''
-            log_msg(logging.DEBUG, "Procces " + str(process.pid) + " has finally died")
-            is_time_expired = True
-            ret_code = None
-        except:
-            log_msg(logging.ERROR, str(cmd) + " failed: unknown exception (proc num "+ str(process.pid) + ")")
-            # Something really bad is going on, so better to send sigkill
+            (pid, sts, rusage) = os.wait4(process.pid, os.WNOHANG)
+        except ChildProcessError:
+            process.returncode = 0
+            return None
+        if pid == process.pid:
+            process.returncode = -os.WTERMSIG(sts) if os.WIFSIGNALED(sts) else os.WEXITSTATUS(sts)
+            return rusage
+        if deadline is not None and time.monotonic() >= deadline:
+            raise subprocess.TimeoutExpired(process.args, time_out)
+        if cancel is not None and cancel.is_set():
+            log_msg(logging.DEBUG, "Process " + str(process.pid) + " is cancelled, sending kill signal to group")
             os.killpg(os.getpgid(process.pid), signal.SIGKILL)
-            process.wait()
-            log_msg(logging.DEBUG, "Procces " + str(process.pid) + " has finally died")
-            raise
-    end_time = os.times()
-    elapsed_time = end_time.children_user - start_time.children_user + \
-                   end_time.children_system - start_time.children_system
-    return ret_code, output, err_output, is_time_expired, elapsed_time
+            cancel = None
+        delay = min(delay * 2, wait_poll_delay)
+        time.sleep(delay if deadline is None else max(min(delay, deadline - time.monotonic()), 0))
+
+
+# Output of the process is collected in temporary files instead of pipes, so the process never blocks on
+# full pipe while we wait for its exit (see wait_with_rusage()).
+def run_cmd_with_usage(cmd, time_out=None, num=-1, memory_limit=None, cpu_limit=None, cancel=None):
+    is_time_expired = False
+    preexec_fn = None
+    if memory_limit is not None or cpu_limit is not None:
+        preexec_fn = lambda: set_child_limits(memory_limit, cpu_limit)
+    start_time = time.monotonic()
+    with tempfile.TemporaryFile() as out_file, tempfile.TemporaryFile() as err_file:
+        with subprocess.Popen(cmd, stdout=out_file, stderr=err_file, start_new_session=True,
+                              preexec_fn=preexec_fn) as process:
+            try:
+                log_msg_str = "Running " + str(cmd)
+                if num != -1:
+                    log_msg_str += " in process " + str(num)
+                if time_out is None:
+                    log_msg_str += " without timeout"
+                else:
+                    log_msg_str += " with " + str(time_out) + " timeout"
+                log_msg(logging.DEBUG, log_msg_str)
+                rusage = wait_with_rusage(process, time_out, cancel)
+                ret_code = process.returncode
+                if cpu_limit is not None and ret_code == -signal.SIGXCPU:
+                    log_msg(logging.DEBUG, "CPU time limit is exceeded for proc num " + str(process.pid))
+                    is_time_expired = True
+                    ret_code = None
+            except subprocess.TimeoutExpired:
+                log_msg(logging.DEBUG, "Timeout triggered for proc num " + str(process.pid) +
+                        " sending kill signal to group")
+                # Sigterm is good enough here and compared to sigkill gives a chance to the processes
+                # to clean up after themselves.
+                os.killpg(os.getpgid(process.pid), signal.SIGTERM)
+                rusage = wait_with_rusage(process)
+                log_msg(logging.DEBUG, "Procces " + str(process.pid) + " has finally died")
+                is_time_expired = True
+                ret_code = None
+            except:
+                log_msg(logging.ERROR, str(cmd) + " failed: unknown exception (proc num "+ str(process.pid) + ")")
+                # Something really bad is going on, so better to send sigkill
+                os.killpg(os.getpgid(process.pid), signal.SIGKILL)
+                process.wait()
+                log_msg(logging.DEBUG, "Procces " + str(process.pid) + " has finally died")
+                raise
+        wall_time = time.monotonic() - start_time
+        out_file.seek(0)
+        output = out_file.read()
+        err_file.seek(0)
+        err_output = err_file.read()
+    if rusage is not None:
+        usage = ResourceUsage(rusage.ru_utime, rusage.ru_stime, wall_time, rusage.ru_maxrss)
+    else:
+        usage = no_usage._replace(wall=wall_time)
+    return ret_code, output, err_output, is_time_expired, usage
 
 
 def if_exec_exist(program):
@@ -234,3 +317,88 @@ def clean_dir(path):
             os.remove(os.path.join(root, name))
         for name in dirs:
             os.rmdir(os.path.join(root, name))
+
+
+# Find section of ELF file by name. Returns (offset, size) of its content or None.
+def find_elf_section(data, section_name):
+    if data[:4] != b"\x7fELF":
+        return None
+    endian = "<" if data[5] == 1 else ">"
+    if data[4] == 2:
+        sh_offset, = struct.unpack_from(endian + "Q", data, 0x28)
+        sh_entry_size, sh_num, sh_str_index = struct.unpack_from(endian + "HHH", data, 0x3A)
+        # name, type, flags, addr, offset, size
+        sh_format = endian + "IIQQQQ"
+    else:
+        sh_offset, = struct.unpack_from(endian + "I", data, 0x20)
+        sh_entry_size, sh_num, sh_str_index = struct.unpack_from(endian + "HHH", data, 0x2E)
+        sh_format = endian + "IIIIII"
+    sections = [struct.unpack_from(sh_format, data, sh_offset + i * sh_entry_size) for i in range(sh_num)]
+    str_table_offset = sections[sh_str_index][4]
+    for section in sections:
+        name_offset = str_table_offset + section[0]
+        if data[name_offset:data.index(b"\0", name_offset)] == section_name:
+            return section[4], section[5]
+    return None
+
+
+# Hash of executable file. Build-id note is unique for every link, so it is excluded.
+def hash_executable(file_name):
+    with open(file_name, "rb") as exe_file:
+        data = bytearray(exe_file.read())
+    try:
+        build_id = find_elf_section(data, b".note.gnu.build-id")
+        if build_id is not None:
+            offset, size = build_id
+            data[offset:offset + size] = bytes(size)
+    except (struct.error, ValueError, IndexError):
+        log_msg(logging.DEBUG, "Can't parse " + file_name + " as ELF file")
+    return hashlib.sha256(data).hexdigest()
+
+
+def get_dir_size(path):
+    size = 0
+    for root, dirs, files in os.walk(path):
+        for name in files:
+            try:
+                size += os.lstat(os.path.join(root, name)).st_size
+            except OSError:
+                # File may be removed in the meantime
+                pass
+    return size
+
+
+# Sharded seed space (see --campaign option of yarpgen and run_gen.py). Campaign ID, shard index and counter
+# are packed into 64-bit index, which is mapped to the seed with finalizer of splitmix64. The mapping is
+# bijective, so seed streams of different shards never intersect and every seed can be traced back.
+# It should be kept in sync with RandValGen::get_shard_seed().
+campaign_bits = 16
+shard_bits = 16
+counter_bits = 32
+mask_64 = (1 << 64) - 1
+
+
+def get_shard_seed(campaign, shard, counter):
+    if not 0 < campaign < (1 << campaign_bits) or not 0 <= shard < (1 << shard_bits) or \
+       not 0 <= counter < (1 << counter_bits):
+        raise ValueError("Coordinates of sharded seed are out of range: " + str((campaign, shard, counter)))
+    z = (campaign << (shard_bits + counter_bits)) | (shard << counter_bits) | counter
+    z = ((z ^ (z >> 30)) * 0xbf58476d1ce4e5b9) & mask_64
+    z = ((z ^ (z >> 27)) * 0x94d049bb133111eb) & mask_64
+    return z ^ (z >> 31)
+
+
+def unshift_xor(z, shift):
+    res = z
+    for i in range(64 // shift):
+        res = z ^ (res >> shift)
+    return res
+
+
+# Inverse of get_shard_seed(). Returns (campaign, shard, counter). Campaign is 0 for seeds outside of any campaign.
+def get_shard_coords(seed):
+    z = unshift_xor(seed & mask_64, 31)
+    z = unshift_xor((z * 0x319642b2d24d8ec3) & mask_64, 27)
+    z = unshift_xor((z * 0x96de1b173f119089) & mask_64, 30)
+    return z >> (shard_bits + counter_bits), (z >> counter_bits) & ((1 << shard_bits) - 1), \
+        z & ((1 << counter_bits) - 1)
@@ -0,0 +1,170 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Calibration of compilation cost model.
+It fits coefficients of linear model, which predicts compilation time from features of generated test.
+Timing data is collected by run_gen.py (see --cost-data option) as JSON records, one per line.
+Resulting file is used by yarpgen's --cost-model option.
+"""
+###############################################################################
+
+import argparse
+import json
+import logging
+
+import common
+
+intercept_name = "intercept"
+
+# Regularization, which is relative to diagonal of normal equations matrix.
+# It makes the fit stable when some features are (almost) linearly dependent.
+ridge_factor = 1e-6
+
+###############################################################################
+
+
+# Solve system of linear equations with Gaussian elimination (matrix is modified)
+def solve(a, b):
+    n = len(b)
+    for col in range(n):
+        pivot = max(range(col, n), key=lambda r: abs(a[r][col]))
+        if a[pivot][col] == 0:
+            continue
+        a[col], a[pivot] = a[pivot], a[col]
+        b[col], b[pivot] = b[pivot], b[col]
+        for row in range(col + 1, n):
+            factor = a[row][col] / a[col][col]
+            for k in range(col, n):
+                a[row][k] -= factor * a[col][k]
+            b[row] -= factor * b[col]
+    x = [0.0] * n
+    for row in reversed(range(n)):
+        if a[row][row] == 0:
+            continue
+        x[row] = (b[row] - sum(a[row][k] * x[k] for k in range(row + 1, n))) / a[row][row]
+    return x
+
+
+# Least squares fit of y = X * coef for columns in active set.
+# Columns are scaled to [-1, 1] range, because features differ by orders of magnitude.
+def least_squares(x_rows, y, active):
+    n = len(active)
+    scale = [max([abs(row[i]) for row in x_rows] + [1e-300]) for i in active]
+    a = [[0.0] * n for i in range(n)]
+    b = [0.0] * n
+    for row, y_val in zip(x_rows, y):
+        scaled_row = [row[active[i]] / scale[i] for i in range(n)]
+        for i in range(n):
+            b[i] += scaled_row[i] * y_val
+            for j in range(n):
+                a[i][j] += scaled_row[i] * scaled_row[j]
+    for i in range(n):
+        a[i][i] += ridge_factor * a[i][i]
+    return [c / s for c, s in zip(solve(a, b), scale)]
+
+
+# Fit coefficients. Compilation time can't be negative or decrease when test grows,
+# so all coefficients are forced to be non-negative.
+def fit(x_rows, y, feature_count):
+    active = list(range(feature_count))
+    while True:
+        active_coef = least_squares(x_rows, y, active)
+        negative = [(c, i) for c, i in zip(active_coef, active) if c < 0]
+        if not negative:
+            break
+        active.remove(min(negative)[1])
+    coef = [0.0] * feature_count
+    for c, i in zip(active_coef, active):
+        coef[i] = c
+    return coef
+
+
+def predict(coef, row):
+    return sum(c * x for c, x in zip(coef, row))
+
+
+def read_cost_data(data_file_name, target):
+    data_file = common.check_and_open_file(data_file_name, "r")
+    feature_names = None
+    x_rows = []
+    y = []
+    for line in data_file:
+        if not line.strip():
+            continue
+        record = json.loads(line)
+        if record["target"] != target:
+            continue
+        if feature_names is None:
+            feature_names = sorted(record["features"])
+        x_rows.append([1.0] + [float(record["features"].get(f, 0)) for f in feature_names])
+        y.append(float(record["build_time"]) * 1000)
+    data_file.close()
+    return [intercept_name] + (feature_names or []), x_rows, y
+
+
+def calibrate(data_file_name, target, out_file_name):
+    names, x_rows, y = read_cost_data(data_file_name, target)
+    if len(x_rows) < len(names):
+        common.print_and_exit("Not enough timing data for " + target + ": " + str(len(x_rows)) +
+                              " samples, at least " + str(len(names)) + " are required")
+
+    coef = fit(x_rows, y, len(names))
+
+    rel_err = [abs(predict(coef, row) - y_val) / y_val for row, y_val in zip(x_rows, y) if y_val > 0]
+    common.log_msg(logging.INFO, "Fitted cost model for " + target + " on " + str(len(x_rows)) + " samples")
+    if rel_err:
+        common.log_msg(logging.INFO, "Mean relative error: " + "{:.1f}".format(100 * sum(rel_err) / len(rel_err)) +
+                       "%, max relative error: " + "{:.1f}".format(100 * max(rel_err)) + "%")
+
+    out_file = open(out_file_name, "w")
+    out_file.write("# Compilation cost model for " + target + " (time in ms)\n")
+    out_file.write("# Fitted on " + str(len(x_rows)) + " samples from " + data_file_name + "\n")
+    for name, c in zip(names, coef):
+        out_file.write(name + " " + repr(c) + "\n")
+    out_file.close()
+
+###############################################################################
+
+if __name__ == '__main__':
+    description = 'Script for calibration of compilation cost model.'
+    epilog = '''
+Examples:
+Collect timing data and fit the model for clang_opt target
+        run_gen.py --target clang --cost-data cost_data.jsonl
+        cost_model.py --data cost_data.jsonl --target clang_opt -o clang_opt.model
+Generate the test, which takes about 10 seconds to compile
+        yarpgen --cost-model=clang_opt.model --target-compile-ms=10000
+    '''
+    parser = argparse.ArgumentParser(description=description, epilog=epilog,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--data", dest="data_file", default="cost_data.jsonl", type=str,
+                        help="Timing data, collected by run_gen.py")
+    parser.add_argument("--target", dest="target", required=True, type=str,
+                        help="Testing set (see test_sets.txt) to fit the model for")
+    parser.add_argument("-o", "--output", dest="out_file", default="cost_model.txt", type=str,
+                        help="Output file with model coefficients")
+    parser.add_argument("-v", "--verbose", dest="verbose", default=False, action="store_true",
+                        help="Increase output verbosity")
+    args = parser.parse_args()
+
+    log_level = logging.DEBUG if args.verbose else logging.INFO
+    common.setup_logger(None, log_level)
+    common.check_python_version()
+
+    calibrate(args.data_file, args.target, args.out_file)
@@ -26,6 +26,7 @@ import logging
 import os
 import sys
 import re
+import shlex
 
 import common
 
@@ -230,6 +231,67 @@ class StatisticsOptions (object):
         except KeyError:
             common.print_and_exit("Can't find key!")
 
+###############################################################################
+# Section for command lines of targets.
+# They are used both for Test_Makefile and for direct invocation of compilers by run_gen.py.
+
+
+def get_compiler_name(target):
+    if selected_standard.is_c():
+        return target.specs.comp_c_name
+    if selected_standard.is_cxx():
+        return target.specs.comp_cxx_name
+    return None
+
+
+def get_opt_flags(target):
+    optflags = target.args
+    if target.arch.comp_name != "":
+        optflags += " " + target.specs.arch_prefix + target.arch.comp_name
+    return optflags
+
+
+# For performance reasons driver should always be compiled with -O0
+def get_driver_opt_flags(target):
+    return re.sub("-O\d", "-O0", get_opt_flags(target))
+
+
+def get_object_name(target, source):
+    return target.name + "_" + source.split(".")[0] + ".o"
+
+
+def get_executable_name(target):
+    return target.name + "_" + executable.value
+
+
+# Returns the list of commands (compilation of every source and link), which are equivalent to
+# "make -f Test_Makefile <target>". Test may be placed to another directory (work_dir).
+def get_build_cmds(target, stat_flags="", blame_opts="", work_dir=""):
+    compiler = get_compiler_name(target)
+    cmds = []
+    for source in sources.value.split():
+        optflags = get_opt_flags(target) if not source.startswith("driver") else get_driver_opt_flags(target)
+        cmd = [compiler] + shlex.split(cxx_flags.value) + shlex.split(std_flags.value) + shlex.split(optflags) + \
+              ["-o", os.path.join(work_dir, get_object_name(target, source)), "-c", os.path.join(work_dir, source)]
+        if source.startswith("func"):
+            cmd += shlex.split(stat_flags) + shlex.split(blame_opts)
+        cmds.append(cmd)
+    cmds.append([compiler] + shlex.split(ld_flags.value) + shlex.split(std_flags.value) +
+                shlex.split(get_opt_flags(target)) +
+                ["-o", os.path.join(work_dir, get_executable_name(target))] +
+                [os.path.join(work_dir, get_object_name(target, s)) for s in sources.value.split()])
+    return cmds
+
+
+# Returns command, which is equivalent to "make -f Test_Makefile run_<target>"
+def get_run_cmd(target, work_dir="."):
+    cmd = []
+    required_sde_arch = define_sde_arch(detect_native_arch(), target.arch.sde_arch)
+    if required_sde_arch != "":
+        cmd += ["sde", "-" + required_sde_arch, "--"]
+    cmd.append(os.path.join(work_dir, get_executable_name(target)))
+    return cmd
+
 ###############################################################################
 # Section for config parser
 
@@ -308,7 +370,14 @@ def parse_config(file_name):
 ###############################################################################
 
 
+# Native arch is detected only once (before worker processes are started)
+native_arch = None
+
+
 def detect_native_arch():
+    global native_arch
+    if native_arch is not None:
+        return native_arch
     check_isa_file = os.path.abspath(common.yarpgen_home + os.sep + check_isa_file_name)
     check_isa_binary = os.path.abspath(common.yarpgen_home + os.sep + check_isa_file_name.replace(".cpp", ""))
 
@@ -335,6 +404,7 @@ def detect_native_arch():
     native_arch_str = str(output, "utf-8").split()[0]
     for sde_target in SdeTarget.all_sde_targets:
         if sde_target.name == native_arch_str:
+            native_arch = sde_target
             return sde_target
     common.print_and_exit("Can't detect system ISA")
 
@@ -371,20 +441,9 @@ def gen_makefile(out_file_name, force, config_file, only_target=None, inject_bla
     for target in CompilerTarget.all_targets:
         if only_target is not None and only_target.name != target.name:
             continue
-        compiler_name = None
-        if selected_standard.is_c():
-            compiler_name = target.specs.comp_c_name
-        if selected_standard.is_cxx():
-            compiler_name = target.specs.comp_cxx_name
-        output += target.name + ": " + "COMPILER=" + compiler_name + "\n"
-
-        optflags_str = target.name + ": " + "OPTFLAGS=" + target.args
-        if target.arch.comp_name != "":
-            optflags_str += " " + target.specs.arch_prefix + target.arch.comp_name
-        optflags_str += "\n"
-        output += optflags_str
-        # For performance reasons driver should always be compiled with -O0
-        output += re.sub("-O\d", "-O0", (optflags_str.replace("OPTFLAGS", "DRIVER_OPTFLAGS")))
+        output += target.name + ": " + "COMPILER=" + get_compiler_name(target) + "\n"
+        output += target.name + ": " + "OPTFLAGS=" + get_opt_flags(target) + "\n"
+        output += target.name + ": " + "DRIVER_OPTFLAGS=" + get_driver_opt_flags(target) + "\n"
 
         if inject_blame_opt is not None:
             output += target.name + ": " + "BLAMEOPTS=" + inject_blame_opt + "\n"
@@ -395,7 +454,7 @@ def gen_makefile(out_file_name, force, config_file, only_target=None, inject_bla
                     output += target.name + ": " + stat_options.name + "=" + \
                               StatisticsOptions.get_options(target.specs) + "\n"
                     stat_targets.remove(stat_target)
-        output += target.name + ": " + "EXECUTABLE=" + target.name + "_" + executable.value + "\n"
+        output += target.name + ": " + "EXECUTABLE=" + get_executable_name(target) + "\n"
         output += target.name + ": " + "$(addprefix " + target.name + "_, $(SOURCES:" + get_file_ext() + "=.o))\n"
         output += "\t" + "$(COMPILER) $(LDFLAGS) $(STDFLAGS) $(OPTFLAGS) -o $(EXECUTABLE) $^\n\n"
 
@@ -0,0 +1,192 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Live metrics of testing campaign in Prometheus text format.
+Metrics are served by HTTP server on localhost (scraped by Prometheus) and/or written to a file for textfile
+collector of node exporter. Only the main process of run_gen.py updates them: statistics updates of workers
+are applied there anyway. Rates (seeds/s, builds/s and runs/s) are computed by Prometheus from counters.
+"""
+###############################################################################
+
+import http.server
+import logging
+import os
+import tempfile
+import threading
+import time
+
+import common
+
+# Buckets (in seconds) of latency histograms
+latency_buckets = [0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300, 600]
+
+# Name -> (type, help, buckets)
+definitions = {
+    "yarpgen_generator_runs_total": ("counter", "Runs of generator by status", None),
+    "yarpgen_generator_seconds": ("histogram", "Wall time of generator runs", latency_buckets),
+    "yarpgen_target_runs_total": ("counter", "Finished runs of testing sets by status", None),
+    "yarpgen_build_seconds": ("histogram", "Wall time of builds by testing set (build cache hits are excluded)",
+                              latency_buckets),
+    "yarpgen_run_seconds": ("histogram", "Wall time of test runs by testing set", latency_buckets),
+    "yarpgen_max_rss_bytes": ("gauge", "Max RSS of the last build or run by testing set", None),
+    "yarpgen_workers": ("gauge", "Number of worker processes (agents for coordinator)", None),
+    "yarpgen_busy_workers": ("gauge", "Number of workers, which execute tasks", None),
+    "yarpgen_queued_tasks": ("gauge", "Tasks, which wait in deques of workers", None),
+    "yarpgen_tests_in_flight": ("gauge", "Seeds, which own test directory", None),
+    "yarpgen_prefetched_tests": ("gauge", "Generated seeds, which wait for free worker", None),
+    "yarpgen_reserved_memory_bytes": ("gauge", "Predicted peak RSS of running builds", None),
+    "yarpgen_queued_seeds": ("gauge", "Seeds of expired leases, which wait for agent", None),
+    "yarpgen_process_rss_bytes": ("gauge", "RSS of the main and worker processes of run_gen.py", None),
+    "yarpgen_last_update_timestamp_seconds": ("gauge", "Time of the last update of metrics", None),
+}
+
+# Metrics of current process. They are set up by run_gen.py (see --metrics-port and --metrics-file options).
+metrics = None
+
+
+def setup_metrics(port, file_name):
+    global metrics
+    metrics = Metrics(port, file_name) if port or file_name else None
+
+
+# Server thread is started after worker processes of run_gen.py are forked (see common.fork_lock)
+def start_server():
+    if metrics is not None:
+        metrics.start()
+
+
+def format_labels(labels):
+    if len(labels) == 0:
+        return ""
+    return "{" + ",".join(name + "=\"" + str(value).replace("\\", "\\\\").replace("\"", "\\\"") + "\""
+                          for name, value in labels) + "}"
+
+
+def format_value(value):
+    return repr(float(value)) if isinstance(value, float) else str(value)
+
+
+class Metrics(object):
+    def __init__(self, port, file_name):
+        # Name -> {sorted labels: value}. Value of histogram is [bucket counts, sum, count].
+        self.values = {name: {} for name in definitions}
+        self.lock = threading.Lock()
+        self.file_name = os.path.abspath(file_name) if file_name else None
+        self.server = None
+        if port:
+            metrics_obj = self
+
+            class Handler(http.server.BaseHTTPRequestHandler):
+                def do_GET(self):
+                    with common.fork_lock:
+                        data = metrics_obj.render().encode("utf-8")
+                    self.send_response(200)
+                    self.send_header("Content-Type", "text/plain; version=0.0.4")
+                    self.send_header("Content-Length", str(len(data)))
+                    self.end_headers()
+                    self.wfile.write(data)
+
+                def log_message(self, format, *args):
+                    pass
+
+            try:
+                self.server = http.server.HTTPServer(("localhost", port), Handler)
+            except OSError as e:
+                common.print_and_exit("Can't serve metrics on port " + str(port) + ": " + str(e))
+        self.server_thread = None
+
+    def start(self):
+        if self.server is None or self.server_thread is not None:
+            return
+        self.server_thread = threading.Thread(target=self.server.serve_forever, daemon=True)
+        self.server_thread.start()
+        common.log_msg(logging.DEBUG, "Metrics are served on http://localhost:" + str(self.server.server_address[1]) +
+                       "/metrics")
+
+    def inc(self, name, labels=None, value=1):
+        key = tuple(sorted((labels or {}).items()))
+        with self.lock:
+            self.values[name][key] = self.values[name].get(key, 0) + value
+
+    def set(self, name, value, labels=None):
+        key = tuple(sorted((labels or {}).items()))
+        with self.lock:
+            self.values[name][key] = value
+
+    def observe(self, name, value, labels=None):
+        key = tuple(sorted((labels or {}).items()))
+        buckets = definitions[name][2]
+        with self.lock:
+            hist = self.values[name].setdefault(key, [[0] * len(buckets), 0.0, 0])
+            for i, bound in enumerate(buckets):
+                if value <= bound:
+                    hist[0][i] += 1
+            hist[1] += value
+            hist[2] += 1
+
+    def render(self):
+        lines = []
+        with self.lock:
+            for name in sorted(definitions):
+                metric_type, metric_help, buckets = definitions[name]
+                lines.append("# HELP " + name + " " + metric_help)
+                lines.append("# TYPE " + name + " " + metric_type)
+                for key, value in sorted(self.values[name].items()):
+                    if metric_type != "histogram":
+                        lines.append(name + format_labels(key) + " " + format_value(value))
+                        continue
+                    bucket_counts, value_sum, count = value
+                    for bound, bucket_count in zip(buckets, bucket_counts):
+                        lines.append(name + "_bucket" + format_labels(key + (("le", format_value(float(bound))),)) +
+                                     " " + str(bucket_count))
+                    lines.append(name + "_bucket" + format_labels(key + (("le", "+Inf"),)) + " " + str(count))
+                    lines.append(name + "_sum" + format_labels(key) + " " + format_value(value_sum))
+                    lines.append(name + "_count" + format_labels(key) + " " + str(count))
+        return "\n".join(lines) + "\n"
+
+    # Called periodically by the main loop. Textfile is replaced atomically, so collector never reads
+    # partially written file.
+    def flush(self):
+        self.set("yarpgen_last_update_timestamp_seconds", time.time())
+        if self.file_name is None:
+            return
+        try:
+            fd, tmp_name = tempfile.mkstemp(prefix=".tmp_", dir=os.path.dirname(self.file_name))
+            with os.fdopen(fd, "w") as f:
+                f.write(self.render())
+            os.chmod(tmp_name, 0o644)
+            os.replace(tmp_name, self.file_name)
+        except OSError as e:
+            common.log_msg(logging.WARNING, "Can't write metrics to " + self.file_name + ": " + str(e))
+
+    def close(self):
+        self.flush()
+        if self.server_thread is not None:
+            self.server.shutdown()
+        if self.server is not None:
+            self.server.server_close()
+
+
+# RSS (in bytes) of process or 0, if it is unknown
+def get_process_rss(pid):
+    try:
+        with open("/proc/" + str(pid) + "/statm", "r") as f:
+            return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except (OSError, ValueError, IndexError):
+        return 0
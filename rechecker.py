@@ -28,7 +28,10 @@ import os
 import sys
 import queue
 
+import build_cache
+import campaign_db
 import common
+import result_store
 import gen_test_makefile
 import run_gen
 import blame_opt
@@ -48,7 +51,18 @@ def process_dir(directory, task_queue):
     return task_queue
 
 
-def prepare_env_and_recheck(input_dir, out_dir, target, num_jobs, config_file):
+# Take saved tests from campaign database instead of walking the directory
+def process_db(db_file, directory, compiler, fail_type, task_queue):
+    common.log_msg(logging.DEBUG, "Searching for test directories in " + str(db_file))
+    for path in campaign_db.get_saved_tests(db_file, compiler, fail_type):
+        test_dir = os.path.join(directory, path)
+        if common.check_if_dir_exists(test_dir):
+            common.log_msg(logging.DEBUG, "Adding " + str(test_dir))
+            task_queue.put(test_dir)
+    return task_queue
+
+
+def prepare_env_and_recheck(input_dir, out_dir, target, num_jobs, config_file, db_file, compiler, fail_type):
     if not common.check_if_dir_exists(input_dir):
         common.print_and_exit("Can't use input directory")
     common.check_dir_and_create(out_dir)
@@ -60,7 +74,10 @@ def prepare_env_and_recheck(input_dir, out_dir, target, num_jobs, config_file):
     lock = multiprocessing.Lock()
 
     task_queue = multiprocessing.JoinableQueue()
-    process_dir(input_dir, task_queue)
+    if db_file is not None:
+        process_db(db_file, input_dir, compiler, fail_type, task_queue)
+    else:
+        process_dir(input_dir, task_queue)
     failed_queue = multiprocessing.SimpleQueue()
     passed_queue = multiprocessing.SimpleQueue()
 
@@ -85,10 +102,15 @@ def recheck(num, lock, task_queue, failed_queue, passed_queue, target, out_dir):
     job_finished = False
     while not job_finished:
         try:
-            test_dir = task_queue.get_nowait()
+            # Queue is filled before workers start, but its feeder thread may be late, so get_nowait() may
+            # raise queue.Empty for non-empty queue
+            test_dir = task_queue.get(timeout=1)
             task_queue.task_done()
             common.log_msg(logging.DEBUG, "#" + str(num) + " test directory: " + str(test_dir))
             abs_test_dir = os.path.join(cwd_save, test_dir)
+            # Tests from result store are extracted in place
+            if result_store.is_stored_test(abs_test_dir):
+                result_store.extract_test(abs_test_dir, abs_test_dir)
             common.check_and_copy(os.path.join(os.path.join(cwd_save, out_dir), gen_test_makefile.Test_Makefile_name),
                                   os.path.join(abs_test_dir,               gen_test_makefile.Test_Makefile_name))
             os.chdir(os.path.join(cwd_save, abs_test_dir))
@@ -101,9 +123,10 @@ def recheck(num, lock, task_queue, failed_queue, passed_queue, target, out_dir):
                     continue
 
                 common.log_msg(logging.DEBUG, "Re-checking target " + i.name)
-                ret_code, output, err_output, time_expired, elapsed_time = \
-                    common.run_cmd(["make", "-f", gen_test_makefile.Test_Makefile_name, i.name],
-                                   run_gen.compiler_timeout, num)
+                # Saved tests are rebuilt over and over, so compilers are invoked directly through build cache
+                ret_code, output, err_output, time_expired, usage, cache_hits, cache_misses = \
+                    build_cache.run_build_cmds(gen_test_makefile.get_build_cmds(i), run_gen.compiler_timeout, num,
+                                               run_gen.compiler_mem_limit)
                 if time_expired or ret_code != 0:
                     failed_queue.put(test_dir)
                     common.log_msg(logging.DEBUG, "#" + str(num) + " Compilation failed")
@@ -111,8 +134,8 @@ def recheck(num, lock, task_queue, failed_queue, passed_queue, target, out_dir):
                     break
 
                 ret_code, output, err_output, time_expired, elapsed_time = \
-                    common.run_cmd(["make", "-f", gen_test_makefile.Test_Makefile_name, "run_" + i.name],
-                                   run_gen.run_timeout, num)
+                    common.run_cmd(gen_test_makefile.get_run_cmd(i), run_gen.run_timeout, num,
+                                   cpu_limit=run_gen.run_timeout)
                 if time_expired or ret_code != 0:
                     failed_queue.put(test_dir)
                     common.log_msg(logging.DEBUG, "#" + str(num) + " Execution failed")
@@ -163,6 +186,18 @@ if __name__ == '__main__':
     parser.add_argument("-j", dest="num_jobs", default=multiprocessing.cpu_count(), type=int,
                         help='Maximum number of instances to run in parallel. By default, '
                              'it is set to number of processor in your system')
+    parser.add_argument("--build-cache", dest="build_cache", default=None, type=str,
+                        help="Directory of compiled objects and executables cache (see build_cache.py)")
+    parser.add_argument("--build-cache-size", dest="build_cache_size", default=10240, type=int,
+                        help="Size cap (in MB) of build cache. Least recently used entries are removed, "
+                             "when it is exceeded. 0 means no limit")
+    parser.add_argument("--campaign-db", dest="campaign_db", default=None, type=str,
+                        help="Campaign database of run_gen.py (see campaign_db.py). If it is set, saved tests are "
+                             "taken from it and input directory should be result directory of run_gen.py")
+    parser.add_argument("--compiler", dest="compiler", default=None, type=str,
+                        help="Recheck only saved tests of this compiler (requires --campaign-db)")
+    parser.add_argument("--fail-type", dest="fail_type", default=None, type=str,
+                        help="Recheck only saved tests of this type, for example, compfail (requires --campaign-db)")
     parser.add_argument("-v", "--verbose", dest="verbose", default=False, action="store_true",
                         help="Increase output verbosity")
     parser.add_argument("--log-file", dest="log_file", type=str,
@@ -174,4 +209,8 @@ if __name__ == '__main__':
 
     common.check_python_version()
     gen_test_makefile.set_standard(args.std_str)
-    prepare_env_and_recheck(args.input_dir, args.out_dir, args.target, args.num_jobs, args.config_file)
+    build_cache.setup_cache(args.build_cache, args.build_cache_size * 1024 * 1024 if args.build_cache_size else None)
+    if (args.compiler or args.fail_type) and not args.campaign_db:
+        common.print_and_exit("--compiler and --fail-type require --campaign-db")
+    prepare_env_and_recheck(args.input_dir, args.out_dir, args.target, args.num_jobs, args.config_file,
+                            args.campaign_db, args.compiler, args.fail_type)
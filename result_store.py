@@ -0,0 +1,193 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Content-addressed storage of saved tests.
+Every unique file is stored once as compressed blob, named by hash of its content. Saved test directory
+contains only manifest with names, hashes and modes of its files. Blobs are compressed with zstd,
+if zstandard module is available, and with zlib otherwise.
+The script itself extracts saved tests back to ordinary directories.
+"""
+###############################################################################
+
+import argparse
+import hashlib
+import json
+import logging
+import os
+import tempfile
+import zlib
+
+import common
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+manifest_file_name = "manifest.json"
+blobs_dir_name = "blobs"
+
+zstd_level = 3
+zlib_level = 6
+
+# Store of current process. It is set up by run_gen.py (see --result-store option) and is inherited by
+# its worker processes.
+store = None
+
+
+def setup_store(store_dir):
+    global store
+    store = ResultStore(store_dir) if store_dir else None
+
+
+def compress(data, codec):
+    if codec == "zst":
+        return zstandard.ZstdCompressor(level=zstd_level).compress(data)
+    return zlib.compress(data, zlib_level)
+
+
+def decompress(data, codec):
+    if codec == "zst":
+        if zstandard is None:
+            common.print_and_exit("zstandard module is required to extract zstd blobs")
+        return zstandard.ZstdDecompressor().decompress(data)
+    return zlib.decompress(data)
+
+
+class ResultStore(object):
+    def __init__(self, store_dir, create=True):
+        self.store_dir = os.path.abspath(store_dir)
+        if create:
+            common.check_dir_and_create(self.store_dir)
+        self.codec = "zst" if zstandard is not None else "zz"
+
+    def get_blob_name(self, key, codec):
+        return os.path.join(self.store_dir, key[:2], key + "." + codec)
+
+    # Returns name of existing blob with any codec or None
+    def find_blob(self, key):
+        for codec in ["zst", "zz"]:
+            blob_name = self.get_blob_name(key, codec)
+            if os.path.isfile(blob_name):
+                return blob_name, codec
+        return None
+
+    # Put file to the store. Returns its key and number of written bytes (0 if the blob already exists).
+    def put(self, file_name):
+        with open(file_name, "rb") as f:
+            data = f.read()
+        key = hashlib.sha256(data).hexdigest()
+        if self.find_blob(key) is not None:
+            return key, 0
+        blob_name = self.get_blob_name(key, self.codec)
+        os.makedirs(os.path.dirname(blob_name), exist_ok=True)
+        blob = compress(data, self.codec)
+        # Blob is published with atomic rename. Concurrent writers of the same blob write the same content.
+        fd, tmp_name = tempfile.mkstemp(prefix="tmp_", dir=os.path.dirname(blob_name))
+        try:
+            with os.fdopen(fd, "wb") as f:
+                f.write(blob)
+            os.rename(tmp_name, blob_name)
+        except OSError:
+            os.unlink(tmp_name)
+            raise
+        return key, len(blob)
+
+    # Save files to the store and write manifest to test_dir. final_dir is the directory, where test_dir
+    # will be moved to. Path to the store is kept relative to it, so the whole output directory can be moved.
+    def save(self, file_list, test_dir, final_dir):
+        manifest = {"store": os.path.relpath(self.store_dir, final_dir), "files": []}
+        raw_size = 0
+        stored_size = 0
+        for file_name in file_list:
+            key, size = self.put(file_name)
+            file_stat = os.stat(file_name)
+            manifest["files"].append({"name": os.path.basename(file_name), "hash": key,
+                                      "size": file_stat.st_size, "mode": file_stat.st_mode & 0o777})
+            raw_size += file_stat.st_size
+            stored_size += size
+        with open(os.path.join(test_dir, manifest_file_name), "w") as f:
+            json.dump(manifest, f, indent=1, sort_keys=True)
+        common.log_msg(logging.DEBUG, "Saved " + str(raw_size) + " bytes of " + final_dir + " to result store, " +
+                       str(stored_size) + " new bytes")
+
+
+def is_stored_test(test_dir):
+    return os.path.isfile(os.path.join(test_dir, manifest_file_name))
+
+
+# Extract files of saved test to out_dir. If store_dir is None, it is taken from manifest.
+def extract_test(test_dir, out_dir, store_dir=None):
+    with open(os.path.join(test_dir, manifest_file_name), "r") as f:
+        manifest = json.load(f)
+    if store_dir is None:
+        store_dir = os.path.join(test_dir, manifest["store"])
+    common.check_dir_and_create(out_dir)
+    test_store = ResultStore(store_dir, create=False)
+    for entry in manifest["files"]:
+        blob = test_store.find_blob(entry["hash"])
+        if blob is None:
+            common.print_and_exit("Blob " + entry["hash"] + " of " + entry["name"] + " wasn't found in " +
+                                  test_store.store_dir)
+        blob_name, codec = blob
+        with open(blob_name, "rb") as f:
+            data = decompress(f.read(), codec)
+        out_name = os.path.join(out_dir, entry["name"])
+        with open(out_name, "wb") as f:
+            f.write(data)
+        os.chmod(out_name, entry["mode"])
+
+
+# Extract all saved tests in input_dir to the same places in out_dir
+def extract_all(input_dir, out_dir, store_dir=None):
+    test_num = 0
+    for root, dirs, files in os.walk(input_dir):
+        if manifest_file_name in files:
+            extract_test(root, os.path.join(out_dir, os.path.relpath(root, input_dir)), store_dir)
+            test_num += 1
+    common.log_msg(logging.INFO, "Extracted " + str(test_num) + " tests to " + out_dir)
+
+
+###############################################################################
+
+if __name__ == '__main__':
+    description = 'Script for extraction of saved tests from result store'
+    parser = argparse.ArgumentParser(description=description, formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+
+    requiredNamed = parser.add_argument_group('required named arguments')
+    requiredNamed.add_argument("-i", "--input-dir", dest="input_dir", type=str, required=True,
+                               help="Saved test or directory with saved tests (for example, result dir of run_gen.py)")
+    requiredNamed.add_argument("-o", "--output-dir", dest="out_dir", type=str, required=True,
+                               help="Output directory for extracted tests")
+
+    parser.add_argument("--store", dest="store_dir", default=None, type=str,
+                        help="Result store directory. By default, it is taken from manifests of saved tests")
+    parser.add_argument("-v", "--verbose", dest="verbose", default=False, action="store_true",
+                        help="Increase output verbosity")
+    parser.add_argument("--log-file", dest="log_file", type=str,
+                        help="Logfile")
+    args = parser.parse_args()
+
+    log_level = logging.DEBUG if args.verbose else logging.INFO
+    common.setup_logger(args.log_file, log_level)
+
+    common.check_python_version()
+    if not common.check_if_dir_exists(args.input_dir):
+        common.print_and_exit("Can't use input directory")
+    extract_all(args.input_dir, args.out_dir, args.store_dir)
@@ -22,40 +22,103 @@ Script for autonomous testing with YARP Generator
 ###############################################################################
 
 import argparse
+import collections
+import copy
 import datetime
+import errno
+import hashlib
+import json
 import logging
 import math
 import multiprocessing
-import multiprocessing.managers
+import multiprocessing.connection
 import os
+import pickle
+import random
 import re
+import resource
+import shlex
 import shutil
+import signal
+import socket
 import stat
 import sys
+import tempfile
+import threading
 import time
-import queue
 
 import common
 import gen_test_makefile
 import blame_opt
+import build_cache
+import campaign_db
+import metrics
+import result_store
 
 res_dir = "result"
+# Private directories for saving of tests (see save_test)
+staging_dir_name = "staging"
 process_dir = "process_"
+checkpoint_file_name = "checkpoint.pickle"
+# Testing directory (which contains generator binary and result directory), as seen from test directory.
+# It is set to absolute path, because test directories may be placed to scratch directory (see --scratch-dir).
+testing_dir = ".."
 creduce_bin = "creduce"
 creduce_n = 0
 
 clang_total_stmt_str = "stmts/expr"
 
 yarpgen_timeout = 60
+# Generator's own wall-clock budget (in ms). It should be less than yarpgen_timeout,
+# so generator has time to emit truncated test instead of being killed.
+yarpgen_gen_time_limit = yarpgen_timeout * 1000 // 2
 compiler_timeout = 1200
 run_timeout = 300
+# Adaptive timeouts (see --adaptive-timeouts option). Timeout of build or run of testing set is a high quantile
+# of its recent wall times multiplied by safety factor, compiler_timeout and run_timeout are upper bounds.
+# Build or run, which has exceeded adaptive timeout, is retried once with the timeout extended by
+# adaptive_timeout_retry_factor (but not above the upper bound), so spikes of machine load don't produce timeouts,
+# while hung compiler holds the worker only for a few adaptive timeouts.
+adaptive_timeout_window = 500
+adaptive_timeout_min_samples = 30
+adaptive_timeout_quantile = 0.99
+adaptive_timeout_factor = 4
+adaptive_timeout_min = 10
+adaptive_timeout_retry_factor = 2
 stat_update_delay = 10
 tmp_cleanup_delay = 3600
+# Delay (in seconds) between checkpoints of testing (see --resume option)
+checkpoint_delay = 60
+# Delay (in seconds) between measurements of size of test directories (see --scratch-size option)
+scratch_size_check_delay = 5
+# Build or run, whose worker has died, is rescheduled this number of times before its opt-set is marked failed
+lost_task_retries = 1
 creduce_timeout = 3600 * 24
+# IR reduction (see --ir-reduce option) only prepares the test for creduce, so it has its own smaller time limit
+ir_reduce_timeout = 3600
 
-# Various memory limits (in kbytes), passed to ulimit -v
+# Various memory limits (in kbytes), set with setrlimit() for the child processes and tasks of TestScheduler
 yarpgen_mem_limit  =  2000000 # 2 Gb
 compiler_mem_limit = 10000000 # 10 Gb
+run_mem_limit      =  2000000 # 2 Gb
+# Memory-aware admission of builds (see --mem-budget option). Peak RSS of compiler is predicted as a high
+# quantile of its recent peak RSS per byte of test multiplied by safety factor.
+memory_model_window = 500
+memory_model_quantile = 0.95
+memory_model_factor = 1.2
+default_build_mem_estimate = 1000000 # 1 Gb, until the first build of testing set is measured
+# Messages of compilers, which have run out of memory (under ulimit or not)
+out_of_memory_patterns = re.compile(b"out of memory|Cannot allocate memory|std::bad_alloc|memory exhausted")
+# Fingerprints of failures (see --reduce-per-fingerprint option).
+# Crash messages of compilers, which are used for unknown compfails. Numbers and paths are removed from them.
+compiler_crash_pattern = re.compile("(internal compiler error|Assertion .* failed|LLVM ERROR|UNREACHABLE executed)" +
+                                    "[^\n]*")
+# Rare features of generated test (see CompileCostModel), whose presence is part of fingerprint of runfails and
+# miscompares. Counts of common features differ in almost every test, so they are not used.
+fingerprint_ir_features = ["reference"]
+# Number of reduced failures per fingerprint, if --creduce is used
+default_reduce_per_fingerprint = 3
+fingerprint_hash_len = 12
 
 script_start_time = datetime.datetime.now()  # We should init variable, so let's do it this way
 
@@ -103,16 +166,6 @@ known_build_fails = { \
 ###############################################################################
 
 
-class MyManager(multiprocessing.managers.BaseManager):
-    pass
-
-
-def manager():
-    m = MyManager()
-    m.start()
-    return m
-
-
 total = "total"
 ok = "ok"
 runfail = "runfail"
@@ -121,8 +174,6 @@ compfail = "compfail"
 compfail_timeout = "compfail_timeout"
 out_dif = "different_output"
 
-gcc_stats_file = None
-
 class StatsParser(object):
     """All parsers should return obtained data in form of list of tuples:
        [(opt_name#1, value#1), (opt_name#2, value#2),...]"""
@@ -202,25 +253,51 @@ class Test(object):
     # Static variables
     # Don't save anything other than log-file if compile time expires
     ignore_comp_time_exp = True
+    # File for timing data of compilation cost model (see cost_model.py)
+    cost_data_file = None
+    # Compilation cost model and requested compilation time, which are passed to generator
+    cost_model_file = None
+    target_compile_ms = None
+    # Number of reduced failures per fingerprint (0 means no limit). Fingerprints require features of test.
+    reduce_per_fingerprint = 0
+    # Reduce IR of the test by generator before creduce (see --ir-reduce option)
+    ir_reduce = False
 
     # Generate new test
     # stat is statistics object
     # seed is optional, if we want to generate some particular seed.
     # proc_num is optinal debug info to track in what process we are running this activity.
-    def __init__(self, stat, seed="", proc_num=-1, blame=False, creduce_makefile=None):
+    # gen_args are budget options of generator, which reproduce particular test (see get_gen_args()).
+    # By default, generator has wall-clock budget, so the test depends on machine load.
+    def __init__(self, stat, seed="", proc_num=-1, blame=False, creduce_makefile=None, gen_args=None):
         # Run generator
-        yarpgen_run_list = [".." + os.sep + "yarpgen", "-q",
+        yarpgen_run_list = [os.path.join(testing_dir, "yarpgen"), "-q",
                             "--std=" + gen_test_makefile.StdID.get_pretty_std_name(gen_test_makefile.selected_standard)]
+        if gen_args is not None:
+            yarpgen_run_list += gen_args
+        else:
+            yarpgen_run_list += ["--gen_time_limit=" + str(yarpgen_gen_time_limit)]
         if seed:
             yarpgen_run_list += ["-s", seed]
+        if Test.cost_data_file or Test.reduce_per_fingerprint:
+            yarpgen_run_list += ["--print-cost-features"]
+        if Test.cost_model_file:
+            yarpgen_run_list += ["--cost-model=" + Test.cost_model_file]
+        if Test.target_compile_ms:
+            yarpgen_run_list += ["--target-compile-ms=" + str(Test.target_compile_ms)]
         self.yarpgen_cmd = " ".join(str(p) for p in yarpgen_run_list)
-        self.ret_code, self.stdout, self.stderr, self.is_time_expired, self.elapsed_time = \
-            common.run_cmd(yarpgen_run_list, yarpgen_timeout, proc_num, yarpgen_mem_limit)
+        # Reduction of IR regenerates the test from the seed, so it is launched with the same options
+        self.yarpgen_run_list = [os.path.abspath(yarpgen_run_list[0])] + yarpgen_run_list[1:]
+        self.ret_code, self.stdout, self.stderr, self.is_time_expired, self.usage = \
+            common.run_cmd_with_usage(yarpgen_run_list, yarpgen_timeout, proc_num, yarpgen_mem_limit)
+        self.elapsed_time = self.usage.user + self.usage.sys
 
         # Files that belongs to generate test. They are hardcoded for now.
         # Generator may report them in output later and we may need to parse it.
         self.files = gen_test_makefile.sources.value.split() + gen_test_makefile.headers.value.split()
         self.files.append(gen_test_makefile.Test_Makefile_name)
+        # Size of the test (in bytes) is used to predict memory of compilers
+        self.size = sum(os.path.getsize(f) for f in self.files if os.path.isfile(f))
 
         # Parse generated seed.
         if not seed:
@@ -230,17 +307,47 @@ class Test(object):
                 seed = str(proc_num) + "_" + datetime.datetime.now().strftime('%Y_%m_%d_%H_%M_%S')
         self.seed = seed
 
+        # Parse exceeded generation budget (if any).
+        # It is reported as "/*BUDGET <name> <node_count> <total_node_count>*/".
+        # Node count at the moment of exceeding allows to reproduce the test without time budget.
+        self.budget = None
+        self.budget_node_count = None
+        if self.stdout:
+            budget_match = re.search(r"/\*BUDGET (\S+) (\d+) (\d+)\*/", str(self.stdout, "utf-8"))
+            if budget_match:
+                self.budget_node_count = int(budget_match.group(2))
+                self.budget = budget_match.group(1) + " (after " + budget_match.group(2) + " of " + \
+                              budget_match.group(3) + " nodes)"
+                common.log_msg(logging.DEBUG, "Generation budget was exceeded for seed " + str(seed) + ": " +
+                               self.budget)
+
+        # Parse features of compilation cost model. They are reported as "/*FEATURES <name>=<value> ...*/".
+        self.cost_features = None
+        if self.stdout:
+            features_match = re.search("/\\*FEATURES (.*)\\*/", str(self.stdout, "utf-8"))
+            if features_match:
+                self.cost_features = {}
+                for feature in features_match.group(1).split():
+                    name, value = feature.split("=")
+                    self.cost_features[name] = int(value)
+
         self.path = os.getcwd()
+        # Triage steps, which are left. The first one is in progress. It is None until all runs are finished.
+        self.triage_steps = None
         self.proc_num = proc_num
         self.stat = stat
         self.blame = blame
         self.blame_phase = ""
         self.blame_result = "was not run"
+        self.blame_steps = None
         self.creduce = bool(creduce_makefile)
         self.creduce_makefile = creduce_makefile
+        # Triage step -> (hash, text) of fingerprint and hashes of failures, which were not reduced as duplicates
+        self.fingerprints = {}
+        self.duplicates = set()
 
         # Update statistics and set the status
-        stat.update_yarpgen_duration(datetime.timedelta(seconds=self.elapsed_time))
+        stat.update_yarpgen_usage(self.usage)
         if self.is_time_expired:
             common.log_msg(logging.WARNING, "Generator has failed (" + runfail_timeout + ")")
             self.status = self.STATUS_fail_timeout
@@ -254,6 +361,8 @@ class Test(object):
         else:
             self.status = self.STATUS_ok
             stat.update_yarpgen_runs(ok)
+        stat.add_db_record("gen_runs", dict(usage_columns("", self.usage), seed=self.seed,
+                                            status=self.status_string() if self.status != self.STATUS_ok else ok))
 
         # Initialize set of test runs
         self.successful_test_runs = []
@@ -278,15 +387,23 @@ class Test(object):
         else: raise
 
     # Save test
-    def save(self, lock):
+    def save(self):
         if self.status != self.STATUS_fail_timeout and self.status != self.STATUS_fail:
             raise
         log = self.build_log()
-        save_test(lock, file_list=[log],
-                   compiler_name=None,
-                   fail_type=self.status_string(),
-                   classification=None,
-                   test_name=None)
+        save_test(file_list=[log],
+                  compiler_name=None,
+                  fail_type=self.status_string(),
+                  classification=None,
+                  test_name=None)
+
+    # Budget options of generator, which reproduce this test regardless of machine load: wall-clock budget
+    # is disabled and node count at the moment, when any budget was exceeded, becomes the budget.
+    def get_gen_args(self):
+        gen_args = ["--gen_time_limit=0"]
+        if getattr(self, "budget_node_count", None) is not None:
+            gen_args.append("--max_node_count=" + str(self.budget_node_count))
+        return gen_args
 
     # Add successful test run
     def add_success_run(self, test_run):
@@ -296,52 +413,155 @@ class Test(object):
     def add_fail_run(self, test_run):
         self.fail_test_runs.append(test_run)
 
-    # Save failed runs and verify successul runs
-    def handle_results(self, lock):
+    # Results are handled in three steps, so blaming and reduction of the test may be scheduled as separate
+    # tasks (see TestScheduler):
+    # - prepare_triage() groups the runs and returns the list of triage steps, which are required;
+    # - do_triage_step() runs one blaming or reduction step in test directory;
+    # - save_results() saves failed runs and miscompares.
+    # Triage steps of the test share its directory, so they must be executed one by one.
+    TRIAGE_reduce_compfail = "reduce_compfail"
+    TRIAGE_blame_runfail = "blame_runfail"
+    TRIAGE_reduce_runfail = "reduce_runfail"
+    TRIAGE_blame_miscompare = "blame_miscompare"
+    TRIAGE_reduce_miscompare = "reduce_miscompare"
+
+    # Group the results and return the list of triage steps. It doesn't touch any files.
+    def prepare_triage(self):
+        self.group_failed_runs()
+        self.group_successful_runs()
+        steps = []
+        if self.build_fail and self.creduce:
+            steps.append(self.TRIAGE_reduce_compfail)
+        if self.run_fail:
+            # Do blaming if blame switch is passed, there are successful runs and fail is not a timeout.
+            if self.blame and len(self.successful_test_runs) > 0 and self.run_fail.status == TestRun.STATUS_runfail:
+                steps.append(self.TRIAGE_blame_runfail)
+            if self.creduce:
+                steps.append(self.TRIAGE_reduce_runfail)
+        if self.has_miscompare and self.good_runs:
+            # Run blame triagging and creduce for one of failing optsets
+            if self.blame:
+                steps.append(self.TRIAGE_blame_miscompare)
+            if self.creduce:
+                steps.append(self.TRIAGE_reduce_miscompare)
+        return steps
+
+    # Cheap fingerprint of the failure, which is reduced by the triage step: type of failure, blamed phase,
+    # compiler message, failing opt-sets and rare features of the test. Compiler message already identifies
+    # compfail, so features are used only for runfails and miscompares. Returns hash and readable text or None,
+    # if the failure can't be told apart from others (runfail or miscompare without blamed phase).
+    def get_fingerprint(self, step):
+        if step == self.TRIAGE_reduce_compfail:
+            runs = [self.build_fail] + self.build_fail.same_type_fails
+            parts = [self.build_fail.status_string(), self.build_fail.get_build_fail_message()]
+        elif step == self.TRIAGE_reduce_runfail:
+            if not self.run_fail.blame_phase:
+                return None
+            runs = [self.run_fail] + self.run_fail.same_type_fails
+            parts = [self.run_fail.status_string(), self.run_fail.blame_phase]
+        else:
+            if not self.blame_phase:
+                return None
+            runs = self.bad_runs
+            parts = [self.status_string(), self.blame_phase]
+        parts.append(",".join(sorted(run.optset for run in runs)))
+        if step != self.TRIAGE_reduce_compfail:
+            features = self.cost_features if self.cost_features is not None else {}
+            parts.append(" ".join(f for f in fingerprint_ir_features if features.get(f, 0) > 0))
+        text = "|".join(parts)
+        fingerprint = hashlib.sha1(text.encode("utf-8")).hexdigest()[:fingerprint_hash_len], text
+        self.fingerprints[step] = fingerprint
+        return fingerprint
+
+    # Failures, which were not reduced as duplicates, are saved in "dup_<hash>" subdirectory of classification
+    def get_bucket(self, step, classification):
+        fingerprint = self.fingerprints.get(step)
+        if fingerprint is None or fingerprint[0] not in self.duplicates:
+            return classification
+        bucket = "dup_" + fingerprint[0]
+        return os.path.join(classification, bucket) if classification else bucket
+
+    # Opt-set, which is blamed or reduced by the triage step
+    def get_triage_optset(self, step):
+        run = {self.TRIAGE_reduce_compfail: self.build_fail,
+               self.TRIAGE_blame_runfail: self.run_fail, self.TRIAGE_reduce_runfail: self.run_fail,
+               self.TRIAGE_blame_miscompare: self.bad_runs[0] if self.bad_runs else None,
+               self.TRIAGE_reduce_miscompare: self.bad_runs[0] if self.bad_runs else None}[step]
+        return run.optset if run else None
+
+    def do_triage_step(self, step):
+        start_time = time.time()
+        if step == self.TRIAGE_reduce_compfail:
+            self.do_creduce_buildfail(self.build_fail)
+        elif step == self.TRIAGE_blame_runfail:
+            do_blame(self.run_fail, self.files, self.successful_test_runs[0].checksum, self.run_fail.target)
+        elif step == self.TRIAGE_reduce_runfail:
+            self.do_creduce_runfail(self.run_fail)
+        elif step == self.TRIAGE_blame_miscompare:
+            do_blame(self, self.files, self.good_runs[0].checksum, self.bad_runs[0].target)
+        elif step == self.TRIAGE_reduce_miscompare:
+            self.do_creduce_miscompare(self.good_runs, self.bad_runs)
+        else:
+            raise
+
+        if step == self.TRIAGE_blame_runfail or step == self.TRIAGE_blame_miscompare:
+            blamed = self.run_fail if step == self.TRIAGE_blame_runfail else self
+            self.stat.add_db_record("blame", {"seed": self.seed, "optset": self.get_triage_optset(step),
+                                              "result": blamed.blame_result,
+                                              "phase": blamed.blame_phase, "steps": blamed.blame_steps,
+                                              "wall_time": time.time() - start_time})
+        else:
+            self.stat.add_db_record("reductions", {"seed": self.seed, "kind": step,
+                                                   "optset": self.get_triage_optset(step),
+                                                   "fingerprint": self.fingerprints.get(step, (None,))[0],
+                                                   "wall_time": time.time() - start_time})
+
+    def save_results(self):
+        self.record_runs()
         # Handle compfails and runfails.
-        self.save_failed(lock)
+        if self.build_fail:
+            self.build_fail.save()
+        if self.run_fail:
+            self.run_fail.save()
         # Handle miscompares.
-        self.verify_results(lock)
+        if self.has_miscompare:
+            self.save_miscompare()
         if self.status == self.STATUS_ok and len(self.fail_test_runs) == 0:
             self.stat.seed_passed(self.seed)
         else:
             self.stat.seed_failed(self.seed)
 
-    # Save failed runs.
-    # Report fails of the same type together.
-    def save_failed(self, lock):
-        build_fail = None
-        run_fail = None
+    # Record final results of all runs to campaign database
+    def record_runs(self):
+        for run in self.successful_test_runs + self.fail_test_runs:
+            status = run.status_string()
+            if run in self.bad_runs:
+                status = "miscompare"
+            self.stat.add_db_record("target_runs", run.get_db_record(status))
+
+    # Group failed runs.
+    # Fails of the same type are reported together.
+    def group_failed_runs(self):
+        self.build_fail = None
+        self.run_fail = None
         for run in self.fail_test_runs:
             if run.status == TestRun.STATUS_compfail or \
                run.status == TestRun.STATUS_compfail_timeout:
-                if build_fail:
-                    build_fail.same_type_fails.append(run)
+                if self.build_fail:
+                    self.build_fail.same_type_fails.append(run)
                 else:
-                    build_fail = run
+                    self.build_fail = run
             elif run.status == TestRun.STATUS_runfail or \
                  run.status == TestRun.STATUS_runfail_timeout:
-                if run_fail:
-                    run_fail.same_type_fails.append(run)
+                if self.run_fail:
+                    self.run_fail.same_type_fails.append(run)
                 else:
-                    run_fail = run
+                    self.run_fail = run
             else:
                 raise
 
-        if build_fail:
-            if self.creduce:
-                self.do_creduce_buildfail(build_fail)
-            build_fail.save(lock)
-        if run_fail:
-            # Do blaming if blame switch is passed, there are successful runs and fail is not a timeout.
-            if self.blame and len(self.successful_test_runs) > 0 and run_fail.status == TestRun.STATUS_runfail:
-                do_blame(run_fail, self.files, self.successful_test_runs[0].checksum, run_fail.target)
-            if self.creduce:
-                self.do_creduce_runfail(run_fail)
-            run_fail.save(lock)
-
-    # Verify the results and if bad results are found, report / save them.
-    def verify_results(self, lock):
+    # Verify the results of successful runs and split them to good and bad ones.
+    def group_successful_runs(self):
         results = {}
         for t in self.successful_test_runs:
             assert t.status == TestRun.STATUS_ok
@@ -350,7 +570,10 @@ class Test(object):
             else:
                 results[t.checksum].append(t)
 
+        self.good_runs = []
+        self.bad_runs = []
         # Check if test passed.
+        self.has_miscompare = len(results) != 1
         if len(results) == 1:
             return
         elif len(results) == 2:
@@ -379,6 +602,8 @@ class Test(object):
                 bad_cmplrs.add(run.target.specs.name)
             if len(good_cmplrs) < len(bad_cmplrs):
                 good_runs, bad_runs = bad_runs, good_runs
+            self.good_runs = good_runs
+            self.bad_runs = bad_runs
         else:
             # More than 2 different results.
             # Treat them all as bad
@@ -386,18 +611,13 @@ class Test(object):
                 self.status = self.STATUS_no_good_runs
             else:
                 self.status = self.STATUS_multiple_miscompare
-            good_runs = []
-            bad_runs = []
             for run in results.values():
-                bad_runs += run
+                self.bad_runs += run
 
-        # Run blame triagging for one of failing optsets
-        if self.blame and good_runs:
-            do_blame(self, self.files, good_runs[0].checksum, bad_runs[0].target)
-
-        # Run creduce for one of failing optsets
-        if self.creduce and good_runs:
-            self.do_creduce_miscompare(good_runs, bad_runs)
+    # Report and save miscompare.
+    def save_miscompare(self):
+        good_runs = self.good_runs
+        bad_runs = self.bad_runs
 
         # Report
         for run in bad_runs:
@@ -423,23 +643,27 @@ class Test(object):
         if len(self.blame_phase) != 0:
             blame_phase = self.blame_phase.replace(" ", "_")
 
-        save_test(lock, files_to_save,
+        save_test(files_to_save,
                    compiler_name = cmplr,
                    fail_type = self.status_string(),
-                   classification = blame_phase,
-                   test_name = "S_" + str(self.seed))
+                   classification = self.get_bucket(self.TRIAGE_reduce_miscompare, blame_phase),
+                   test_name = "S_" + str(self.seed),
+                   fingerprint = self.fingerprints.get(self.TRIAGE_reduce_miscompare, (None,))[0])
 
     def build_log(self, bad_runs=[], good_runs=[]):
         log_name = "log.txt"
         log = open(log_name, "w")
         log.write("YARPGEN version: " + common.yarpgen_version_str + "\n")
         log.write("Seed: " + str(self.seed) + "\n")
+        if self.budget:
+            log.write("Generation budget exceeded: " + self.budget + "\n")
         log.write("Time: " + datetime.datetime.now().strftime('%Y/%m/%d %H:%M:%S') + "\n")
         log.write("Language standard: " + gen_test_makefile.get_standard() + "\n")
         log.write("Type: " + self.status_string() + "\n")
         if self.blame:
             log.write("Blaming " + self.blame_result + "\n")
             log.write("Optimization to blame: " + self.blame_phase + "\n")
+        write_fingerprint(log, self, self.TRIAGE_reduce_miscompare)
         log.write("\n\n")
         if self.status == self.STATUS_fail_timeout:
             log.write("Generator timeout: " + str(yarpgen_timeout) + " seconds\n")
@@ -535,6 +759,64 @@ class Test(object):
                                          "Check for creduce_bug_000 dir in the results.", forced_duplication=True)
 
 
+    # Copy files of the test to reduce folder and go there. If the folder is left by interrupted reduction
+    # (see --resume), its partially reduced source is kept, so creduce continues from it.
+    def prepare_reduce_dir(self, reduce_dir):
+        reduced_file_name = "func" + gen_test_makefile.get_file_ext()
+        is_resumed = os.path.isfile(os.path.join(reduce_dir, reduced_file_name))
+        if is_resumed:
+            common.log_msg(logging.DEBUG, "Resuming reduction of seed " + self.seed + " in " + reduce_dir)
+        common.check_dir_and_create(reduce_dir)
+        for f in self.files:
+            if is_resumed and f == reduced_file_name:
+                continue
+            common.check_and_copy(f, reduce_dir)
+        os.chdir(reduce_dir)
+
+    # Reduce IR of the test by generator (see --reduce option of yarpgen), so creduce starts from far smaller test.
+    # Interestingness test of creduce is reused, but all sources of candidate are taken from its directory.
+    # The step is skipped if the reduction has been done already (e.g. reduction is resumed).
+    def do_ir_reduce(self, test_sh, creduce_makefile_name):
+        if not Test.ir_reduce or os.path.isfile("ir_reduce.log"):
+            return
+        ir_test_sh = test_sh.replace(os.sep + creduce_makefile_name + " ",
+                                     os.sep + gen_test_makefile.Test_Makefile_name + " ")
+        ir_test_sh_file = open("ir_test.sh", "w")
+        ir_test_sh_file.write(ir_test_sh)
+        ir_test_sh_file.close()
+        st = os.stat(ir_test_sh_file.name)
+        os.chmod(ir_test_sh_file.name, st.st_mode | stat.S_IEXEC)
+
+        ir_dir = "ir_reduce"
+        common.check_dir_and_create(ir_dir)
+        # Wall-clock budget of generator is replaced with node count budget of the test, so the same IR is generated
+        ir_params_list = [p for p in self.yarpgen_run_list
+                          if not p.startswith("--gen_time_limit=") and not p.startswith("--max_node_count=")]
+        ir_params_list += self.get_gen_args() + ["-d", ir_dir, "--reduce=" + os.path.abspath(ir_test_sh_file.name),
+                                                 "--reduce-jobs=" + str(creduce_n)]
+        if "-s" not in ir_params_list:
+            ir_params_list += ["-s", self.seed]
+        ir_ret_code, ir_stdout, ir_stderr, ir_is_time_expired, ir_elapsed_time = \
+            common.run_cmd(ir_params_list, ir_reduce_timeout, self.proc_num)
+
+        ir_log = open("ir_reduce.log", "w")
+        ir_log.write("Generator cmd: " + " ".join(str(p) for p in ir_params_list) + "\n")
+        ir_log.write("Return code: " + str(ir_ret_code) + "\n")
+        ir_log.write("Execution time: " + str(ir_elapsed_time) + "\n")
+        ir_log.write("Time limit was exceeded!\n" if ir_is_time_expired else "Time limit was not exceeded\n")
+        ir_log.write(str(ir_stderr, "utf-8"))
+        ir_log.close()
+        common.check_and_copy(ir_log.name, "..")
+        self.files.append(ir_log.name)
+
+        # Sources of the test are replaced only by successfully reduced ones
+        if ir_ret_code != 0 or ir_is_time_expired:
+            common.log_msg(logging.DEBUG, "IR reduction has failed for seed " + self.seed)
+            return
+        for f in os.listdir(ir_dir):
+            if os.path.isfile(os.path.join(ir_dir, f)):
+                common.check_and_copy(os.path.join(ir_dir, f), ".")
+
     #TODO: all do_creduce _* function have a lot of copy-pasted code. We need to refactor them!
     def do_creduce_miscompare(self, good_runs, bad_runs):
         # Pick the fastest non-failing opt-set
@@ -569,10 +851,7 @@ class Test(object):
         self.files.append(creduce_makefile_name)
 
         # Prepare reduce folder
-        os.mkdir("reduce")
-        for f in self.files:
-            common.check_and_copy(f, "reduce")
-        os.chdir("reduce")
+        self.prepare_reduce_dir("reduce")
 
         # This is required only for old loop code and assumes 5 files, not 2.
         #self.creduce_performance_hack()
@@ -596,6 +875,7 @@ class Test(object):
         os.chmod(test_sh_file.name, st.st_mode | stat.S_IEXEC)
         common.check_and_copy(test_sh_file.name, "..")
         self.files.append(test_sh_file.name)
+        self.do_ir_reduce(test_sh, creduce_makefile_name)
 
         # Run creduce
         cr_params_list = [creduce_bin, "--n", str(creduce_n), "--timing", "--timeout",
@@ -659,10 +939,7 @@ class Test(object):
         self.files.append(creduce_makefile_name)
 
         # Prepare reduce folder
-        os.mkdir("reduce_compfail")
-        for f in self.files:
-            common.check_and_copy(f, "reduce_compfail")
-        os.chdir("reduce_compfail")
+        self.prepare_reduce_dir("reduce_compfail")
 
         # Now we need to construct a Makefile and script for passing to creduce.
         # Need to make sure that -Werror=uninitialized is passed to the compiler.
@@ -681,6 +958,7 @@ class Test(object):
         os.chmod(test_sh_file.name, st.st_mode | stat.S_IEXEC)
         common.check_and_copy(test_sh_file.name, "..")
         self.files.append(test_sh_file.name)
+        self.do_ir_reduce(test_sh, creduce_makefile_name)
 
         # Run creduce
         cr_params_list = [creduce_bin, "--n", str(creduce_n), "--timing", "--timeout",
@@ -744,10 +1022,7 @@ class Test(object):
         self.files.append(creduce_makefile_name)
 
         # Prepare reduce folder
-        os.mkdir("reduce_runfail")
-        for f in self.files:
-            common.check_and_copy(f, "reduce_runfail")
-        os.chdir("reduce_runfail")
+        self.prepare_reduce_dir("reduce_runfail")
 
         # Now we need to construct a Makefile and script for passing to creduce.
         # Need to make sure that -Werror=uninitialized is passed to the compiler.
@@ -774,6 +1049,7 @@ class Test(object):
         os.chmod(test_sh_file.name, st.st_mode | stat.S_IEXEC)
         common.check_and_copy(test_sh_file.name, "..")
         self.files.append(test_sh_file.name)
+        self.do_ir_reduce(test_sh, creduce_makefile_name)
 
         # Run creduce
         cr_params_list = [creduce_bin, "--n", str(creduce_n), "--timing", "--timeout",
@@ -850,17 +1126,65 @@ class TestRun(object):
         self.same_type_fails = []
         self.blame_phase = ""
         self.blame_result = "was not run"
+        self.blame_steps = None
         self.parse_stats = parse_stats
-
-    # Build test
+        self.exe_hash = None
+        self.run_dedup = None
+        # Timeouts are chosen by scheduler (see AdaptiveTimeouts). Timeouts of the retry after expiration of
+        # adaptive timeout are None, if there was no retry.
+        self.build_timeout = compiler_timeout
+        self.run_timeout = run_timeout
+        self.build_retry_timeout = None
+        self.run_retry_timeout = None
+        # Build, which was killed for memory, is retried without other builds (see TestScheduler.dispatch())
+        self.killed_for_memory = False
+        self.exclusive = False
+        # Usage of build with any build cache hit is not a measurement, so it is not recorded anywhere
+        self.build_cache_hit = False
+
+    # Build test.
+    # Compilers are invoked directly with the same command lines as in Test_Makefile (see gen_test_makefile.py),
+    # which is left for humans and creduce.
     def build(self):
-        # build
-        build_params_list = ["make", "-f", gen_test_makefile.Test_Makefile_name, self.optset]
-        self.build_cmd = " ".join(str(p) for p in build_params_list)
-        self.build_ret_code, self.build_stdout, self.build_stderr, self.is_build_time_expired, self.build_elapsed_time = \
-            common.run_cmd(build_params_list, compiler_timeout, self.proc_num, compiler_mem_limit)
+        stat_flags = ""
+        if self.parse_stats:
+            stat_flags = gen_test_makefile.StatisticsOptions.get_options(self.target.specs)
+        build_cmds = gen_test_makefile.get_build_cmds(self.target, stat_flags=stat_flags)
+        self.build_cmd = " && ".join(" ".join(shlex.quote(arg) for arg in cmd) for cmd in build_cmds)
+        self.build_retry_timeout = None
+        time_out = self.build_timeout
+        while True:
+            self.build_ret_code, self.build_stdout, self.build_stderr, self.is_build_time_expired, self.build_usage, \
+                cache_hits, cache_misses = build_cache.run_build_cmds(build_cmds, time_out, self.proc_num,
+                                                                      compiler_mem_limit,
+                                                                      use_cache=not self.parse_stats)
+            if not self.is_build_time_expired or self.build_retry_timeout is not None or \
+               self.build_timeout >= compiler_timeout:
+                break
+            self.build_retry_timeout = time_out = get_retry_timeout(self.build_timeout, compiler_timeout)
+            common.log_msg(logging.DEBUG, "Build of " + self.optset + " for seed " + self.test.seed +
+                           " has exceeded adaptive timeout of " + str(self.build_timeout) +
+                           " seconds, it is retried with timeout of " + str(time_out) + " seconds")
+        self.build_elapsed_time = self.build_usage.user + self.build_usage.sys
+        self.build_cache_hit = cache_hits > 0
+        # Fail of compiler, which was killed by OOM killer or has run out of memory next to other compilers,
+        # isn't accounted until it is retried without other builds. Usage is recorded only for the final attempt.
+        if not self.exclusive and not self.is_build_time_expired and \
+           (self.build_ret_code == -signal.SIGKILL or
+            (self.build_ret_code != 0 and out_of_memory_patterns.search(self.build_stderr))):
+            common.log_msg(logging.DEBUG, "Build of " + self.optset + " for seed " + self.test.seed +
+                           " was killed for memory")
+            self.killed_for_memory = True
+            return False
+        self.killed_for_memory = False
+        if not self.build_cache_hit:
+            self.stat.update_target_usage(self.optset, CmdRun.USAGE_build, self.build_usage)
+        self.stat.update_build_cache(cache_hits, cache_misses)
         # update status and stats
         if self.is_build_time_expired:
+            common.log_msg(logging.DEBUG, "Build of " + self.optset + " for seed " + self.test.seed +
+                           " has exceeded timeout of " +
+                           format_timeout(self.build_timeout, self.build_retry_timeout, compiler_timeout))
             self.stat.update_target_runs(self.optset, compfail_timeout)
             self.status = self.STATUS_compfail_timeout
         elif self.build_ret_code != 0:
@@ -868,53 +1192,109 @@ class TestRun(object):
             self.status = self.STATUS_compfail
         else:
             self.status = self.STATUS_not_run
+            if Test.cost_data_file and self.test.cost_features and not self.build_cache_hit:
+                self.record_cost_data()
 
         # parse stats if needed
+        stats_file = None
         if self.parse_stats:
             opt_stats = None
             stmt_stats = None
-            if "clang" in self.target.specs.name and os.path.isfile("func.stats"):
-                opt_stats = StatsParser.parse_clang_opt_stats_file("func.stats")
+            stats_file = self.find_stats_file()
+            if "clang" in self.target.specs.name and stats_file:
+                opt_stats = StatsParser.parse_clang_opt_stats_file(stats_file)
                 stmt_stats = StatsParser.parse_clang_stmt_stats_file(str(self.build_stderr, "utf-8"))
             elif "gcc" in self.target.specs.name:
-                global gcc_stats_file
-                if gcc_stats_file is None:
-                    regex = re.compile("func\.cpp\..")
-                    files = os.listdir(".")
-                    for act_file in files:
-                        if regex.match(act_file) and act_file.endswith(".statistics"):
-                            gcc_stats_file = act_file
-                if os.path.isfile(gcc_stats_file):
-                    opt_stats = StatsParser.parse_gcc_opt_stats_file(gcc_stats_file)
+                if stats_file:
+                    opt_stats = StatsParser.parse_gcc_opt_stats_file(stats_file)
             else:
                 common.log_msg(logging.ERROR, "Can't parse statistics file")
             self.stat.add_stats(opt_stats, self.optset, StatsVault.opt_stats_id)
             self.stat.add_stats(stmt_stats, self.optset, StatsVault.stmt_stats_id)
 
         # update file list
-        expected_files = [source + ".o" for source in gen_test_makefile.sources.value.split()]
-        expected_files.append(gen_test_makefile.executable.value)
-        expected_files = [self.optset + "_" + e for e in expected_files]
-        if self.parse_stats:
-            expected_files.append("func.stats")
+        expected_files = [gen_test_makefile.get_object_name(self.target, source)
+                          for source in gen_test_makefile.sources.value.split()]
+        expected_files.append(gen_test_makefile.get_executable_name(self.target))
+        if stats_file:
+            expected_files.append(stats_file)
         for f in expected_files:
             if os.path.isfile(f):
                 self.files.append(f)
         # save executable separately (we need it in case of miscompare)
-        exe_file = self.optset + "_out"
+        exe_file = gen_test_makefile.get_executable_name(self.target)
         if os.path.isfile(exe_file):
             self.exe_file = exe_file
+            if self.status == self.STATUS_not_run:
+                self.exe_hash = common.hash_executable(exe_file)
         return self.status == self.STATUS_not_run
 
+    # Key of the run: opt-sets with the same key are guaranteed to have the same result
+    def get_run_key(self):
+        if self.exe_hash is None:
+            return None
+        return self.exe_hash, tuple(gen_test_makefile.get_run_cmd(self.target)[:-1])
+
+    # Opt-sets of the test are built concurrently in the same directory, so statistics are dumped next to
+    # the object file of the opt-set (i.e. "<optset>_func.stats"). Names without opt-set prefix are
+    # accepted for compilers, which can't do it.
+    def find_stats_file(self):
+        if "clang" in self.target.specs.name:
+            regex = re.compile("^(" + re.escape(self.optset) + "_)?func\\.stats$")
+        else:
+            regex = re.compile("^(" + re.escape(self.optset) + "_)?func\\.(c|cpp)\\..*\\.statistics$")
+        stats_files = [f for f in os.listdir(".") if regex.match(f)]
+        # Prefer the file of the opt-set
+        stats_files.sort(key=lambda f: not f.startswith(self.optset + "_"))
+        return stats_files[0] if stats_files else None
+
+    # Append timing data for calibration of compilation cost model.
+    # Every record is written with single write() to a file opened in append mode, so records from
+    # different processes don't interleave.
+    def record_cost_data(self):
+        record = {"seed": self.test.seed, "target": self.optset, "build_time": self.build_elapsed_time,
+                  "features": self.test.cost_features}
+        with open(Test.cost_data_file, "a") as cost_data_file:
+            cost_data_file.write(json.dumps(record, sort_keys=True) + "\n")
+
     # Run test
     def run(self):
         # run
-        run_params_list = ["make", "-f", gen_test_makefile.Test_Makefile_name, "run_" + self.optset]
+        run_params_list = gen_test_makefile.get_run_cmd(self.target)
         self.run_cmd = " ".join(str(p) for p in run_params_list)
-        self.run_ret_code, self.run_stdout, self.run_stderr, self.run_is_time_expired, self.run_elapsed_time = \
-            common.run_cmd(run_params_list, run_timeout, self.proc_num)
+        self.run_retry_timeout = None
+        time_out = self.run_timeout
+        while True:
+            self.run_ret_code, self.run_stdout, self.run_stderr, self.run_is_time_expired, self.run_usage = \
+                common.run_cmd_with_usage(run_params_list, time_out, self.proc_num, cpu_limit=time_out)
+            if not self.run_is_time_expired or self.run_retry_timeout is not None or self.run_timeout >= run_timeout:
+                break
+            self.run_retry_timeout = time_out = get_retry_timeout(self.run_timeout, run_timeout)
+            common.log_msg(logging.DEBUG, "Run of " + self.optset + " for seed " + self.test.seed +
+                           " has exceeded adaptive timeout of " + str(self.run_timeout) +
+                           " seconds, it is retried with timeout of " + str(time_out) + " seconds")
+        self.stat.update_target_usage(self.optset, CmdRun.USAGE_run, self.run_usage)
+        return self.set_run_status()
+
+    # Take the result of the run of byte-identical executable (see get_run_key()) instead of running it
+    def reuse_run(self, test_run):
+        self.run_cmd = " ".join(str(p) for p in gen_test_makefile.get_run_cmd(self.target))
+        self.run_ret_code = test_run.run_ret_code
+        self.run_stdout = test_run.run_stdout
+        self.run_stderr = test_run.run_stderr
+        self.run_is_time_expired = test_run.run_is_time_expired
+        self.run_usage = common.no_usage
+        self.run_dedup = test_run.optset
+        self.stat.update_run_dedup()
+        return self.set_run_status()
+
+    def set_run_status(self):
+        self.run_elapsed_time = self.run_usage.user + self.run_usage.sys
         # update status and stats
         if self.run_is_time_expired:
+            common.log_msg(logging.DEBUG, "Run of " + self.optset + " for seed " + self.test.seed +
+                           " has exceeded timeout of " +
+                           format_timeout(self.run_timeout, self.run_retry_timeout, run_timeout))
             self.stat.update_target_runs(self.optset, runfail_timeout)
             self.status = self.STATUS_runfail_timeout
         elif self.run_ret_code != 0:
@@ -924,9 +1304,18 @@ class TestRun(object):
             self.stat.update_target_runs(self.optset, ok)
             self.status = self.STATUS_ok
             self.checksum = str(self.run_stdout, "utf-8").split()[-1]
-        self.stat.update_target_duration(self.optset, datetime.timedelta(seconds=self.build_elapsed_time+self.run_elapsed_time))
         return self.status == self.STATUS_ok
 
+    def get_db_record(self, status):
+        record = {"seed": self.test.seed, "optset": self.optset, "spec": self.target.specs.name, "status": status,
+                  "checksum": getattr(self, "checksum", None), "exe_hash": self.exe_hash, "run_dedup": self.run_dedup,
+                  "build_timeout": self.build_timeout, "run_timeout": self.run_timeout}
+        # Builds from cache and reused runs have no measured usage
+        record.update(usage_columns("build_", getattr(self, "build_usage", None) if not self.build_cache_hit
+                                              else None))
+        record.update(usage_columns("run_", getattr(self, "run_usage", None) if self.run_dedup is None else None))
+        return record
+
     def status_string(self):
         if   self.status == self.STATUS_ok:               return "ok"
         elif self.status == self.STATUS_miscompare:       return "miscompare"
@@ -938,7 +1327,7 @@ class TestRun(object):
         elif self.status == self.STATUS_not_run:          return "not_run"
         else: raise
 
-    def save(self, lock):
+    def save(self):
         if self.status <= self.STATUS_not_built or self.status >= self.STATUS_miscompare:
             raise
 
@@ -969,12 +1358,18 @@ class TestRun(object):
         log = self.build_log()
         file_list.append(log)
 
-        save_test(lock,
-                   file_list,
-                   compiler_name=self.target.specs.name,
-                   fail_type=save_status,
-                   classification=classification,
-                   test_name="S_"+str(self.test.seed))
+        step = self.get_triage_step()
+        save_test(file_list,
+                  compiler_name=self.target.specs.name,
+                  fail_type=save_status,
+                  classification=self.test.get_bucket(step, classification),
+                  test_name="S_"+str(self.test.seed),
+                  fingerprint=self.test.fingerprints.get(step, (None,))[0])
+
+    def get_triage_step(self):
+        if self.status == self.STATUS_compfail or self.status == self.STATUS_compfail_timeout:
+            return Test.TRIAGE_reduce_compfail
+        return Test.TRIAGE_reduce_runfail
 
     def classify_build_fail(self):
         for reg_expr, tag in known_build_fails.items():
@@ -982,11 +1377,23 @@ class TestRun(object):
                 return tag
         return None
 
+    # Tag of known compfail or crash message of compiler without numbers and paths
+    def get_build_fail_message(self):
+        tag = self.classify_build_fail()
+        if tag is not None:
+            return tag
+        match = compiler_crash_pattern.search(str(self.build_stderr, "utf-8"))
+        if match is None:
+            return ""
+        return re.sub("0x[0-9a-fA-F]+|[0-9]+", "N", re.sub("\\S*/\\S*", "", match.group(0))).strip()
+
     def build_log(self):
         log_name = "log.txt"
         log = open(log_name, "w")
         log.write("YARPGEN version: " + common.yarpgen_version_str + "\n")
         log.write("Seed: " + str(self.test.seed) + "\n")
+        if self.test.budget:
+            log.write("Generation budget exceeded: " + self.test.budget + "\n")
         log.write("Time: " + datetime.datetime.now().strftime('%Y/%m/%d %H:%M:%S') + "\n")
         tests = [self] + self.same_type_fails
         log.write("Optsets: " + ", ".join(t.optset for t in tests) + "\n")
@@ -995,6 +1402,7 @@ class TestRun(object):
         if self.test.blame:
             log.write("Blaming " + self.blame_result + "\n")
             log.write("Optimization to blame: " + self.blame_phase + "\n")
+        write_fingerprint(log, self.test, self.get_triage_step())
 
         for test in tests:
             log.write("\n\n")
@@ -1002,7 +1410,8 @@ class TestRun(object):
             log.write("========== Details for " + test.optset + " optset.\n")
             log.write("====================================================================\n")
             if test.status == self.STATUS_compfail_timeout:
-                log.write("Build timeout: " + str(compiler_timeout) + " seconds\n")
+                log.write("Build timeout: " + format_timeout(test.build_timeout, test.build_retry_timeout,
+                                                             compiler_timeout) + "\n")
                 if Test.ignore_comp_time_exp:
                     log.write("File sizes: \n")
                     for file in self.test.files + self.files:
@@ -1011,6 +1420,7 @@ class TestRun(object):
             if test.status >= self.STATUS_compfail:
                 log.write("Build cmd: " + test.build_cmd + "\n")
                 log.write("Build exit code: " + str(test.build_ret_code) + "\n")
+                log.write("Build usage: " + format_usage(test.build_usage) + "\n")
                 log.write("=== Build log ======================================================\n")
                 log.write(str(test.build_stdout, "utf-8"))
                 log.write("=== Build err ======================================================\n")
@@ -1018,10 +1428,14 @@ class TestRun(object):
                 log.write("=== Build end ======================================================\n")
                 log.write("\n")
             if test.status == self.STATUS_runfail_timeout:
-                log.write("Exec timeout: " + str(run_timeout) + " seconds\n")
+                log.write("Exec timeout: " + format_timeout(test.run_timeout, test.run_retry_timeout, run_timeout) +
+                          "\n")
             if test.status >= self.STATUS_runfail:
                 log.write("Run cmd: " + test.run_cmd + "\n")
                 log.write("Run exit code: " + str(test.run_ret_code) + "\n")
+                log.write("Run usage: " + format_usage(test.run_usage) + "\n")
+                if test.run_dedup:
+                    log.write("Executable is identical to " + test.run_dedup + ", its result was reused\n")
                 log.write("=== Run log ========================================================\n")
                 log.write(str(test.run_stdout, "utf-8"))
                 log.write("=== Run err ========================================================\n")
@@ -1033,6 +1447,15 @@ class TestRun(object):
         return log_name
 # End of TestRun class
 
+def write_fingerprint(log, test, step):
+    fingerprint = test.fingerprints.get(step)
+    if fingerprint is None:
+        return
+    log.write("Fingerprint: " + fingerprint[0] + " (" + fingerprint[1] + ")\n")
+    if fingerprint[0] in test.duplicates:
+        log.write("Reduction was skipped: fingerprint has been reduced " + str(Test.reduce_per_fingerprint) +
+                  " times\n")
+
 # Run blaming in Test or TestRun object.
 # out: new files, blame_phase, blame_result
 def do_blame(test_obj, test_files, good_result, target_to_blame):
@@ -1043,6 +1466,7 @@ def do_blame(test_obj, test_files, good_result, target_to_blame):
         for f in test_files:
             common.check_and_copy(f, "blame")
         # Run blaming
+        steps = collections.Counter()
         blame_phase = blame_opt.prepare_env_and_blame(
             fail_dir = os.path.join(current_dir, "blame"),
             valid_res = good_result,
@@ -1050,7 +1474,9 @@ def do_blame(test_obj, test_files, good_result, target_to_blame):
             out_dir = "./blame",
             lock = None,
             num = test_obj.proc_num,
-            inplace = True)
+            inplace = True,
+            steps = steps)
+        test_obj.blame_steps = steps["probes"]
         # Copy resuls back
         os.chdir(current_dir)
         if os.path.exists("blame/Blame_Makefile"):
@@ -1072,6 +1498,10 @@ def do_blame(test_obj, test_files, good_result, target_to_blame):
 
 
 class CmdRun (object):
+    # Kinds of resource usage
+    USAGE_gen = "generator"
+    USAGE_build = "compiler"
+    USAGE_run = "executable"
 
     def __init__(self, name):
         self.name = name
@@ -1082,7 +1512,7 @@ class CmdRun (object):
         self.runfail = 0
         self.runfail_timeout = 0
         self.out_dif = 0
-        self.duration = datetime.timedelta(0)
+        self.usage = {}
 
     def update(self, tag):
         self.total += 1
@@ -1121,11 +1551,15 @@ class CmdRun (object):
         if tag == out_dif:
             return self.out_dif
 
-    def update_duration(self, interval):
-        self.duration += interval
+    def update_usage(self, kind, usage):
+        self.usage[kind] = common.add_usage(self.usage.get(kind, common.no_usage), usage)
 
+    def get_usage(self, kind):
+        return self.usage.get(kind, common.no_usage)
+
+    # Total cpu time
     def get_duration(self):
-        return self.duration
+        return datetime.timedelta(seconds=sum(u.user + u.sys for u in self.usage.values()))
 
     def get_name(self):
         return self.name
@@ -1175,6 +1609,15 @@ class StatsVault(object):
         return True if self.stats_num[StatsVault.stmt_stats_id] else False
 
 
+# Statistics of current process. In the main process it is Statistics object, which is shown to the user,
+# while worker processes of TestScheduler record their updates to StatisticsBatch.
+process_stat = None
+
+
+def get_process_stat():
+    return process_stat
+
+
 class Statistics (object):
     def __init__(self):
         self.yarpgen_runs = CmdRun("yarpgen")
@@ -1187,15 +1630,25 @@ class Statistics (object):
         self.seeds_pass = None
         self.seeds_fail = None
         self.collect_stats_enabled = False
+        self.build_cache_hits = 0
+        self.build_cache_misses = 0
+        self.run_dedups = 0
 
     def update_yarpgen_runs(self, tag):
         self.yarpgen_runs.update(tag)
+        if metrics.metrics is not None:
+            metrics.metrics.inc("yarpgen_generator_runs_total", {"status": tag})
 
     def get_yarpgen_runs(self, tag):
         return self.yarpgen_runs.get_value(tag)
 
-    def update_yarpgen_duration(self, interval):
-        self.yarpgen_runs.update_duration(interval)
+    def update_yarpgen_usage(self, usage):
+        self.yarpgen_runs.update_usage(CmdRun.USAGE_gen, usage)
+        if metrics.metrics is not None:
+            metrics.metrics.observe("yarpgen_generator_seconds", usage.wall)
+
+    def get_yarpgen_usage(self):
+        return self.yarpgen_runs.get_usage(CmdRun.USAGE_gen)
 
     def get_yarpgen_duration(self):
         return self.yarpgen_runs.get_duration()
@@ -1204,16 +1657,39 @@ class Statistics (object):
         if tag != ok:
             common.log_msg(logging.DEBUG, "Run of " + target_name + " has failed (" + tag + ")")
         self.target_runs[target_name].update(tag)
+        if metrics.metrics is not None:
+            metrics.metrics.inc("yarpgen_target_runs_total", {"target": target_name, "status": tag})
 
     def get_target_runs(self, target_name, tag):
         return self.target_runs[target_name].get_value(tag)
 
-    def update_target_duration(self, target_name, interval):
-        self.target_runs[target_name].update_duration(interval)
+    def update_target_usage(self, target_name, kind, usage):
+        self.target_runs[target_name].update_usage(kind, usage)
+        # Builds, which were taken from build cache, have no usage
+        if metrics.metrics is not None and usage != common.no_usage:
+            metric_name = "yarpgen_build_seconds" if kind == CmdRun.USAGE_build else "yarpgen_run_seconds"
+            metrics.metrics.observe(metric_name, usage.wall, {"target": target_name})
+            metrics.metrics.set("yarpgen_max_rss_bytes", usage.max_rss * 1024, {"target": target_name, "kind": kind})
+
+    def get_target_usage(self, target_name, kind):
+        return self.target_runs[target_name].get_usage(kind)
 
     def get_target_duration(self, target_name):
         return self.target_runs[target_name].get_duration()
 
+    def update_build_cache(self, hits, misses):
+        self.build_cache_hits += hits
+        self.build_cache_misses += misses
+
+    def get_build_cache_stats(self):
+        return self.build_cache_hits, self.build_cache_misses
+
+    def update_run_dedup(self):
+        self.run_dedups += 1
+
+    def get_run_dedups(self):
+        return self.run_dedups
+
     def enable_seeds(self):
         self.seeds_pass = []
         self.seeds_fail = []
@@ -1225,13 +1701,20 @@ class Statistics (object):
         return self.seeds_pass, self.seeds_fail
 
     def seed_passed(self, seed):
+        self.add_db_record("seeds", dict(get_shard_columns(seed), seed=seed, status="passed"))
         if not self.seeds_pass is None:
             self.seeds_pass.append(seed)
 
     def seed_failed(self, seed):
+        self.add_db_record("seeds", dict(get_shard_columns(seed), seed=seed, status="failed"))
         if not self.seeds_fail is None:
             self.seeds_fail.append(seed)
 
+    # Records are written by the main process, see campaign_db.py
+    def add_db_record(self, table, row):
+        if campaign_db.db is not None:
+            campaign_db.db.add(table, row)
+
     def add_stats(self, opt_stats, target_name, id):
         if opt_stats is not None:
             self.stats_vault[target_name].add_stats(opt_stats, id)
@@ -1254,7 +1737,67 @@ class Statistics (object):
     def get_collect_stmt_stats_enabled(self):
         return self.collect_stats_enabled
 
-MyManager.register("Statistics", Statistics)
+    # Statistics can't be pickled as is (see __reduce__()), so checkpoint keeps its state
+    def get_state(self):
+        return dict(self.__dict__)
+
+    def set_state(self, state):
+        self.__dict__.update(state)
+
+    # Test and TestRun objects are passed between processes, so they always refer to statistics of the
+    # process, where they are.
+    def __reduce__(self):
+        return (get_process_stat, ())
+
+    def apply_updates(self, updates):
+        for method_name, args in updates:
+            getattr(self, method_name)(*args)
+
+
+# Local statistics of worker process. Updates are recorded and sent to the scheduler in batch together with
+# the result of the task, so they cost nothing until the task is done.
+class StatisticsBatch (object):
+    update_methods = ["update_yarpgen_runs", "update_yarpgen_usage", "update_target_runs", "update_target_usage",
+                      "update_build_cache", "update_run_dedup", "seed_passed", "seed_failed", "add_stats",
+                      "add_db_record"]
+
+    def __init__(self):
+        self.updates = []
+
+    def __getattr__(self, name):
+        if name not in StatisticsBatch.update_methods:
+            raise AttributeError(name)
+        return lambda *args: self.updates.append((name, args))
+
+    def __reduce__(self):
+        return (get_process_stat, ())
+
+    def flush(self):
+        updates = self.updates
+        self.updates = []
+        return updates
+
+
+# Statistics, which are saved to checkpoint (see TestScheduler.get_checkpoint()). They only accumulate the updates,
+# while metrics, log and campaign database are updated by the statistics of the scheduler.
+class CheckpointStatistics (Statistics):
+    def __init__(self, stat):
+        self.set_state(copy.deepcopy(stat.get_state()))
+
+    def update_yarpgen_runs(self, tag):
+        self.yarpgen_runs.update(tag)
+
+    def update_yarpgen_usage(self, usage):
+        self.yarpgen_runs.update_usage(CmdRun.USAGE_gen, usage)
+
+    def update_target_runs(self, target_name, tag):
+        self.target_runs[target_name].update(tag)
+
+    def update_target_usage(self, target_name, kind, usage):
+        self.target_runs[target_name].update_usage(kind, usage)
+
+    def add_db_record(self, table, row):
+        pass
 
 
 def strfdelta(time_delta, format_str):
@@ -1278,6 +1821,20 @@ def add_metrix_prefix(num):
     return "{:.1f}{}".format(num / math.pow(unit, exp), prefix)
 
 
+# Columns of resource usage in campaign database (see campaign_db.py)
+def usage_columns(prefix, usage):
+    if usage is None:
+        return {prefix + "user_time": None, prefix + "sys_time": None, prefix + "wall_time": None,
+                prefix + "max_rss": None}
+    return {prefix + "user_time": usage.user, prefix + "sys_time": usage.sys, prefix + "wall_time": usage.wall,
+            prefix + "max_rss": usage.max_rss}
+
+
+def format_usage(usage):
+    return "user {:.1f} s, sys {:.1f} s, wall {:.1f} s, max RSS {}b".format(
+        usage.user, usage.sys, usage.wall, add_metrix_prefix(usage.max_rss * 1000))
+
+
 def get_total_stmt_stats(stmt_stats_list):
     if stmt_stats_list is None:
         return 0
@@ -1294,7 +1851,7 @@ def get_stmt_speed(stmt_stats, time_delta):
     return add_metrix_prefix(stmt_stats / time_delta.total_seconds()) + " SaE/s"
 
 
-def form_statistics(stat, targets, prev_len, tasks=None):
+def form_statistics(stat, targets, prev_len, active_tasks=0):
     verbose_stat_str = ""
 
     testing_speed = get_testing_speed(stat.get_yarpgen_runs(total), datetime.datetime.now() - script_start_time)
@@ -1310,6 +1867,7 @@ def form_statistics(stat, targets, prev_len, tasks=None):
     verbose_stat_str += "generator stat:" + "\n"
     verbose_stat_str += "cpu time: " + strfdelta(stat.get_yarpgen_duration(),
                                                  "{days} d {hours}:{minutes}:{seconds}") + "\n"
+    verbose_stat_str += "usage: " + format_usage(stat.get_yarpgen_usage()) + "\n"
     verbose_stat_str += "\t" + total + " : " + str(stat.get_yarpgen_runs(total)) + "\n"
     verbose_stat_str += "\t" + ok + " : " + str(stat.get_yarpgen_runs(ok)) + "\n"
     verbose_stat_str += "\t" + runfail_timeout + " : " + str(stat.get_yarpgen_runs(runfail_timeout)) + "\n"
@@ -1335,6 +1893,8 @@ def form_statistics(stat, targets, prev_len, tasks=None):
         verbose_stat_str += "\tcpu time: " + strfdelta(stat.get_target_duration(i.name),
                                                        "{days} d {hours}:{minutes}:{seconds}") + "\n"
         total_cpu_duration += stat.get_target_duration(i.name)
+        for kind in [CmdRun.USAGE_build, CmdRun.USAGE_run]:
+            verbose_stat_str += "\t" + kind + " usage: " + format_usage(stat.get_target_usage(i.name, kind)) + "\n"
         verbose_stat_str += "\t" + total + " : " + str(stat.get_target_runs(i.name, total)) + "\n"
         total_runs += stat.get_target_runs(i.name, total)
         verbose_stat_str += "\t" + ok + " : " + str(stat.get_target_runs(i.name, ok)) + "\n"
@@ -1350,6 +1910,16 @@ def form_statistics(stat, targets, prev_len, tasks=None):
         verbose_stat_str += "\t" + out_dif + " : " + str(stat.get_target_runs(i.name, out_dif)) + "\n"
         total_out_dif += stat.get_target_runs(i.name, out_dif)
 
+    verbose_stat_str += "\n##########################\n"
+    verbose_stat_str += "runs of identical executables, which were skipped: " + str(stat.get_run_dedups()) + "\n"
+
+    if build_cache.cache is not None:
+        cache_hits, cache_misses = stat.get_build_cache_stats()
+        verbose_stat_str += "\n##########################\n"
+        verbose_stat_str += "build cache stat:\n"
+        verbose_stat_str += "\thits : " + str(cache_hits) + "\n"
+        verbose_stat_str += "\tmisses : " + str(cache_misses) + "\n"
+
     if stat.seeds_enabled():
         seeds_pass, seeds_fail = stat.get_seeds()
         verbose_stat_str += "PASSED SEEDS (" + str(len(seeds_pass)) + "): " + \
@@ -1370,18 +1940,12 @@ def form_statistics(stat, targets, prev_len, tasks=None):
                 stmt_stats_list.append(stat.get_total_stats_num(i.name, StatsVault.stmt_stats_id))
     verbose_stat_str += "\n=================================\n"
 
-    active = 0
-    if tasks:
-        for task in tasks:
-            if task.is_alive():
-                active = active + 1
-
     stat_str = '\r'
     stat_str += "time " + strfdelta(datetime.datetime.now() - script_start_time,
                                     "{days} d {hours}:{minutes}:{seconds}") + " | "
     stat_str += "cpu time: " + strfdelta(total_cpu_duration, "{days} d {hours}:{minutes}:{seconds}") + " | "
     stat_str += testing_speed + " | "
-    stat_str += " active " + str(active) + " | "
+    stat_str += " active " + str(active_tasks) + " | "
     stat_str += "seeds/targets: " + str(total_seeds)+"/"+str(total_runs) + " | "
     stat_str += "Errors(g/ct/c/rt/r/d): " + str(total_gen_errors) + "/"
     stat_str += str(total_compfail_timeout) + "/"
@@ -1403,28 +1967,15 @@ def form_statistics(stat, targets, prev_len, tasks=None):
     return stat_str, verbose_stat_str, prev_len
 
 
-# Print realtime stats and also run tmp cleaner in background.
-def print_online_statistics_and_cleanup(lock, stat, targets, task_threads, num_jobs, no_tmp_cln):
-    any_alive = True
-    prev_len = 0
-    start_time = time.time() - tmp_cleanup_delay
-    while any_alive:
-        lock.acquire()
-        stat_str, verbose_stat_str, prev_len = form_statistics(stat, targets, prev_len, task_threads)
-        common.stat_logger.log(logging.INFO, verbose_stat_str)
-        sys.stdout.write(stat_str)
-        sys.stdout.flush()
-        lock.release()
-
-        if (time.time() - start_time) > tmp_cleanup_delay and not no_tmp_cln:
-            start_time = time.time()
-            common.run_cmd([os.path.abspath(common.yarpgen_home + os.sep + "tmp_cleaner.sh")])
-
-        time.sleep(stat_update_delay)
-
-        any_alive = False
-        for num in range(num_jobs):
-            any_alive |= task_threads[num].is_alive()
+# Print realtime stats
+def print_online_statistics(lock, stat, targets, prev_len, active_tasks):
+    lock.acquire()
+    stat_str, verbose_stat_str, prev_len = form_statistics(stat, targets, prev_len, active_tasks)
+    common.stat_logger.log(logging.INFO, verbose_stat_str)
+    sys.stdout.write(stat_str)
+    sys.stdout.flush()
+    lock.release()
+    return prev_len
 
 
 def gen_test_makefile_and_copy(dest, config_file):
@@ -1516,8 +2067,35 @@ def proccess_seeds(seeds_option_value):
         common.log_msg(logging.INFO, "Note, that in the input seeds list there were "+str(len(seeds)-len(unique_seeds))+" duplicating seeds.", forced_duplication=True)
     return unique_seeds
 
+# Checkpoint of testing is written to output directory atomically, so it is either old or new one after crash
+def save_checkpoint(out_dir, checkpoint):
+    checkpoint_file = os.path.join(out_dir, checkpoint_file_name)
+    try:
+        with open(checkpoint_file + ".tmp", "wb") as f:
+            pickle.dump(checkpoint, f)
+        os.replace(checkpoint_file + ".tmp", checkpoint_file)
+    except OSError as e:
+        common.log_msg(logging.ERROR, "Can't write checkpoint " + checkpoint_file + ": " + str(e))
+
+
+def load_checkpoint(out_dir):
+    checkpoint_file = os.path.join(out_dir, checkpoint_file_name)
+    if not os.path.isfile(checkpoint_file):
+        common.print_and_exit("Can't resume testing: there is no checkpoint " + checkpoint_file)
+    with open(checkpoint_file, "rb") as f:
+        return pickle.load(f)
+
+
+def remove_checkpoint(out_dir):
+    checkpoint_file = os.path.join(out_dir, checkpoint_file_name)
+    if os.path.isfile(checkpoint_file):
+        os.remove(checkpoint_file)
+
+
 def prepare_env_and_start_testing(out_dir, timeout, targets, num_jobs, config_file, seeds_option_value, blame, creduce,
-                                  no_tmp_cln, collect_stat):
+                                  no_tmp_cln, collect_stat, prefetch, scratch_dir, scratch_size, resume,
+                                  agent_address=None, auth_key=None, seed_stream=None, adaptive_timeouts=False,
+                                  mem_budget=None):
     gen_test_makefile.check_if_std_defined()
     common.check_dir_and_create(out_dir)
 
@@ -1553,26 +2131,50 @@ def prepare_env_and_start_testing(out_dir, timeout, targets, num_jobs, config_fi
         common.log_msg(logging.WARNING, "Can't collect statistics for those targets, because they are not running: "
                                          + str(missed_stat_targets) + "\n", forced_duplication=True)
 
-    seeds = []
-    task_queue = None
-    if seeds_option_value:
+    # Resumed testing continues with the seeds of checkpoint
+    checkpoint = load_checkpoint(out_dir) if resume else None
+    seeds = None
+    if checkpoint is not None:
+        seeds = checkpoint["seeds"]
+    elif seeds_option_value:
         seeds = proccess_seeds(seeds_option_value)
-        task_queue = multiprocessing.Queue()
-        for s in seeds:
-            task_queue.put(s)
-        if len(seeds) < num_jobs:
-            num_jobs = len(seeds)
+    if seeds is not None:
+        seed_num = len(seeds)
+        if checkpoint is not None:
+            seed_num += len(checkpoint["seeds_to_rerun"]) + len(checkpoint["tests"])
+        if seed_num < num_jobs:
+            num_jobs = max(seed_num, 1)
+        prefetch = max(min(prefetch, seed_num - num_jobs), 0)
 
     print_compilers_version(targets)
 
     os.chdir(out_dir)
+    global testing_dir
+    testing_dir = out_dir
     common.check_dir_and_create(res_dir)
-    for i in range(num_jobs):
-        common.check_dir_and_create(process_dir + str(i))
+    # Test directories are placed either to testing directory or to private directory inside of scratch directory
+    # (usually, it is tmpfs), so only saved tests reach the disk. Resumed testing reuses private directory
+    # of interrupted run.
+    test_root = out_dir
+    old_test_root = checkpoint.get("test_root") if checkpoint is not None else None
+    if old_test_root is not None and not os.path.isdir(old_test_root):
+        old_test_root = None
+    if scratch_dir:
+        common.check_dir_and_create(scratch_dir)
+        if old_test_root is not None and old_test_root != out_dir and \
+           os.path.dirname(old_test_root) == os.path.abspath(scratch_dir):
+            test_root = old_test_root
+        else:
+            test_root = tempfile.mkdtemp(prefix="yarpgen_", dir=scratch_dir)
+        common.log_msg(logging.DEBUG, "Test directories are placed to " + test_root)
+    test_dirs = [os.path.join(test_root, process_dir + str(i)) for i in range(num_jobs + prefetch)]
+    for test_dir in test_dirs:
+        common.check_dir_and_create(test_dir)
 
     lock = multiprocessing.Lock()
-    manager_obj = manager()
-    stat = manager_obj.Statistics()
+    global process_stat
+    process_stat = Statistics() if agent_address is None else AgentStatistics()
+    stat = process_stat
     if seeds_option_value:
         stat.enable_seeds()
     if len(collect_stat.split()) > 0 and "clang" in collect_stat:
@@ -1582,92 +2184,861 @@ def prepare_env_and_start_testing(out_dir, timeout, targets, num_jobs, config_fi
     end_time = start_time + timeout * 60
     if timeout == -1:
         end_time = -1
-
-    task_threads = [0] * num_jobs
-    for num in range(num_jobs):
-        task_threads[num] = multiprocessing.Process(target=gen_and_test,
-                                                    args=(num, makefile, lock, end_time, task_queue, stat, targets,
-                                                          blame, creduce_makefile, collect_stat.split()))
-        task_threads[num].start()
-
-    print_online_statistics_and_cleanup(lock, stat, targets, task_threads, num_jobs, no_tmp_cln)
+    if checkpoint is not None:
+        stat.set_state(checkpoint["stat"])
+        end_time = -1 if checkpoint["time_left"] == -1 else start_time + checkpoint["time_left"]
+        if seed_stream is not None and checkpoint.get("seed_counter") is not None:
+            seed_stream.counter = checkpoint["seed_counter"]
+    # History of timeouts is kept across leases of agent
+    timeouts = AdaptiveTimeouts() if adaptive_timeouts else None
+    if timeouts is not None and checkpoint is not None and checkpoint.get("timeouts") is not None:
+        timeouts.set_state(checkpoint["timeouts"])
+    memory = MemoryModel(mem_budget) if mem_budget else None
+    if memory is not None and checkpoint is not None and checkpoint.get("memory") is not None:
+        memory.set_state(checkpoint["memory"])
+    buckets = FailureBuckets(Test.reduce_per_fingerprint) if creduce_makefile and Test.reduce_per_fingerprint else None
+    if buckets is not None and checkpoint is not None and checkpoint.get("buckets") is not None:
+        buckets.set_state(checkpoint["buckets"])
+
+    scratch_limit = scratch_size * 1024 * 1024 if scratch_dir and scratch_size > 0 else None
+    if agent_address is None:
+        scheduler = TestScheduler(num_jobs, makefile, lock, end_time, seeds, stat, targets, blame, creduce_makefile,
+                                  collect_stat.split(), no_tmp_cln, test_dirs, prefetch, scratch_limit, checkpoint,
+                                  seed_stream, timeouts, memory, buckets)
+        # Tests of interrupted run are taken by scheduler, so the rest of its directories may be removed
+        if old_test_root is not None:
+            remove_stale_test_dirs(old_test_root, test_dirs, out_dir)
+        scheduler.run()
+    else:
+        # Agent tests seeds of coordinator lease by lease. Workers serve all leases, and they are forked before
+        # heartbeat thread of agent is started.
+        workers = create_workers(num_jobs, prefetch)
+        agent = Agent(agent_address, auth_key, num_jobs, stat)
+        while True:
+            seeds = agent.get_lease()
+            if seeds is None:
+                break
+            scheduler = TestScheduler(num_jobs, makefile, lock, end_time, seeds, stat, targets, blame,
+                                      creduce_makefile, collect_stat.split(), no_tmp_cln, test_dirs, prefetch,
+                                      scratch_limit, timeouts=timeouts, memory=memory, buckets=buckets,
+                                      workers=workers)
+            scheduler.run()
+        agent.close()
+        stop_workers(workers)
 
     sys.stdout.write("\n")
-    for i in range(num_jobs):
-        common.log_msg(logging.DEBUG, "Removing " + process_dir + str(i) + " dir")
-        shutil.rmtree(process_dir + str(i))
+    for test_dir in test_dirs:
+        common.log_msg(logging.DEBUG, "Removing " + test_dir + " dir")
+        shutil.rmtree(test_dir)
+    if test_root != out_dir:
+        os.rmdir(test_root)
+    # Leftovers of interrupted saves
+    shutil.rmtree(os.path.join(testing_dir, staging_dir_name), ignore_errors=True)
+    if campaign_db.db is not None:
+        campaign_db.db.close()
+    if metrics.metrics is not None:
+        metrics.metrics.close()
+    if seed_stream is not None:
+        common.log_msg(logging.INFO, "Tested seeds of " + seed_stream.get_coverage_str(), forced_duplication=True)
 
     stat_str, verbose_stat_str, prev_len = form_statistics(stat, targets, 0)
     sys.stdout.write(verbose_stat_str)
     sys.stdout.flush()
 
 
-def gen_and_test(num, makefile, lock, end_time, task_queue, stat, targets, blame, creduce_makefile, stat_targets):
-    common.log_msg(logging.DEBUG, "Job #" + str(num))
-    os.chdir(process_dir + str(num))
-    work_dir = os.getcwd()
-    inf = (end_time == -1) or not (task_queue is None)
+# Remove test directories of interrupted run, which are not used by current one, and its private directory
+# in scratch directory
+def remove_stale_test_dirs(old_test_root, test_dirs, out_dir):
+    for entry in os.listdir(old_test_root):
+        old_dir = os.path.join(old_test_root, entry)
+        if entry.startswith(process_dir) and old_dir not in test_dirs:
+            common.log_msg(logging.DEBUG, "Removing stale " + old_dir + " dir")
+            shutil.rmtree(old_dir, ignore_errors=True)
+    if old_test_root != out_dir and len(os.listdir(old_test_root)) == 0:
+        os.rmdir(old_test_root)
+
+
+# Limit address space of worker process. Only soft limit is changed, so it can be raised back for the next
+# task. The limit is inherited by all processes, which are started by the task (generator, compilers, test,
+# blaming and creduce).
+def set_worker_mem_limit(mem_limit):
+    soft, hard = resource.getrlimit(resource.RLIMIT_AS)
+    if mem_limit is not None:
+        soft = mem_limit * 1024
+        if hard != resource.RLIM_INFINITY:
+            soft = min(soft, hard)
+    resource.setrlimit(resource.RLIMIT_AS, (soft, hard))
+
+
+# Main loop of worker process. It receives tasks from scheduler through the pipe and sends back
+# their results or errors and updates of statistics.
+def task_worker(num, conn):
+    global process_stat
+    process_stat = StatisticsBatch()
+    default_mem_limit = resource.getrlimit(resource.RLIMIT_AS)
+    while True:
+        task = conn.recv()
+        if task is None:
+            break
+        res = None
+        err = None
+        try:
+            os.chdir(task.test_dir)
+            set_worker_mem_limit(task.mem_limit)
+            res = task.func(*task.args)
+        # common.print_and_exit() raises SystemExit, but the worker should survive it.
+        except (Exception, SystemExit) as e:
+            err = type(e).__name__ + ": " + str(e)
+        finally:
+            resource.setrlimit(resource.RLIMIT_AS, default_mem_limit)
+        conn.send((res, err, process_stat.flush()))
+    conn.close()
+
+
+# Tasks, which are executed by worker processes. Each task works in test directory of its seed.
+def gen_task(seed, stat, proc_num, makefile, blame, creduce_makefile, gen_args=None):
+    common.clean_dir(".")
+    common.check_and_copy(makefile, ".")
+    # Generate the test.
+    # TODO: maybe, it is better to call generator through Makefile?
+    test = Test(stat=stat, seed=seed, proc_num=proc_num, blame=blame, creduce_makefile=creduce_makefile,
+                gen_args=gen_args)
+    if not test.is_ok():
+        test.save()
+    return test
+
+
+def build_task(test_run):
+    test_run.build()
+    return test_run
+
+
+def run_task(test_run):
+    test_run.run()
+    return test_run
+
+
+def triage_task(test, step):
+    test.do_triage_step(step)
+    return test
+
+
+def save_results_task(test):
+    test.save_results()
+
+
+class Task(object):
+    KIND_gen = "generate"
+    KIND_build = "build"
+    KIND_run = "run"
+    KIND_blame = "blame"
+    KIND_reduce = "reduce"
+    KIND_save = "save"
+
+    # mem_limit (in kbytes) is applied to everything, which is run by the task
+    def __init__(self, kind, func, args, test_dir, mem_limit=None):
+        self.kind = kind
+        self.func = func
+        self.args = args
+        self.test_dir = test_dir
+        self.mem_limit = mem_limit
+        # Predicted peak RSS (in kbytes) of admitted task and whether it runs without other builds
+        # (see TestScheduler.dispatch())
+        self.mem_estimate = 0
+        self.exclusive = False
+        # Number of times the task was rescheduled after failure of worker (see TestScheduler.retry_lost_task())
+        self.retries = 0
+
+    # Builds and triage steps (blaming probes and parallel compiles of creduce) run compilers
+    def runs_compiler(self):
+        return self.kind in (Task.KIND_build, Task.KIND_blame, Task.KIND_reduce)
+
+
+# Worker process and its deque of pending tasks
+class Worker(object):
+    def __init__(self, num):
+        self.num = num
+        self.tasks = collections.deque()
+        self.task = None
+        self.start()
+
+    def start(self):
+        self.conn, child_conn = multiprocessing.Pipe()
+        self.process = multiprocessing.Process(target=task_worker, args=(self.num, child_conn))
+        with common.fork_lock:
+            self.process.start()
+        child_conn.close()
+
+    # Worker process may be killed (by OOM killer, for example), so it has to be replaced
+    def restart(self):
+        self.conn.close()
+        self.process.join()
+        self.start()
+
+    def stop(self):
+        self.conn.send(None)
+        self.conn.close()
+        self.process.join()
+
+    def is_idle(self):
+        return self.task is None
+
+    def submit(self, task):
+        self.task = task
+        self.conn.send(task)
+
+    def receive(self):
+        task = self.task
+        self.task = None
+        try:
+            res, err, stat_updates = self.conn.recv()
+        except EOFError:
+            res = None
+            err = "worker process " + str(self.num) + " has died"
+            stat_updates = []
+            self.restart()
+        return task, res, err, stat_updates
+
+
+# Returns workers and generation worker (if prefetch is used) of TestScheduler
+def create_workers(num_jobs, prefetch):
+    return [Worker(i) for i in range(num_jobs)], Worker(num_jobs) if prefetch > 0 else None
+
+
+def stop_workers(workers):
+    for worker in workers[0] + [workers[1]]:
+        if worker is not None:
+            worker.stop()
+
+
+# Work-stealing scheduler of fine-grained tasks.
+# Every seed in flight owns one of process_N test directories. The test is generated there, after that
+# build and run of every opt-set, every triage step (blaming and reduction) and saving of results are
+# separate tasks. Opt-sets are built concurrently, so all their outputs have opt-set prefix
+# (see gen_test_makefile.py), while triage steps of the seed are executed one by one.
+# Tasks of the seed are pushed to the deque of the worker, which has generated the seed. Worker takes
+# its own tasks from the back of the deque, so it finishes seeds one by one. Idle worker steals the oldest
+# task of the worker with the longest deque and starts new seed only if there is nothing to steal,
+# so one long compilation doesn't stall the rest of opt-sets of its seed.
+# Generation is taken off the critical path by one extra worker, which generates up to "prefetch" seeds
+# ahead of compilation. Idle worker adopts the oldest prefetched seed before generating a new one itself.
+# Every prefetched seed occupies its own test directory, so the depth of prefetch bounds extra disk usage.
+# Random seeds are taken from shard of campaign (see --campaign option), so the campaign can be replayed
+# and seeds of different runs and hosts never collide. Counter of the stream is saved to checkpoint.
+class ShardSeedStream(object):
+    def __init__(self, campaign, shard, counter=0):
+        self.campaign = campaign
+        self.shard = shard
+        self.first_counter = counter
+        self.counter = counter
+
+    # Returns next seed or None if the shard is exhausted
+    def next(self):
+        if self.counter >= (1 << common.counter_bits):
+            return None
+        seed = str(common.get_shard_seed(self.campaign, self.shard, self.counter))
+        self.counter += 1
+        return seed
+
+    def get_coverage_str(self):
+        return "campaign " + str(self.campaign) + ", shard " + str(self.shard) + ", counters [" + \
+               str(self.first_counter) + ", " + str(self.counter) + ")"
+
+
+# Timeout of the retry of build or run, which has exceeded adaptive timeout
+def get_retry_timeout(time_out, limit):
+    return min(limit, time_out * adaptive_timeout_retry_factor)
+
+
+def format_timeout(time_out, retry_timeout, limit):
+    ret = str(time_out) + " seconds"
+    if retry_timeout is not None:
+        ret += ", retry: " + str(retry_timeout) + " seconds"
+    return ret + " (limit " + str(limit) + ")"
+
+
+# Per-target timeouts, which are learned from history of builds and runs (see --adaptive-timeouts option).
+# Only the scheduler chooses timeouts, workers get them with test runs.
+class AdaptiveTimeouts(object):
+    def __init__(self):
+        # (target, usage kind) -> wall times of recent builds or runs
+        self.history = {}
 
-    while inf or end_time > time.time():
-        # Fetch next seed if seeds were specified
-        seed = ""
-        if task_queue is not None:
-            # Python multiprocessing queue may raise empty exception
-            # even for non empty queue, so do several attempts to not loos workers.
-            for i in range(3):
-                try:
-                    seed = task_queue.get_nowait()
-                except queue.Empty:
-                    time.sleep(1/(num+1))
-                    seed = "done"
-                else:
-                    break
-            if seed == "done":
-                break
+    # Builds with any build cache hit are not passed here (see TestScheduler.handle_result()), as their usage
+    # isn't a measurement. Deduplicated runs have no usage.
+    def add(self, target_name, kind, usage):
+        if usage == common.no_usage:
+            return
+        history = self.history.setdefault((target_name, kind),
+                                          collections.deque(maxlen=adaptive_timeout_window))
+        history.append(usage.wall)
+
+    # Returns timeout (in seconds), which doesn't exceed the limit
+    def get(self, target_name, kind, limit):
+        history = self.history.get((target_name, kind))
+        if history is None or len(history) < adaptive_timeout_min_samples:
+            return limit
+        times = sorted(history)
+        quantile = times[min(int(math.ceil(adaptive_timeout_quantile * len(times))), len(times)) - 1]
+        return min(limit, max(adaptive_timeout_min, int(math.ceil(quantile * adaptive_timeout_factor))))
+
+    def get_state(self):
+        return {key: list(history) for key, history in self.history.items()}
+
+    def set_state(self, state):
+        for key, times in state.items():
+            self.history[key] = collections.deque(times, maxlen=adaptive_timeout_window)
+
+
+# Prediction of peak RSS of compilers per testing set and size of test (see --mem-budget option)
+class MemoryModel(object):
+    def __init__(self, budget):
+        # Memory (in kbytes), which may be used by concurrent builds
+        self.budget = budget
+        # Target -> peak RSS (in kbytes) per byte of test for recent builds
+        self.history = {}
+
+    def add(self, target_name, test_size, usage):
+        # Builds, which were taken from build cache, have no usage
+        if usage == common.no_usage or test_size == 0:
+            return
+        history = self.history.setdefault(target_name, collections.deque(maxlen=memory_model_window))
+        history.append(usage.max_rss / test_size)
 
-        # Cleanup before start
-        if os.getcwd() != work_dir:
-            raise
-        common.clean_dir(".")
-        common.check_and_copy(makefile, work_dir)
-
-        # Generate the test.
-        # TODO: maybe, it is better to call generator through Makefile?
-        test = Test(stat=stat, seed=seed, proc_num=num, blame=blame,
-                    creduce_makefile=creduce_makefile)
-        if not test.is_ok():
-            test.save(lock)
-            continue
+    def predict(self, target_name, test_size):
+        history = self.history.get(target_name)
+        if history is None or len(history) == 0:
+            return default_build_mem_estimate
+        ratios = sorted(history)
+        ratio = ratios[min(int(math.ceil(memory_model_quantile * len(ratios))), len(ratios)) - 1]
+        return int(math.ceil(ratio * test_size * memory_model_factor))
 
-        # Run all required opt-sets.
-        out_res = set()
-        prev_out_res_len = 1  # We can't check first result
-        for t in gen_test_makefile.CompilerTarget.all_targets:
-            # Skip the target we are not supposed to run.
-            if t.specs.name not in targets.split():
-                continue
-            target_elapsed_time = 0.0
+    def get_state(self):
+        return {target_name: list(history) for target_name, history in self.history.items()}
 
-            test_run = TestRun(test=test, stat=stat, target=t, proc_num=num,
-                               parse_stats= True if (t.name in stat_targets) else False)
-            if not test_run.build():
-                test.add_fail_run(test_run)
+    def set_state(self, state):
+        for target_name, ratios in state.items():
+            self.history[target_name] = collections.deque(ratios, maxlen=memory_model_window)
+
+
+# Numbers of failures per fingerprint (see --reduce-per-fingerprint option). Only the first failures of every
+# fingerprint are reduced, the rest are saved to the bucket of the fingerprint as is.
+class FailureBuckets(object):
+    def __init__(self, limit):
+        self.limit = limit
+        # Fingerprint hash -> number of failures
+        self.counts = {}
+        # Failures, which were reduced by the previous runs of campaign
+        if campaign_db.db is not None:
+            self.counts.update(campaign_db.db.get_fingerprint_counts())
+
+    # Returns True, if the failure should be reduced
+    def add(self, fingerprint):
+        self.counts[fingerprint] = self.counts.get(fingerprint, 0) + 1
+        return self.counts[fingerprint] <= self.limit
+
+    def get_state(self):
+        return dict(self.counts)
+
+    def set_state(self, state):
+        for fingerprint, count in state.items():
+            self.counts[fingerprint] = max(count, self.counts.get(fingerprint, 0))
+
+
+# Campaign of current run (see --campaign option) or None
+campaign_id = None
+
+
+# Coordinates of seed in campaign for campaign database. Seeds of other campaigns are not accounted.
+def get_shard_columns(seed):
+    if campaign_id is None:
+        return {}
+    try:
+        campaign, shard, counter = common.get_shard_coords(int(seed.split("_")[-1]))
+    except ValueError:
+        return {}
+    if campaign != campaign_id:
+        return {}
+    return {"campaign": campaign, "shard": shard, "counter": counter}
+
+
+# Scheduler itself works in the main process and communicates with workers through pipes, so new tasks
+# are created and assigned only there.
+class TestScheduler(object):
+    def __init__(self, num_jobs, makefile, lock, end_time, seeds, stat, targets, blame, creduce_makefile,
+                 stat_targets, no_tmp_cln, test_dirs, prefetch=0, scratch_limit=None, checkpoint=None,
+                 seed_stream=None, timeouts=None, memory=None, buckets=None, workers=None):
+        self.num_jobs = num_jobs
+        self.prefetch = prefetch
+        self.makefile = makefile
+        self.lock = lock
+        self.end_time = end_time
+        # Specified seeds are run regardless of timeout
+        self.seeds = list(seeds) if seeds is not None else None
+        # Source of "random" seeds or None for seeds, which are chosen by generator
+        self.seed_stream = seed_stream
+        # Timeouts of builds and runs are fixed, if it is None
+        self.timeouts = timeouts
+        # Builds are admitted regardless of memory, if it is None
+        self.memory = memory
+        # Builds, which were killed for memory and wait for running builds to finish
+        self.exclusive_tasks = collections.deque()
+        self.memory_retries = 0
+        # All failures are reduced, if it is None
+        self.buckets = buckets
+        self.skipped_reductions = 0
+        self.stat = stat
+        # Tests in flight are rerun after resume, so checkpoint keeps statistics without their updates.
+        # Updates of test are moved there, when the test is finished or continued after resume (is in triage).
+        self.checkpoint_stat = CheckpointStatistics(stat)
+        self.test_updates = {}
+        self.targets = [t for t in gen_test_makefile.CompilerTarget.all_targets if t.specs.name in targets.split()]
+        self.targets_str = targets
+        self.blame = blame
+        self.creduce_makefile = creduce_makefile
+        self.stat_targets = stat_targets
+        self.no_tmp_cln = no_tmp_cln
+
+        self.free_test_dirs = list(reversed(test_dirs))
+        # Size limit (in bytes) of all test directories. New tests aren't started while it is exceeded.
+        self.test_root = os.path.dirname(test_dirs[0])
+        self.scratch_limit = scratch_limit
+        # Walk of test directories is expensive, so their size is sampled on a timer
+        self.scratch_size = 0
+        self.scratch_size_time = None
+        # Tests in flight, their owners and number of unfinished opt-sets (by test directory).
+        # Prefetched tests have no owner until they are adopted.
+        self.tests = {}
+        self.owners = {}
+        self.unfinished_runs = {}
+        self.exe_runs = {}
+        self.prefetched_tests = collections.deque()
+        self.stolen_tasks = 0
+        self.adopted_tests = 0
+        # Workers may be started by the caller (see create_workers()) and serve several schedulers
+        self.own_workers = workers is None
+        self.workers, self.gen_worker = create_workers(num_jobs, prefetch) if workers is None else workers
+        # Workers are forked, so metrics can be served from now on
+        metrics.start_server()
+        # Seeds of tests in flight (by test directory). They are rerun, if testing is resumed from checkpoint.
+        self.test_seeds = {}
+        # Seeds, which are run before any others, and tests in triage, which are continued after resume.
+        # Generated tests are regenerated with the same budget (see Test.get_gen_args()).
+        self.resumed_seeds = []
+        self.resumed_gen_args = {}
+        self.resumed_tests = collections.deque()
+        if checkpoint is not None:
+            self.resume(checkpoint)
+
+    # Checkpoint is written periodically by the main loop (see --resume option).
+    # Generation and runs of tests in flight are cheap, so only their seeds are saved. Generated tests are saved
+    # with budget options of generator, which reproduce them. Tests in triage (blaming and reduction) are saved
+    # with their directories to be continued.
+    def get_checkpoint(self):
+        seeds_to_rerun = list(self.resumed_seeds)
+        seed_gen_args = dict(self.resumed_gen_args)
+        tests = []
+        for test_dir in self.owners:
+            test = self.tests.get(test_dir)
+            if test is not None and test.triage_steps is not None:
+                self.commit_updates(test_dir)
+                tests.append((test_dir, pickle.dumps(test)))
+            elif test is not None:
+                seeds_to_rerun.append(test.seed)
+                seed_gen_args[test.seed] = test.get_gen_args()
+            elif self.test_seeds.get(test_dir):
+                seeds_to_rerun.append(self.test_seeds[test_dir])
+        return {"stat": self.checkpoint_stat.get_state(),
+                "seeds": list(self.seeds) if self.seeds is not None else None,
+                "seed_counter": self.seed_stream.counter if self.seed_stream is not None else None,
+                "timeouts": self.timeouts.get_state() if self.timeouts is not None else None,
+                "memory": self.memory.get_state() if self.memory is not None else None,
+                "buckets": self.buckets.get_state() if self.buckets is not None else None,
+                "time_left": -1 if self.end_time == -1 else max(self.end_time - time.time(), 0),
+                "seeds_to_rerun": seeds_to_rerun,
+                "seed_gen_args": seed_gen_args,
+                "test_root": self.test_root,
+                "tests": tests}
+
+    # Statistics updates of tasks are applied at once, and they are kept by test until they can be checkpointed
+    def apply_updates(self, test_dir, updates):
+        self.stat.apply_updates(updates)
+        self.test_updates.setdefault(test_dir, []).extend(updates)
+
+    def commit_updates(self, test_dir):
+        self.checkpoint_stat.apply_updates(self.test_updates.pop(test_dir, []))
+
+    def resume(self, checkpoint):
+        self.resumed_seeds = list(checkpoint["seeds_to_rerun"])
+        self.resumed_gen_args = dict(checkpoint.get("seed_gen_args", {}))
+        # Tests keep their directories, if possible
+        tests = [(old_dir, pickle.loads(test_data)) for old_dir, test_data in checkpoint["tests"]]
+        tests.sort(key=lambda t: t[0] not in self.free_test_dirs)
+        for old_dir, test in tests:
+            if not os.path.isdir(old_dir) or len(self.free_test_dirs) == 0:
+                common.log_msg(logging.DEBUG, "Directory of seed " + test.seed + " is lost, it is rerun")
+                self.resumed_seeds.append(test.seed)
+                self.resumed_gen_args[test.seed] = test.get_gen_args()
                 continue
+            if old_dir in self.free_test_dirs:
+                test_dir = old_dir
+                self.free_test_dirs.remove(test_dir)
+            else:
+                test_dir = self.free_test_dirs.pop()
+                common.clean_dir(test_dir)
+                for entry in os.listdir(old_dir):
+                    common.check_and_copy(os.path.join(old_dir, entry), test_dir)
+            # Blaming is restarted from scratch
+            if len(test.triage_steps) > 0 and test.triage_steps[0].startswith("blame"):
+                shutil.rmtree(os.path.join(test_dir, "blame"), ignore_errors=True)
+            test.path = test_dir
+            test.proc_num = int(os.path.basename(test_dir)[len(process_dir):])
+            self.tests[test_dir] = test
+            self.owners[test_dir] = None
+            self.test_seeds[test_dir] = test.seed
+            self.resumed_tests.append(test_dir)
+        common.log_msg(logging.INFO, "Testing is resumed: " + str(len(self.resumed_tests)) + " tests are continued, " +
+                       str(len(self.resumed_seeds)) + " seeds are rerun")
+
+    # Returns next seed ("" for random one) or None if testing is over
+    def next_seed(self):
+        if len(self.resumed_seeds) > 0:
+            return self.resumed_seeds.pop(0)
+        if self.seeds is not None:
+            return self.seeds.pop(0) if len(self.seeds) > 0 else None
+        if self.end_time == -1 or self.end_time > time.time():
+            return self.seed_stream.next() if self.seed_stream is not None else ""
+        return None
 
-            if not test_run.run():
+    def new_test_task(self, worker):
+        if len(self.free_test_dirs) == 0:
+            return None
+        # Backpressure on scratch directory. Tests in flight will free the space eventually.
+        if self.scratch_limit is not None and len(self.owners) > 0 and \
+           self.get_scratch_size() >= self.scratch_limit:
+            return None
+        seed = self.next_seed()
+        if seed is None:
+            return None
+        test_dir = self.free_test_dirs.pop()
+        proc_num = int(os.path.basename(test_dir)[len(process_dir):])
+        self.owners[test_dir] = worker
+        self.test_seeds[test_dir] = seed
+        return Task(Task.KIND_gen, gen_task,
+                    (seed, self.stat, proc_num, self.makefile, self.blame, self.creduce_makefile,
+                     self.resumed_gen_args.get(seed)),
+                    test_dir, yarpgen_mem_limit)
+
+    def get_scratch_size(self):
+        if self.scratch_size_time is None or time.time() - self.scratch_size_time >= scratch_size_check_delay:
+            self.scratch_size = common.get_dir_size(self.test_root)
+            self.scratch_size_time = time.time()
+        return self.scratch_size
+
+    def next_task(self, worker):
+        if len(worker.tasks) > 0:
+            return worker.tasks.pop()
+        victim = max(self.workers, key=lambda w: len(w.tasks))
+        if len(victim.tasks) > 0:
+            return victim.tasks.popleft()
+        if len(self.resumed_tests) > 0:
+            test_dir = self.resumed_tests.popleft()
+            self.owners[test_dir] = worker
+            self.push_next_triage_step(test_dir)
+            return worker.tasks.pop()
+        if len(self.prefetched_tests) > 0:
+            test_dir = self.prefetched_tests.popleft()
+            self.adopted_tests += 1
+            self.owners[test_dir] = worker
+            self.start_runs(test_dir)
+            return worker.tasks.pop()
+        return self.new_test_task(worker)
+
+    # Build is admitted, if predicted peak RSS of all running builds fits memory budget. Blaming reserves memory
+    # for all its concurrent probes (see --blame-probes option). Build or blaming is always admitted, if nothing
+    # else is reserved, so testing can't stall. Tasks, which run compilers, aren't admitted, while build, which
+    # was killed for memory, waits for its retry or is retried. Other tasks are always admitted.
+    def admit(self, task):
+        if not task.runs_compiler():
+            return True
+        if len(self.exclusive_tasks) > 0 or any(w.task is not None and w.task.exclusive for w in self.workers):
+            return False
+        if task.kind == Task.KIND_reduce or self.memory is None:
+            return True
+        if task.kind == Task.KIND_build:
+            task.mem_estimate = self.memory.predict(task.args[0].optset, self.tests[task.test_dir].size)
+        else:
+            test, step = task.args
+            task.mem_estimate = blame_opt.blame_probes * \
+                self.memory.predict(test.get_triage_optset(step), self.tests[task.test_dir].size)
+        reserved = sum(w.task.mem_estimate for w in self.workers if w.task is not None)
+        return reserved == 0 or reserved + task.mem_estimate <= self.memory.budget
+
+    def dispatch(self):
+        # Build, which was killed for memory, is retried without other compilers, as soon as running builds and
+        # triage steps are done. Generation and runs don't wait for it.
+        if len(self.exclusive_tasks) > 0 and \
+           not any(w.task is not None and w.task.runs_compiler() for w in self.workers):
+            idle_workers = [w for w in self.workers if w.is_idle()]
+            if len(idle_workers) > 0:
+                idle_workers[0].submit(self.exclusive_tasks.popleft())
+        # Concurrent probes of blaming run on the cores of idle workers, so they are left idle for them
+        refused_tasks = []
+        for worker in self.workers:
+            while worker.is_idle() and self.get_busy_cores() < len(self.workers):
+                task = self.next_task(worker)
+                if task is None:
+                    break
+                if self.admit(task):
+                    if self.owners[task.test_dir] not in (worker, None):
+                        self.stolen_tasks += 1
+                    worker.submit(task)
+                else:
+                    refused_tasks.append(task)
+        # Tasks, which weren't admitted, wait in the deques of their owners, until running builds free the memory
+        for task in refused_tasks:
+            self.push(task)
+        # Backpressure: generator waits, while there are enough prefetched tests
+        if self.gen_worker is not None and self.gen_worker.is_idle() and \
+           len(self.prefetched_tests) < self.prefetch:
+            task = self.new_test_task(None)
+            if task is not None:
+                self.gen_worker.submit(task)
+
+    def push(self, task):
+        self.owners[task.test_dir].tasks.append(task)
+
+    # Number of cores, which are used by the running tasks of workers
+    def get_busy_cores(self):
+        return sum(blame_opt.blame_probes if w.task.kind == Task.KIND_blame else 1
+                   for w in self.workers if w.task is not None)
+
+    def finish_test(self, test_dir):
+        self.commit_updates(test_dir)
+        self.tests.pop(test_dir, None)
+        self.resumed_gen_args.pop(self.test_seeds.pop(test_dir, None), None)
+        self.exe_runs.pop(test_dir, None)
+        del self.owners[test_dir]
+        self.free_test_dirs.append(test_dir)
+
+    # Push build tasks of all opt-sets of generated test
+    def start_runs(self, test_dir):
+        test = self.tests[test_dir]
+        self.unfinished_runs[test_dir] = len(self.targets)
+        self.exe_runs[test_dir] = {}
+        for t in self.targets:
+            test_run = TestRun(test=test, stat=self.stat, target=t, proc_num=test.proc_num,
+                               parse_stats=t.name in self.stat_targets)
+            if self.timeouts is not None:
+                test_run.build_timeout = self.timeouts.get(t.name, CmdRun.USAGE_build, compiler_timeout)
+                test_run.run_timeout = self.timeouts.get(t.name, CmdRun.USAGE_run, run_timeout)
+            self.push(Task(Task.KIND_build, build_task, (test_run,), test_dir, compiler_mem_limit))
+
+    def finish_run(self, test_dir, test_run):
+        test = self.tests[test_dir]
+        if test_run is not None:
+            # Test run was pickled together with its own copy of the test
+            test_run.test = test
+            if test_run.status == TestRun.STATUS_ok:
+                test.add_success_run(test_run)
+            else:
                 test.add_fail_run(test_run)
-                continue
+        self.unfinished_runs[test_dir] -= 1
+        if self.unfinished_runs[test_dir] == 0:
+            del self.unfinished_runs[test_dir]
+            # Done with running tests, now verify the results.
+            test.triage_steps = test.prepare_triage()
+            self.push_next_triage_step(test_dir)
+
+    # Opt-sets often produce byte-identical executables, so only the first of them is run and the rest reuse
+    # its result. exe_runs maps run key of the test to the finished run or to the list of runs, which are waiting
+    # for it.
+    def start_run(self, test_dir, test_run):
+        test_run.test = self.tests[test_dir]
+        runs = self.exe_runs[test_dir]
+        key = test_run.get_run_key()
+        if key is None or key not in runs:
+            if key is not None:
+                runs[key] = []
+            self.push(Task(Task.KIND_run, run_task, (test_run,), test_dir, run_mem_limit))
+        elif isinstance(runs[key], TestRun):
+            test_run.reuse_run(runs[key])
+            self.finish_run(test_dir, test_run)
+        else:
+            runs[key].append(test_run)
 
-            test.add_success_run(test_run)
+    def finish_same_runs(self, test_dir, test_run, failed):
+        runs = self.exe_runs[test_dir]
+        key = test_run.get_run_key()
+        if key is None:
+            return
+        waiting_runs = runs.pop(key, [])
+        if failed:
+            # Nothing to reuse, so waiting runs are executed on their own
+            for waiting_run in waiting_runs:
+                self.push(Task(Task.KIND_run, run_task, (waiting_run,), test_dir, run_mem_limit))
+            return
+        runs[key] = test_run
+        for waiting_run in waiting_runs:
+            waiting_run.reuse_run(test_run)
+            self.finish_run(test_dir, waiting_run)
+
+    def push_next_triage_step(self, test_dir):
+        test = self.tests[test_dir]
+        if len(test.triage_steps) == 0:
+            self.push(Task(Task.KIND_save, save_results_task, (test,), test_dir))
+            return
+        # Step is removed from the list, when it is finished
+        step = test.triage_steps[0]
+        fingerprint = None
+        if self.buckets is not None and step.startswith("reduce") and step not in test.fingerprints:
+            fingerprint = test.get_fingerprint(step)
+        if fingerprint is not None:
+            fingerprint, text = fingerprint
+            if not self.buckets.add(fingerprint):
+                common.log_msg(logging.DEBUG, "Reduction of seed " + test.seed + " is skipped, fingerprint " +
+                               fingerprint + " (" + text + ") has been reduced already")
+                self.skipped_reductions += 1
+                test.duplicates.add(fingerprint)
+                test.triage_steps.pop(0)
+                self.push_next_triage_step(test_dir)
+                return
+        kind = Task.KIND_blame if step.startswith("blame") else Task.KIND_reduce
+        self.push(Task(kind, triage_task, (test, step), test_dir, compiler_mem_limit))
+
+    # Build or run has failed without result (its worker has died, for example). It is rescheduled, and if it
+    # fails again, the opt-set is accounted as failed, so its result is not lost silently.
+    # Returns True, if the task was rescheduled.
+    def retry_lost_task(self, task):
+        test_run = task.args[0]
+        if task.retries < lost_task_retries:
+            retry_task = Task(task.kind, task.func, task.args, task.test_dir, task.mem_limit)
+            retry_task.retries = task.retries + 1
+            retry_task.exclusive = task.exclusive
+            if task.exclusive:
+                self.exclusive_tasks.append(retry_task)
+            else:
+                self.push(retry_task)
+            common.log_msg(logging.DEBUG, "Task " + task.kind + " of " + test_run.optset + " for seed " +
+                           self.tests[task.test_dir].seed + " is rescheduled")
+            return True
+        common.log_msg(logging.ERROR, "Task " + task.kind + " of " + test_run.optset + " for seed " +
+                       self.tests[task.test_dir].seed + " has failed " + str(task.retries + 1) +
+                       " times, opt-set is marked as failed")
+        tag = compfail if task.kind == Task.KIND_build else runfail
+        self.apply_updates(task.test_dir, [("update_target_runs", (test_run.optset, tag))])
+        return False
+
+    def handle_result(self, task, res, err):
+        test_dir = task.test_dir
+        if err is not None:
+            common.log_msg(logging.ERROR, "Task " + task.kind + " in " + test_dir + " has failed: " + str(err))
+            if (task.kind == Task.KIND_build or task.kind == Task.KIND_run) and self.retry_lost_task(task):
+                return
+
+        if task.kind == Task.KIND_gen:
+            if err is not None or not res.is_ok() or len(self.targets) == 0:
+                self.finish_test(test_dir)
+                return
+            self.tests[test_dir] = res
+            if self.owners[test_dir] is None:
+                self.prefetched_tests.append(test_dir)
+            else:
+                self.start_runs(test_dir)
+
+        elif task.kind == Task.KIND_build:
+            if err is None and res.killed_for_memory:
+                self.memory_retries += 1
+                res.exclusive = True
+                retry_task = Task(Task.KIND_build, build_task, (res,), test_dir, compiler_mem_limit)
+                retry_task.exclusive = True
+                self.exclusive_tasks.append(retry_task)
+                return
+            # Usage of build with cache hits is not a measurement
+            if err is None and self.timeouts is not None and not res.build_cache_hit:
+                self.timeouts.add(res.optset, CmdRun.USAGE_build, res.build_usage)
+            if err is None and self.memory is not None and not res.build_cache_hit:
+                self.memory.add(res.optset, self.tests[test_dir].size, res.build_usage)
+            if err is not None:
+                self.finish_run(test_dir, None)
+            elif res.status == TestRun.STATUS_not_run:
+                self.start_run(test_dir, res)
+            else:
+                self.finish_run(test_dir, res)
+
+        elif task.kind == Task.KIND_run:
+            if err is None and self.timeouts is not None:
+                self.timeouts.add(res.optset, CmdRun.USAGE_run, res.run_usage)
+            self.finish_same_runs(test_dir, task.args[0] if err is not None else res, err is not None)
+            self.finish_run(test_dir, res if err is None else None)
+
+        elif task.kind == Task.KIND_blame or task.kind == Task.KIND_reduce:
+            # Triage step has updated its own copy of the test, which replaces ours.
+            if err is None:
+                self.tests[test_dir] = res
+            self.tests[test_dir].triage_steps.pop(0)
+            self.push_next_triage_step(test_dir)
+
+        elif task.kind == Task.KIND_save:
+            self.finish_test(test_dir)
+
+    def update_metrics(self, busy_workers):
+        workers = [w for w in self.workers + [self.gen_worker] if w is not None]
+        metrics.metrics.set("yarpgen_workers", len(workers))
+        metrics.metrics.set("yarpgen_busy_workers", len(busy_workers))
+        metrics.metrics.set("yarpgen_queued_tasks", sum(len(w.tasks) for w in workers))
+        metrics.metrics.set("yarpgen_tests_in_flight", len(self.owners))
+        metrics.metrics.set("yarpgen_prefetched_tests", len(self.prefetched_tests))
+        metrics.metrics.set("yarpgen_reserved_memory_bytes",
+                            sum(w.task.mem_estimate for w in self.workers if w.task is not None) * 1024)
+        metrics.metrics.set("yarpgen_process_rss_bytes", metrics.get_process_rss(os.getpid()), {"process": "main"})
+        metrics.metrics.set("yarpgen_process_rss_bytes", sum(metrics.get_process_rss(w.process.pid) for w in workers),
+                            {"process": "worker"})
+        metrics.metrics.flush()
 
-        # Done with running tests, now verify the results.
-        test.handle_results(lock)
+    def run(self):
+        prev_len = 0
+        stat_time = 0
+        checkpoint_time = time.time()
+        cleanup_time = time.time() - tmp_cleanup_delay
+        while True:
+            self.dispatch()
+            busy_workers = [w for w in self.workers + [self.gen_worker] if w is not None and not w.is_idle()]
+            if len(busy_workers) == 0:
+                break
 
-    # Here we are done with this worker. Make a log entry and leave a marker in work dir.
-    common.log_msg(logging.DEBUG, "Process " + str(num) + " is done working.")
-    seed_file = open("done", "w")
-    seed_file.write("Process " + str(num) + " is done working \n")
-    seed_file.close()
+            if time.time() - stat_time >= stat_update_delay:
+                stat_time = time.time()
+                prev_len = print_online_statistics(self.lock, self.stat, self.targets_str, prev_len,
+                                                   len(busy_workers))
+                # Records of campaign database are committed in batches
+                if campaign_db.db is not None:
+                    campaign_db.db.commit()
+                if metrics.metrics is not None:
+                    self.update_metrics(busy_workers)
+            if time.time() - checkpoint_time >= checkpoint_delay:
+                checkpoint_time = time.time()
+                save_checkpoint(testing_dir, self.get_checkpoint())
+            if (time.time() - cleanup_time) > tmp_cleanup_delay and not self.no_tmp_cln:
+                cleanup_time = time.time()
+                common.run_cmd([os.path.abspath(common.yarpgen_home + os.sep + "tmp_cleaner.sh")])
+
+            ready = multiprocessing.connection.wait([w.conn for w in busy_workers], timeout=stat_update_delay)
+            for worker in busy_workers:
+                if worker.conn in ready:
+                    task, res, err, stat_updates = worker.receive()
+                    self.apply_updates(task.test_dir, stat_updates)
+                    self.handle_result(task, res, err)
+
+        if self.own_workers:
+            stop_workers((self.workers, self.gen_worker))
+        # Testing is finished, so there is nothing to resume
+        remove_checkpoint(testing_dir)
+        common.log_msg(logging.DEBUG, "All tests are done. Number of stolen tasks: " + str(self.stolen_tasks) +
+                                      ", number of prefetched tests: " + str(self.adopted_tests) +
+                                      ", number of builds retried alone after memory kill: " +
+                                      str(self.memory_retries) + ", number of skipped reductions: " +
+                                      str(self.skipped_reductions))
 
 
 # save file_list in [compiler_name]/[fail_type]/[classification]/[test_name]
@@ -1675,33 +3046,422 @@ def gen_and_test(num, makefile, lock, end_time, task_queue, stat, targets, blame
 # - icc/miscompare/S_123456
 # - icc/miscompare/SIMP/S_123456
 # - clang/build_fail/assert_XXXX/S_123456
+# - clang/build_fail/assert_XXXX/dup_0123456789ab/S_123456 (not reduced duplicate, see Test.get_bucket)
 # - gcc/miscompare/S_123456
 # - gen_fail/S_20161230_22_30
+# Files are staged in private directory and the test is published with single atomic rename, so no lock
+# is required and nobody sees partially saved test. If the name is already taken, suffix is added to it.
+# When result store is used, only manifest of the test is saved (see result_store.py).
 # return dir name
-def save_test(lock, file_list, compiler_name=None, fail_type=None, classification=None, test_name=None):
-    dest = ".." + os.sep + res_dir + \
+def save_test(file_list, compiler_name=None, fail_type=None, classification=None, test_name=None,
+              fingerprint=None):
+    dest = os.path.join(testing_dir, res_dir) + \
                   ((os.sep + compiler_name) if (compiler_name is not None) else "") + \
                   ((os.sep + fail_type) if (fail_type is not None) else os.sep + "script_problem") + \
                   ((os.sep + classification) if (classification is not None) else "") + \
                   ((os.sep + test_name) if (test_name is not None) else os.sep + "FAIL_" + datetime.datetime.now().strftime('%Y%m%d_%H%M%S'))
+    dest = os.path.abspath(dest)
+    staging_dir = None
     try:
-        lock.acquire()
-        dest = os.path.abspath(dest)
-        common.check_dir_and_create(dest)
-        for f in file_list:
-            common.check_and_copy(f, dest)
+        # Staging directory should be on the same filesystem as results
+        staging_root = os.path.join(testing_dir, staging_dir_name)
+        os.makedirs(staging_root, exist_ok=True)
+        staging_dir = tempfile.mkdtemp(prefix="save_", dir=staging_root)
+        if result_store.store is not None:
+            result_store.store.save(file_list, staging_dir, dest)
+        else:
+            for f in file_list:
+                common.check_and_copy(f, staging_dir)
+        os.makedirs(os.path.dirname(dest), exist_ok=True)
+        name = dest
+        suffix = 0
+        while True:
+            try:
+                os.rename(staging_dir, name)
+                break
+            except OSError as e:
+                # Linux replaces empty directory, so only non-empty one is a collision
+                if e.errno != errno.EEXIST and e.errno != errno.ENOTEMPTY:
+                    raise
+                suffix += 1
+                name = dest + "_" + str(suffix)
+        staging_dir = None
+        dest = name
+        if process_stat is not None:
+            process_stat.add_db_record("saved_tests", {"seed": test_name[2:] if test_name else None,
+                                                       "compiler": compiler_name, "fail_type": fail_type,
+                                                       "classification": classification,
+                                                       "fingerprint": fingerprint,
+                                                       "path": os.path.relpath(dest, os.path.join(testing_dir,
+                                                                                                  res_dir))})
     except Exception as e:
         common.log_msg(logging.ERROR, "Problem when saving test in " + str(dest) + " directory")
         common.log_msg(logging.ERROR, "Exception type: " + str(type(e)))
         common.log_msg(logging.ERROR, "Exception args: " + str(e.args))
         common.log_msg(logging.ERROR, "Exception: " + str(e))
-
     finally:
-        lock.release()
+        if staging_dir is not None:
+            shutil.rmtree(staging_dir, ignore_errors=True)
 
     return dest
 
 
+###############################################################################
+# Multi-node testing.
+# Coordinator (see --listen option) hands out leases of seeds to agents (see --agent option) over TCP. Agent tests
+# the seeds of its lease with local TestScheduler and sends back updates of statistics, which contain finished
+# seeds, and saved tests with every heartbeat. When agent misses its heartbeats or disconnects, its lease expires
+# and unfinished seeds are queued again. Messages are pickled, so connections are authenticated (see --auth-key).
+
+# Delay (in seconds) between heartbeats of agent and time after the last heartbeat, when lease expires
+heartbeat_delay = 5
+lease_timeout = 60
+# Size of lease per job of agent
+lease_seeds_per_job = 4
+# Maximal number of leases of the seed, which isn't finished by agents
+max_seed_leases = 2
+
+
+def parse_address(address):
+    host, sep, port = address.rpartition(":")
+    if not sep or not port.isdigit():
+        common.print_and_exit("Can't parse address " + address + ", it should be host:port")
+    return host if host else "localhost", int(port)
+
+
+# Statistics of agent. Updates, which are applied by local scheduler, are also kept for the coordinator.
+class AgentStatistics(Statistics):
+    def __init__(self):
+        Statistics.__init__(self)
+        self.forward_lock = threading.Lock()
+        self.forwarded_updates = []
+
+    def apply_updates(self, updates):
+        Statistics.apply_updates(self, updates)
+        with self.forward_lock:
+            self.forwarded_updates += updates
+
+    def take_forwarded_updates(self):
+        with self.forward_lock:
+            updates = self.forwarded_updates
+            self.forwarded_updates = []
+        return updates
+
+    def get_state(self):
+        state = Statistics.get_state(self)
+        del state["forward_lock"]
+        del state["forwarded_updates"]
+        return state
+
+
+class Agent(object):
+    def __init__(self, address, auth_key, num_jobs, stat):
+        self.stat = stat
+        try:
+            self.conn = multiprocessing.connection.Client(address, authkey=auth_key)
+        except (OSError, multiprocessing.AuthenticationError) as e:
+            common.print_and_exit("Can't connect to coordinator " + str(address) + ": " + str(e))
+        # Main thread requests leases, while heartbeat thread reports progress
+        self.send_lock = threading.Lock()
+        self.send(("hello", socket.gethostname(), num_jobs))
+        self.stopped = threading.Event()
+        self.heartbeat_thread = threading.Thread(target=self.heartbeat_loop, daemon=True)
+        self.heartbeat_thread.start()
+
+    def send(self, msg):
+        with self.send_lock:
+            self.conn.send(msg)
+
+    # Updates of statistics and saved tests, which were not sent yet
+    def send_progress(self):
+        updates = self.stat.take_forwarded_updates()
+        saved_tests = []
+        for method_name, args in updates:
+            if method_name == "add_db_record" and args[0] == "saved_tests":
+                test_dir = os.path.join(testing_dir, res_dir, args[1]["path"])
+                files = {}
+                for root, dirs, file_names in os.walk(test_dir):
+                    for name in file_names:
+                        with open(os.path.join(root, name), "rb") as f:
+                            files[os.path.relpath(os.path.join(root, name), test_dir)] = f.read()
+                saved_tests.append((args[1], files))
+        self.send(("progress", updates, saved_tests))
+
+    def heartbeat_loop(self):
+        while not self.stopped.wait(heartbeat_delay):
+            try:
+                with common.fork_lock:
+                    self.send_progress()
+            except OSError as e:
+                common.log_msg(logging.ERROR, "Connection to coordinator is lost: " + str(e))
+                return
+
+    # Returns seeds of the next lease or None if testing is over
+    def get_lease(self):
+        while True:
+            try:
+                self.send_progress()
+                self.send(("request",))
+                msg = self.conn.recv()
+            except (OSError, EOFError) as e:
+                common.log_msg(logging.ERROR, "Connection to coordinator is lost: " + str(e))
+                return None
+            if msg[0] == "lease":
+                common.log_msg(logging.DEBUG, "Got lease of " + str(len(msg[1])) + " seeds")
+                return msg[1]
+            elif msg[0] == "done":
+                return None
+            # Other leases may expire, so we should ask again later
+            time.sleep(heartbeat_delay)
+
+    def close(self):
+        self.stopped.set()
+        self.heartbeat_thread.join()
+        try:
+            self.send_progress()
+            self.send(("bye",))
+            self.conn.close()
+        except OSError:
+            pass
+
+
+class AgentState(object):
+    def __init__(self, agent_id):
+        self.name = "#" + str(agent_id)
+        self.num_jobs = 0
+        # Unfinished seeds of the current lease
+        self.lease = set()
+        self.heartbeat_time = time.time()
+
+
+class Coordinator(object):
+    def __init__(self, address, auth_key, seeds, end_time, stat, targets, seed_stream=None):
+        self.stat = stat
+        self.targets = targets
+        self.end_time = end_time
+        # Specified seeds or None for random ones. Seeds of expired leases are handed out first.
+        self.seeds = collections.deque(seeds) if seeds is not None else None
+        self.requeued_seeds = collections.deque()
+        # Number of leases of requeued seeds
+        self.seed_leases = {}
+        # Random seeds are taken from the stream, if campaign is set
+        self.seed_stream = seed_stream
+        self.random_seeds = set()
+        self.random = random.SystemRandom()
+        self.agents = {}
+        self.agent_num = 0
+        self.lost_leases = 0
+        self.lock = multiprocessing.Lock()
+        try:
+            self.listener = multiprocessing.connection.Listener(address, authkey=auth_key)
+        except OSError as e:
+            common.print_and_exit("Can't listen on " + str(address) + ": " + str(e))
+        common.log_msg(logging.INFO, "Coordinator is listening on " + str(address), forced_duplication=True)
+        # Connections are accepted (and authenticated) by separate thread
+        self.new_conns = []
+        self.new_conns_lock = threading.Lock()
+        threading.Thread(target=self.accept_loop, daemon=True).start()
+
+    def accept_loop(self):
+        while True:
+            try:
+                conn = self.listener.accept()
+            except (OSError, EOFError, multiprocessing.AuthenticationError) as e:
+                common.log_msg(logging.WARNING, "Connection of agent was rejected: " + str(e))
+                continue
+            with self.new_conns_lock:
+                self.new_conns.append(conn)
+
+    def next_seeds(self, num):
+        seeds = []
+        while len(seeds) < num and len(self.requeued_seeds) > 0:
+            seeds.append(self.requeued_seeds.popleft())
+        if self.seeds is not None:
+            while len(seeds) < num and len(self.seeds) > 0:
+                seeds.append(self.seeds.popleft())
+        elif self.end_time == -1 or self.end_time > time.time():
+            while len(seeds) < num and self.seed_stream is not None:
+                seed = self.seed_stream.next()
+                if seed is None:
+                    self.end_time = 0
+                    break
+                seeds.append(seed)
+            while len(seeds) < num and self.seed_stream is None:
+                seed = str(self.random.getrandbits(64))
+                if seed not in self.random_seeds:
+                    self.random_seeds.add(seed)
+                    seeds.append(seed)
+        return seeds
+
+    def has_seeds(self):
+        return len(self.requeued_seeds) > 0 or \
+               (len(self.seeds) > 0 if self.seeds is not None else self.end_time == -1 or self.end_time > time.time())
+
+    def is_finished(self):
+        return not self.has_seeds() and all(len(agent.lease) == 0 for agent in self.agents.values())
+
+    # Unfinished seeds of the lease are queued again. Seed, which may kill the agent or fail with exception every
+    # time, is given up after max_seed_leases leases.
+    def requeue_seeds(self, agent, reason):
+        requeued = []
+        for seed in sorted(agent.lease):
+            self.seed_leases[seed] = self.seed_leases.get(seed, 1) + 1
+            if self.seed_leases[seed] <= max_seed_leases:
+                requeued.append(seed)
+            else:
+                common.log_msg(logging.ERROR, "Seed " + seed + " wasn't finished in " + str(max_seed_leases) +
+                               " leases, it is given up")
+        common.log_msg(logging.WARNING, str(len(agent.lease)) + " seeds are queued again, because " + reason + ": " +
+                       str(requeued))
+        self.requeued_seeds.extend(requeued)
+        agent.lease = set()
+
+    def drop_agent(self, conn, reason):
+        agent = self.agents.pop(conn)
+        if len(agent.lease) > 0:
+            self.requeue_seeds(agent, "lease of agent " + agent.name + " has expired (" + reason + ")")
+            self.lost_leases += 1
+        else:
+            common.log_msg(logging.DEBUG, "Agent " + agent.name + " is gone (" + reason + ")")
+        conn.close()
+
+    # Saved test of agent is published in the same way as our own (see save_test())
+    def save_agent_test(self, record, files):
+        staging_root = os.path.join(testing_dir, staging_dir_name)
+        os.makedirs(staging_root, exist_ok=True)
+        agent_dir = tempfile.mkdtemp(prefix="agent_", dir=staging_root)
+        try:
+            for name, data in files.items():
+                file_name = os.path.join(agent_dir, name)
+                os.makedirs(os.path.dirname(file_name), exist_ok=True)
+                with open(file_name, "wb") as f:
+                    f.write(data)
+            save_test([os.path.join(agent_dir, name) for name in os.listdir(agent_dir)],
+                      compiler_name=record["compiler"],
+                      fail_type=record["fail_type"],
+                      classification=record["classification"],
+                      test_name=os.path.basename(record["path"]))
+        finally:
+            shutil.rmtree(agent_dir, ignore_errors=True)
+
+    def handle_message(self, conn, msg):
+        agent = self.agents[conn]
+        agent.heartbeat_time = time.time()
+        if msg[0] == "hello":
+            agent.name, agent.num_jobs = msg[1] + agent.name, msg[2]
+            common.log_msg(logging.INFO, "Agent " + agent.name + " with " + str(agent.num_jobs) + " jobs is connected")
+        elif msg[0] == "progress":
+            updates, saved_tests = msg[1], msg[2]
+            # Saved tests are recorded again, when they are saved here
+            self.stat.apply_updates([u for u in updates if u[0] != "add_db_record" or u[1][0] != "saved_tests"])
+            for method_name, args in updates:
+                if method_name == "seed_passed" or method_name == "seed_failed":
+                    agent.lease.discard(args[0])
+            for record, files in saved_tests:
+                self.save_agent_test(record, files)
+        elif msg[0] == "request":
+            if len(agent.lease) > 0:
+                self.requeue_seeds(agent, "they weren't finished by agent " + agent.name)
+            seeds = self.next_seeds(agent.num_jobs * lease_seeds_per_job)
+            if len(seeds) > 0:
+                agent.lease = set(seeds)
+                conn.send(("lease", seeds))
+            elif self.is_finished():
+                conn.send(("done",))
+            else:
+                conn.send(("wait",))
+        elif msg[0] == "bye":
+            self.drop_agent(conn, "finished")
+
+    def run(self):
+        prev_len = 0
+        stat_time = 0
+        metrics.start_server()
+        while True:
+            with self.new_conns_lock:
+                for conn in self.new_conns:
+                    self.agents[conn] = AgentState(self.agent_num)
+                    self.agent_num += 1
+                self.new_conns = []
+            for conn, agent in list(self.agents.items()):
+                if time.time() - agent.heartbeat_time > lease_timeout:
+                    self.drop_agent(conn, "no heartbeat")
+            if self.is_finished():
+                break
+
+            if time.time() - stat_time >= stat_update_delay:
+                stat_time = time.time()
+                prev_len = print_online_statistics(self.lock, self.stat, self.targets, prev_len, len(self.agents))
+                if campaign_db.db is not None:
+                    campaign_db.db.commit()
+                if metrics.metrics is not None:
+                    metrics.metrics.set("yarpgen_workers", len(self.agents))
+                    metrics.metrics.set("yarpgen_busy_workers",
+                                        sum(1 for agent in self.agents.values() if len(agent.lease) > 0))
+                    metrics.metrics.set("yarpgen_queued_seeds", len(self.requeued_seeds))
+                    metrics.metrics.flush()
+
+            ready = multiprocessing.connection.wait(list(self.agents), timeout=1)
+            for conn in ready:
+                try:
+                    msg = conn.recv()
+                except (OSError, EOFError):
+                    self.drop_agent(conn, "disconnected")
+                    continue
+                self.handle_message(conn, msg)
+
+        # Agents, which are waiting for the next lease, are released
+        for conn in list(self.agents):
+            try:
+                conn.send(("done",))
+            except OSError:
+                pass
+            self.drop_agent(conn, "testing is over")
+        self.listener.close()
+        common.log_msg(logging.DEBUG, "All tests are done. Number of lost leases: " + str(self.lost_leases))
+
+
+def prepare_env_and_coordinate(out_dir, timeout, targets, config_file, seeds_option_value, address, auth_key,
+                               seed_stream=None):
+    gen_test_makefile.check_if_std_defined()
+    common.check_dir_and_create(out_dir)
+    # Makefile isn't used, but testing sets are parsed from config file by its generation
+    gen_test_makefile.gen_makefile(
+        out_file_name = os.path.join(out_dir, gen_test_makefile.Test_Makefile_name),
+        force = True,
+        config_file = config_file)
+    dump_testing_sets(targets)
+    seeds = proccess_seeds(seeds_option_value) if seeds_option_value else None
+
+    os.chdir(out_dir)
+    global testing_dir
+    testing_dir = out_dir
+    common.check_dir_and_create(res_dir)
+
+    global process_stat
+    process_stat = Statistics()
+    stat = process_stat
+    if seeds_option_value:
+        stat.enable_seeds()
+
+    end_time = -1 if timeout == -1 else time.time() + timeout * 60
+    coordinator = Coordinator(address, auth_key, seeds, end_time, stat, targets, seed_stream)
+    coordinator.run()
+
+    sys.stdout.write("\n")
+    shutil.rmtree(os.path.join(testing_dir, staging_dir_name), ignore_errors=True)
+    if campaign_db.db is not None:
+        campaign_db.db.close()
+    if metrics.metrics is not None:
+        metrics.metrics.close()
+    if seed_stream is not None:
+        common.log_msg(logging.INFO, "Tested seeds of " + seed_stream.get_coverage_str(), forced_duplication=True)
+
+    stat_str, verbose_stat_str, prev_len = form_statistics(stat, targets, 0)
+    sys.stdout.write(verbose_stat_str)
+    sys.stdout.flush()
+
+
 ###############################################################################
 
 
@@ -1754,15 +3514,96 @@ Use specified folder for testing
                              "Seeds may be separated by whitespaces and commas."\
                              "The seed may start with S_ or end with /, i.e. S_12345/ is interpretted as 12345."
                              "File comments may start with #")
+    parser.add_argument("--campaign", dest="campaign", default=None, type=int,
+                        help="Take seeds from sharded seed space of campaign (1-" + str((1 << common.campaign_bits) - 1) +
+                             ") instead of random ones. Seeds are determined by campaign, shard and counter, so runs "
+                             "on different hosts with different shards never collide and the campaign can be replayed")
+    parser.add_argument("--shard", dest="shard", default=0, type=int,
+                        help="Shard of campaign (0-" + str((1 << common.shard_bits) - 1) + "), which is tested by this run")
+    parser.add_argument("--seed-counter", dest="seed_counter", default=0, type=int,
+                        help="Counter of the first seed in the shard")
+    parser.add_argument("--prefetch", dest="prefetch", default=2, type=int,
+                        help="Number of seeds, which are generated ahead of compilation by one extra process. "
+                             "Every prefetched seed occupies its own test directory. 0 disables prefetch")
     parser.add_argument("--blame", dest="blame", default=False, action="store_true",
                         help="Enable optimization triagging for failing tests for supported compilers")
+    parser.add_argument("--blame-probes", dest="blame_probes", default=3, type=int,
+                        help="Number of concurrent builds of blaming. They speculatively probe the next steps of "
+                             "binary search of the failing optimization, so 2^d-1 probes make d steps at once. "
+                             "Blaming reserves memory budget (see --mem-budget) for all of them")
     parser.add_argument("--creduce", dest="creduce", nargs='?', const=4, type=int, default=False,
                         help="Enable test reduction using CReduce tool. When given a number, "
                              "it's used as a number of creduce processes run for a single reduction (default is 4)")
+    parser.add_argument("--ir-reduce", dest="ir_reduce", default=False, action="store_true",
+                        help="Reduce IR of the test by generator (see --reduce option of yarpgen) before creduce. "
+                             "It knows structure and values of the test, so creduce gets far smaller test. "
+                             "Time limit of IR reduction is " + str(ir_reduce_timeout) + " s")
+    parser.add_argument("--reduce-per-fingerprint", dest="reduce_per_fingerprint", default=None, type=int,
+                        help="Number of reduced failures per fingerprint (type of failure, blamed phase, compiler "
+                             "message, failing opt-sets and rare IR features of the test). Other failures with "
+                             "the same fingerprint are saved without reduction to dup_<fingerprint> directory. "
+                             "Runfails and miscompares are bucketed only with blamed phase (see --blame). "
+                             "0 means no limit. Default is " + str(default_reduce_per_fingerprint))
     parser.add_argument("--no-tmp-cleaner", dest="no_tmp_cleaner", default=False, action="store_true",
                         help="Do not run tmp_cleaner.sh script during the run")
     parser.add_argument("--collect-stat", dest="collect_stat", default="", type=str,
                         help="List of testing sets for statistics collection")
+    parser.add_argument("--cost-data", dest="cost_data", default=None, type=str,
+                        help="Append timing data for compilation cost model calibration (see cost_model.py) "
+                             "to specified file")
+    parser.add_argument("--cost-model", dest="cost_model", default=None, type=str,
+                        help="Compilation cost model file, which is passed to generator (see cost_model.py)")
+    parser.add_argument("--target-compile-ms", dest="target_compile_ms", default=None, type=int,
+                        help="Requested compilation time of generated tests in ms (requires --cost-model)")
+    parser.add_argument("--build-cache", dest="build_cache", default=None, type=str,
+                        help="Directory of compiled objects and executables cache (see build_cache.py). "
+                             "It may be shared by several runs")
+    parser.add_argument("--build-cache-size", dest="build_cache_size", default=10240, type=int,
+                        help="Size cap (in MB) of build cache. Least recently used entries are removed, "
+                             "when it is exceeded. 0 means no limit")
+    parser.add_argument("--scratch-dir", dest="scratch_dir", default=None, type=str,
+                        help="Directory for test directories of workers, for example, /dev/shm or tmpfs mount point. "
+                             "Only saved tests are copied to output directory")
+    parser.add_argument("--scratch-size", dest="scratch_size", default=4096, type=int,
+                        help="Size cap (in MB) of test directories in scratch directory. New seeds are not started, "
+                             "while it is exceeded. 0 means no limit")
+    parser.add_argument("--result-store", dest="result_store", nargs='?', const="", default=None, type=str,
+                        help="Save failed tests to compressed content-addressed store (see result_store.py). "
+                             "By default, store is placed in output directory, but it may be shared by several runs")
+    parser.add_argument("--campaign-db", dest="campaign_db", default=None, type=str,
+                        help="SQLite database of seeds, runs and saved tests (see campaign_db.py). By default, it is "
+                             "output directory + /" + campaign_db.default_db_file_name + ". It may be shared by several runs")
+    parser.add_argument("--adaptive-timeouts", dest="adaptive_timeouts", default=False, action="store_true",
+                        help="Timeout of build and run of every testing set is " + str(adaptive_timeout_factor) +
+                             " times " + str(adaptive_timeout_quantile) + " quantile of its last " +
+                             str(adaptive_timeout_window) + " builds or runs (but not less than " +
+                             str(adaptive_timeout_min) + " s). Default timeouts (" + str(compiler_timeout) + " s and " +
+                             str(run_timeout) + " s) are upper bounds: build or run, which exceeds adaptive "
+                             "timeout, is retried once with " + str(adaptive_timeout_retry_factor) +
+                             " times longer timeout")
+    parser.add_argument("--mem-budget", dest="mem_budget", default=None, type=int,
+                        help="Memory (in MB), which may be used by concurrent compilers. Builds are started only if "
+                             "their predicted peak RSS fits it. By default, it is 80%% of physical memory. 0 disables "
+                             "the limit")
+    parser.add_argument("--metrics-port", dest="metrics_port", default=None, type=int,
+                        help="Serve live metrics of testing in Prometheus format on http://localhost:PORT/metrics "
+                             "(see metrics.py)")
+    parser.add_argument("--metrics-file", dest="metrics_file", default=None, type=str,
+                        help="Write live metrics of testing in Prometheus format to the file every " +
+                             str(stat_update_delay) + " seconds (for textfile collector of node exporter)")
+    parser.add_argument("--resume", dest="resume", default=False, action="store_true",
+                        help="Resume interrupted testing in output directory from its checkpoint, which is written "
+                             "every " + str(checkpoint_delay) + " seconds. Seeds and time limit are taken from "
+                             "the checkpoint, other options should be the same as in interrupted run")
+    parser.add_argument("--listen", dest="listen", default=None, type=str,
+                        help="Run as coordinator of multi-node testing on host:port. Seeds are tested by agents, "
+                             "while statistics and saved tests are collected here")
+    parser.add_argument("--agent", dest="agent", default=None, type=str,
+                        help="Run as agent of coordinator on host:port. Seeds and time limit are given by "
+                             "coordinator, testing options should be the same")
+    parser.add_argument("--auth-key", dest="auth_key", default=os.environ.get("YARPGEN_AUTH_KEY"), type=str,
+                        help="Key for authentication of coordinator and agents. By default, it is taken from "
+                             "YARPGEN_AUTH_KEY environment variable")
     parser.add_argument("--ignore-comp-time-exp", dest="ignore_comp_time_exp", default=True, action="store_true",
                         help="Don't save files (except log-file) when compile time expires")
     args = parser.parse_args()
@@ -1785,6 +3626,59 @@ Use specified folder for testing
         creduce_n = args.creduce
     gen_test_makefile.set_standard(args.std_str)
     Test.ignore_comp_time_exp = args.ignore_comp_time_exp
-    prepare_env_and_start_testing(os.path.abspath(args.out_dir), args.timeout, args.target, args.num_jobs,
-                                  args.config_file, args.seeds_option_value, args.blame, args.creduce,
-                                  args.no_tmp_cleaner, args.collect_stat)
+    if args.target_compile_ms and not args.cost_model:
+        common.print_and_exit("--target-compile-ms requires --cost-model")
+    if args.cost_data:
+        Test.cost_data_file = os.path.abspath(args.cost_data)
+    if args.cost_model:
+        Test.cost_model_file = os.path.abspath(args.cost_model)
+    Test.target_compile_ms = args.target_compile_ms
+    if args.reduce_per_fingerprint is None:
+        args.reduce_per_fingerprint = default_reduce_per_fingerprint
+    Test.reduce_per_fingerprint = max(args.reduce_per_fingerprint, 0) if args.creduce else 0
+    Test.ir_reduce = bool(args.creduce) and args.ir_reduce
+    blame_opt.blame_probes = max(args.blame_probes, 1)
+    build_cache.setup_cache(args.build_cache, args.build_cache_size * 1024 * 1024 if args.build_cache_size else None)
+    if args.listen and args.agent:
+        common.print_and_exit("Process can't be coordinator and agent at the same time")
+    if (args.listen or args.agent) and not args.auth_key:
+        common.print_and_exit("Multi-node testing requires --auth-key")
+    if (args.listen or args.agent) and args.resume:
+        common.print_and_exit("Multi-node testing can't be resumed, coordinator queues lost seeds again by itself")
+    # Agent sends saved tests and database records to coordinator
+    if args.agent and (args.result_store is not None or args.campaign_db or args.seeds_option_value):
+        common.print_and_exit("Result store, campaign database and seeds are set up by coordinator, not agent")
+    if args.mem_budget is None:
+        mem_budget = os.sysconf("SC_PAGE_SIZE") * os.sysconf("SC_PHYS_PAGES") // 1024 * 4 // 5
+    else:
+        mem_budget = args.mem_budget * 1024
+    seed_stream = None
+    if args.campaign is not None:
+        if args.seeds_option_value or args.agent:
+            common.print_and_exit("--campaign can't be used with --seeds or --agent")
+        if not 0 < args.campaign < (1 << common.campaign_bits) or not 0 <= args.shard < (1 << common.shard_bits) or \
+           not 0 <= args.seed_counter < (1 << common.counter_bits):
+            common.print_and_exit("Campaign, shard or seed counter is out of range")
+        campaign_id = args.campaign
+        seed_stream = ShardSeedStream(args.campaign, args.shard, args.seed_counter)
+    elif args.shard != 0 or args.seed_counter != 0:
+        common.print_and_exit("--shard and --seed-counter require --campaign")
+    common.check_dir_and_create(args.out_dir)
+    if not args.agent:
+        campaign_db.setup_db(args.campaign_db or os.path.join(args.out_dir, campaign_db.default_db_file_name),
+                             os.path.abspath(args.out_dir), " ".join(str(p) for p in sys.argv))
+    metrics.setup_metrics(args.metrics_port, args.metrics_file)
+    if args.result_store is not None:
+        result_store.setup_store(args.result_store or os.path.join(args.out_dir, result_store.blobs_dir_name))
+    if args.listen:
+        prepare_env_and_coordinate(os.path.abspath(args.out_dir), args.timeout, args.target, args.config_file,
+                                   args.seeds_option_value, parse_address(args.listen), args.auth_key.encode(),
+                                   seed_stream)
+    else:
+        prepare_env_and_start_testing(os.path.abspath(args.out_dir), args.timeout, args.target, args.num_jobs,
+                                      args.config_file, args.seeds_option_value, args.blame, args.creduce,
+                                      args.no_tmp_cleaner, args.collect_stat, max(args.prefetch, 0),
+                                      args.scratch_dir and os.path.abspath(args.scratch_dir), args.scratch_size,
+                                      args.resume, args.agent and parse_address(args.agent),
+                                      args.auth_key and args.auth_key.encode(), seed_stream, args.adaptive_timeouts,
+                                      mem_budget)
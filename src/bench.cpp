@@ -0,0 +1,503 @@
+/*
+Copyright (c) 2018, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Benchmark driver for the generator itself. It measures hot library
+// functions in isolation (micro benchmarks) and whole-program generation over
+// fixed sets of seeds with several generation presets (macro benchmarks).
+// Results are printed in JSON format, so they can be compared between
+// revisions.
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "expr.h"
+#include "gen_policy.h"
+#include "options.h"
+#include "program.h"
+#include "stmt.h"
+#include "sym_table.h"
+#include "type.h"
+#include "variable.h"
+
+#ifndef BUILD_VERSION
+#define BUILD_VERSION ""
+#endif
+
+using namespace yarpgen;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Metrics = std::vector<std::pair<std::string, double>>;
+
+// Number of scalar variables in each extern symbol table of micro benchmarks'
+// context
+const uint32_t FIXTURE_VAR_COUNT = 20;
+
+struct BenchOptions {
+  uint64_t first_seed = 1;
+  uint64_t seed_count = 20;
+  // Scale of micro benchmarks (number of the cheapest operations)
+  uint64_t iters = 1000000;
+  std::string filter;
+  std::string out_file;
+  std::string out_dir = ".";
+};
+
+double elapsed_sec(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double per_sec(double count, double sec) { return sec > 0 ? count / sec : 0; }
+
+// Peak resident set size of the process in kilobytes (0 if unsupported).
+// It is a high-water mark, so it never decreases between benchmarks.
+uint64_t get_peak_rss_kb() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+uint64_t get_file_size(std::string file_name) {
+  std::ifstream file(file_name, std::ifstream::ate | std::ifstream::binary);
+  return file.is_open() ? static_cast<uint64_t>(file.tellg()) : 0;
+}
+
+// Prepares generator for a new test. RandValGen reports its seed to
+// std::cout, which is reserved for results, so the report is swallowed.
+void start_test(uint64_t seed) {
+  Program::reset_gen_state();
+  std::ostringstream sink;
+  std::streambuf *cout_buf = std::cout.rdbuf(sink.rdbuf());
+  rand_val_gen = std::make_shared<RandValGen>(RandValGen(seed));
+  std::cout.rdbuf(cout_buf);
+  default_gen_policy.init_from_config();
+}
+
+// Creates context of test function with extern symbol tables filled with
+// scalar variables only (see Program::form_extern_sym_table for the real one)
+std::shared_ptr<Context> create_fixture_ctx() {
+  Context ctx(default_gen_policy, nullptr, Node::NodeID::MAX_STMT_ID, true);
+  ctx.set_extern_inp_sym_table(std::make_shared<SymbolTable>());
+  ctx.set_extern_mix_sym_table(std::make_shared<SymbolTable>());
+  ctx.set_extern_out_sym_table(std::make_shared<SymbolTable>());
+  std::shared_ptr<Context> ctx_ptr = std::make_shared<Context>(ctx);
+
+  std::shared_ptr<Context> const_ctx = std::make_shared<Context>(ctx);
+  GenPolicy const_gen_policy = default_gen_policy;
+  const_gen_policy.set_allow_const(true);
+  const_ctx->set_gen_policy(const_gen_policy);
+
+  for (uint32_t i = 0; i < FIXTURE_VAR_COUNT; ++i) {
+    ctx_ptr->get_extern_inp_sym_table()->add_variable(
+        ScalarVariable::generate(const_ctx));
+    ctx_ptr->get_extern_mix_sym_table()->add_variable(
+        ScalarVariable::generate(ctx_ptr));
+    ctx_ptr->get_extern_out_sym_table()->add_variable(
+        ScalarVariable::generate(ctx_ptr));
+  }
+  return ctx_ptr;
+}
+
+// Micro benchmarks are not limited by budgets, because they generate
+// many independent pieces of IR
+void disable_budgets() {
+  options->gen_time_limit = 0;
+  options->max_node_count = 0;
+  options->max_out_size = 0;
+  options->max_test_complexity = 0;
+}
+
+void zero_out_stmt_and_expr_counts() {
+  Stmt::zero_out_total_stmt_count();
+  Stmt::zero_out_func_stmt_count();
+  Expr::zero_out_total_expr_count();
+  Expr::zero_out_func_expr_count();
+}
+
+Metrics bench_rand_id(const BenchOptions &bench_options) {
+  start_test(bench_options.first_seed);
+  auto &arith_leaves = default_gen_policy.get_arith_leaves();
+  uint64_t checksum = 0;
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < bench_options.iters; ++i)
+    checksum += rand_val_gen->get_rand_id(arith_leaves);
+  double sec = elapsed_sec(start);
+  return {{"iterations", bench_options.iters},
+          {"time_s", sec},
+          {"ops_per_s", per_sec(bench_options.iters, sec)},
+          {"checksum", checksum}};
+}
+
+Metrics bench_scalar_typed_val_ops(const BenchOptions &bench_options) {
+  using ScalarTypedVal = BuiltinType::ScalarTypedVal;
+  start_test(bench_options.first_seed);
+  std::shared_ptr<Context> ctx = create_fixture_ctx();
+
+  // Operands are generated in advance, so only operators are measured
+  const uint32_t VAL_COUNT = 1024;
+  const std::vector<Type::IntegerTypeID> type_ids = {
+      Type::IntegerTypeID::INT, Type::IntegerTypeID::UINT,
+      Type::IntegerTypeID::LLINT, Type::IntegerTypeID::ULLINT};
+  std::vector<ScalarTypedVal> vals;
+  for (uint32_t i = 0; i < VAL_COUNT; ++i)
+    vals.push_back(ScalarTypedVal::generate(ctx, type_ids.at(i % type_ids.size())));
+
+  const std::vector<std::function<ScalarTypedVal(ScalarTypedVal, ScalarTypedVal)>> ops = {
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a + b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a - b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a * b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a / b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a % b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a << b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a >> b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a & b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a | b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a ^ b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a < b; },
+      [](ScalarTypedVal a, ScalarTypedVal b) { return a == b; }};
+
+  uint64_t checksum = 0;
+  uint64_t ub_count = 0;
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < bench_options.iters; ++i) {
+    // Operands of the same type are required
+    ScalarTypedVal &lhs = vals.at(i % VAL_COUNT);
+    ScalarTypedVal &rhs = vals.at((i + 7 * type_ids.size()) % VAL_COUNT);
+    ScalarTypedVal res = ops.at(i % ops.size())(lhs, rhs);
+    if (res.has_ub())
+      ub_count++;
+    else
+      checksum += res.get_abs_val();
+  }
+  double sec = elapsed_sec(start);
+  return {{"iterations", bench_options.iters},
+          {"time_s", sec},
+          {"ops_per_s", per_sec(bench_options.iters, sec)},
+          {"ub_ratio", static_cast<double>(ub_count) / bench_options.iters},
+          {"checksum", checksum}};
+}
+
+Metrics bench_arith_expr_generate(const BenchOptions &bench_options) {
+  disable_budgets();
+  start_test(bench_options.first_seed);
+  std::shared_ptr<Context> ctx = create_fixture_ctx();
+  std::vector<std::shared_ptr<Expr>> inp =
+      ctx->get_extern_inp_sym_table()->get_all_var_use_exprs();
+  std::vector<std::shared_ptr<Expr>> mix =
+      ctx->get_extern_mix_sym_table()->get_all_var_use_exprs();
+  inp.insert(inp.end(), mix.begin(), mix.end());
+
+  uint64_t count = bench_options.iters / 1000;
+  uint64_t start_nodes = GenPolicy::get_node_count();
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < count; ++i)
+    ArithExpr::generate(ctx, inp);
+  double sec = elapsed_sec(start);
+  uint64_t nodes = GenPolicy::get_node_count() - start_nodes;
+  return {{"iterations", count},
+          {"time_s", sec},
+          {"exprs_per_s", per_sec(count, sec)},
+          {"nodes_per_s", per_sec(nodes, sec)}};
+}
+
+// Scopes are generated once and reused by emission benchmark
+std::vector<std::shared_ptr<ScopeStmt>> generate_scopes(uint64_t count,
+                                                        uint64_t &nodes,
+                                                        double &sec) {
+  std::shared_ptr<Context> ctx = create_fixture_ctx();
+  std::vector<std::shared_ptr<ScopeStmt>> scopes;
+  uint64_t start_nodes = GenPolicy::get_node_count();
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < count; ++i) {
+    // Statement limits are per test, so every scope is generated as the
+    // first one
+    zero_out_stmt_and_expr_counts();
+    scopes.push_back(ScopeStmt::generate(ctx));
+  }
+  sec = elapsed_sec(start);
+  nodes = GenPolicy::get_node_count() - start_nodes;
+  return scopes;
+}
+
+Metrics bench_scope_stmt_generate(const BenchOptions &bench_options) {
+  disable_budgets();
+  start_test(bench_options.first_seed);
+  uint64_t count = bench_options.iters / 10000;
+  uint64_t nodes = 0;
+  double sec = 0;
+  generate_scopes(count, nodes, sec);
+  return {{"iterations", count},
+          {"time_s", sec},
+          {"scopes_per_s", per_sec(count, sec)},
+          {"nodes_per_s", per_sec(nodes, sec)}};
+}
+
+Metrics bench_scope_stmt_emit(const BenchOptions &bench_options) {
+  disable_budgets();
+  start_test(bench_options.first_seed);
+  uint64_t nodes = 0;
+  double gen_sec = 0;
+  std::vector<std::shared_ptr<ScopeStmt>> scopes =
+      generate_scopes(bench_options.iters / 100000 + 1, nodes, gen_sec);
+
+  const uint32_t REPEAT_COUNT = 10;
+  uint64_t bytes = 0;
+  Clock::time_point start = Clock::now();
+  for (uint32_t i = 0; i < REPEAT_COUNT; ++i) {
+    for (auto &scope : scopes) {
+      std::ostringstream stream;
+      scope->emit(stream);
+      bytes += stream.tellp();
+    }
+  }
+  double sec = elapsed_sec(start);
+  return {{"iterations", REPEAT_COUNT * scopes.size()},
+          {"time_s", sec},
+          {"nodes_per_s", per_sec(REPEAT_COUNT * nodes, sec)},
+          {"bytes_per_s", per_sec(bytes, sec)}};
+}
+
+// Generation preset of macro benchmark. Options are applied before
+// initialization of default GenPolicy, policy adjustment - after it.
+struct Preset {
+  std::string name;
+  std::function<void()> set_options;
+  std::function<void(GenPolicy &)> adjust_policy;
+};
+
+const std::vector<Preset> presets = {
+    {"defaults", []() {}, [](GenPolicy &) {}},
+    {"deep_expressions", []() { options->max_arith_depth = 8; },
+     [](GenPolicy &) {}},
+    {"many_structs",
+     []() {
+       options->min_struct_type_count = 6;
+       options->max_struct_type_count = 12;
+       options->min_inp_struct_count = options->min_mix_struct_count =
+           options->min_out_struct_count = 8;
+       options->max_inp_struct_count = options->max_mix_struct_count =
+           options->max_out_struct_count = 16;
+     },
+     [](GenPolicy &) {}},
+    {"many_pointers", []() {},
+     [](GenPolicy &gen_policy) {
+       gen_policy.set_min_inp_ptr_count(20);
+       gen_policy.set_max_inp_ptr_count(40);
+       gen_policy.set_min_mix_ptr_count(20);
+       gen_policy.set_max_mix_ptr_count(40);
+       gen_policy.set_min_out_ptr_count(20);
+       gen_policy.set_max_out_ptr_count(40);
+     }}};
+
+Metrics bench_program(const BenchOptions &bench_options, const Preset &preset) {
+  double gen_sec = 0;
+  double emit_sec = 0;
+  uint64_t nodes = 0;
+  uint64_t bytes = 0;
+  uint64_t budget_exceeded = 0;
+  std::string out_file = bench_options.out_dir + "/single.c";
+
+  for (uint64_t i = 0; i < bench_options.seed_count; ++i) {
+    *options = Options();
+    preset.set_options();
+    start_test(bench_options.first_seed + i);
+    preset.adjust_policy(default_gen_policy);
+
+    Clock::time_point start = Clock::now();
+    Program program(bench_options.out_dir);
+    program.generate();
+    gen_sec += elapsed_sec(start);
+
+    start = Clock::now();
+    program.emit_decl();
+    program.emit_func();
+    program.emit_main();
+    emit_sec += elapsed_sec(start);
+
+    nodes += GenPolicy::get_node_count();
+    bytes += get_file_size(out_file);
+    if (GenPolicy::is_budget_exceeded())
+      budget_exceeded++;
+  }
+
+  double sec = gen_sec + emit_sec;
+  return {{"seeds", bench_options.seed_count},
+          {"time_s", sec},
+          {"gen_time_s", gen_sec},
+          {"emit_time_s", emit_sec},
+          {"seeds_per_s", per_sec(bench_options.seed_count, sec)},
+          {"nodes_per_s", per_sec(nodes, sec)},
+          {"bytes_per_s", per_sec(bytes, sec)},
+          {"avg_nodes", static_cast<double>(nodes) / bench_options.seed_count},
+          {"avg_bytes", static_cast<double>(bytes) / bench_options.seed_count},
+          {"budget_exceeded", budget_exceeded},
+          {"peak_rss_kb", get_peak_rss_kb()}};
+}
+
+void print_usage_and_exit(std::string error_msg = "") {
+  int exit_code = 0;
+  if (error_msg != "") {
+    std::cerr << error_msg << std::endl;
+    exit_code = -1;
+  }
+  std::cout << "Usage: yarpgen-bench [options]\n";
+  std::cout << "\t-h, --help                Display this message\n";
+  std::cout << "\t--seeds=<N>               Number of seeds per preset of "
+               "macro benchmarks (default 20)\n";
+  std::cout << "\t--first-seed=<N>          First seed of the seed set "
+               "(default 1)\n";
+  std::cout << "\t--iters=<N>               Scale of micro benchmarks "
+               "(default 1000000)\n";
+  std::cout << "\t--filter=<str>            Run only benchmarks, whose name "
+               "contains <str>\n";
+  std::cout << "\t-o, --output=<file>       Write results to <file> instead "
+               "of stdout\n";
+  std::cout << "\t-d, --out-dir=<dir>       Output directory for generated "
+               "tests (default .)\n";
+  exit(exit_code);
+}
+
+bool parse_arg(const char *arg, std::string name, std::string &value) {
+  std::string prefix = name + "=";
+  if (strncmp(arg, prefix.c_str(), prefix.size()) != 0)
+    return false;
+  value = arg + prefix.size();
+  if (value.empty())
+    print_usage_and_exit("Empty value of " + name);
+  return true;
+}
+
+uint64_t to_uint(std::string name, std::string value) {
+  try {
+    return std::stoull(value);
+  } catch (std::exception &e) {
+    print_usage_and_exit("Can't recognize value of " + name + ": " + value);
+  }
+  return 0;
+}
+
+BenchOptions parse_args(int argc, char *argv[]) {
+  BenchOptions bench_options;
+  for (int i = 1; i < argc; ++i) {
+    std::string value;
+    if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+      print_usage_and_exit();
+    else if (parse_arg(argv[i], "--seeds", value))
+      bench_options.seed_count = to_uint("--seeds", value);
+    else if (parse_arg(argv[i], "--first-seed", value))
+      bench_options.first_seed = to_uint("--first-seed", value);
+    else if (parse_arg(argv[i], "--iters", value))
+      bench_options.iters = to_uint("--iters", value);
+    else if (parse_arg(argv[i], "--filter", value))
+      bench_options.filter = value;
+    else if (parse_arg(argv[i], "--output", value))
+      bench_options.out_file = value;
+    else if (parse_arg(argv[i], "--out-dir", value))
+      bench_options.out_dir = value;
+    else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "-d")) &&
+             i + 1 < argc) {
+      (argv[i][1] == 'o' ? bench_options.out_file : bench_options.out_dir) =
+          argv[i + 1];
+      ++i;
+    } else
+      print_usage_and_exit("Unknown option: " + std::string(argv[i]));
+  }
+  if (bench_options.seed_count == 0 || bench_options.first_seed == 0)
+    print_usage_and_exit("Seeds should be positive");
+  return bench_options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  options = new Options;
+  BenchOptions bench_options = parse_args(argc, argv);
+
+  std::vector<std::pair<std::string, std::function<Metrics()>>> benchmarks = {
+      {"micro/rand_id", [&]() { return bench_rand_id(bench_options); }},
+      {"micro/scalar_typed_val_ops",
+       [&]() { return bench_scalar_typed_val_ops(bench_options); }},
+      {"micro/arith_expr_generate",
+       [&]() { return bench_arith_expr_generate(bench_options); }},
+      {"micro/scope_stmt_generate",
+       [&]() { return bench_scope_stmt_generate(bench_options); }},
+      {"micro/scope_stmt_emit",
+       [&]() { return bench_scope_stmt_emit(bench_options); }}};
+  for (const auto &preset : presets)
+    benchmarks.push_back({"macro/" + preset.name, [&]() {
+                            return bench_program(bench_options, preset);
+                          }});
+
+  std::ostringstream json;
+  json.precision(10);
+  json << "{\n  \"yarpgen_version\": \"" << options->yarpgen_version
+       << "\",\n  \"build\": \"" << BUILD_VERSION
+       << "\",\n  \"benchmarks\": [";
+  bool first = true;
+  for (auto &benchmark : benchmarks) {
+    if (benchmark.first.find(bench_options.filter) == std::string::npos)
+      continue;
+    std::cerr << "Running " << benchmark.first << std::endl;
+    *options = Options();
+    Metrics metrics = benchmark.second();
+    json << (first ? "\n" : ",\n") << "    {\"name\": \"" << benchmark.first
+         << "\"";
+    for (auto &metric : metrics)
+      json << ", \"" << metric.first << "\": " << metric.second;
+    json << "}";
+    first = false;
+  }
+  json << "\n  ],\n  \"peak_rss_kb\": " << get_peak_rss_kb() << "\n}\n";
+
+  if (bench_options.out_file.empty())
+    std::cout << json.str();
+  else {
+    std::ofstream out_file(bench_options.out_file);
+    if (!out_file.is_open()) {
+      std::cerr << "Can't open output file " << bench_options.out_file
+                << std::endl;
+      return -1;
+    }
+    out_file << json.str();
+  }
+
+  delete (options);
+  return 0;
+}
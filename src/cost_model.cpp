@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "cost_model.h"
+#include "util.h"
+
+using namespace yarpgen;
+
+CompileCostModel::CompileCostModel () : loaded(false), intercept(0), cost(0), func_start_cost(0), func_node_count(0) {
+    coef.fill(0);
+    features.fill(0);
+}
+
+void CompileCostModel::load (std::string file_name) {
+    std::ifstream in_file(file_name);
+    if (!in_file.is_open())
+        ERROR("can't open cost model file " + file_name);
+
+    std::string line;
+    while (std::getline(in_file, line)) {
+        std::istringstream line_stream(line);
+        std::string name;
+        double val;
+        if (!(line_stream >> name) || name[0] == '#')
+            continue;
+        if (!(line_stream >> val))
+            ERROR("bad line in cost model file: " + line);
+
+        if (name == "intercept") {
+            intercept = val;
+            continue;
+        }
+        bool found = false;
+        for (int i = 0; i < MAX_FEATURE_ID; ++i)
+            if (get_feature_name(static_cast<FeatureID>(i)) == name) {
+                coef.at(i) = val;
+                found = true;
+            }
+        if (!found)
+            ERROR("unknown feature in cost model file: " + name);
+    }
+
+    // Features may be accumulated before the model is loaded
+    cost = 0;
+    for (int i = 0; i < MAX_FEATURE_ID; ++i)
+        cost += coef.at(i) * features.at(i);
+    loaded = true;
+}
+
+void CompileCostModel::reset_features () {
+    features.fill(0);
+    cost = 0;
+    func_start_cost = 0;
+    func_node_count = 0;
+}
+
+void CompileCostModel::add_node (Node::NodeID node_id) {
+    // (n + 1)^2 - n^2
+    add_feature(FUNC_NODES_SQ, 2 * func_node_count + 1);
+    func_node_count++;
+
+    switch (node_id) {
+        case Node::NodeID::ASSIGN:      add_feature(ASSIGN, 1);      break;
+        case Node::NodeID::BINARY:      add_feature(BINARY, 1);      break;
+        case Node::NodeID::CONST:       add_feature(CONST, 1);       break;
+        case Node::NodeID::TYPE_CAST:   add_feature(TYPE_CAST, 1);   break;
+        case Node::NodeID::UNARY:       add_feature(UNARY, 1);       break;
+        case Node::NodeID::VAR_USE:     add_feature(VAR_USE, 1);     break;
+        case Node::NodeID::MEMBER:      add_feature(MEMBER, 1);      break;
+        case Node::NodeID::REFERENCE:   add_feature(REFERENCE, 1);   break;
+        case Node::NodeID::DEREFERENCE: add_feature(DEREFERENCE, 1); break;
+        case Node::NodeID::DECL:        add_feature(DECL, 1);        break;
+        case Node::NodeID::EXPR:        add_feature(EXPR, 1);        break;
+        case Node::NodeID::SCOPE:       add_feature(SCOPE, 1);       break;
+        case Node::NodeID::IF:          add_feature(IF, 1);          break;
+        default:
+            ERROR("bad NodeID");
+    }
+}
+
+void CompileCostModel::add_feature (FeatureID feature_id, uint64_t count) {
+    features.at(feature_id) += count;
+    cost += coef.at(feature_id) * count;
+}
+
+void CompileCostModel::update_max (FeatureID feature_id, uint64_t val) {
+    if (val <= features.at(feature_id))
+        return;
+    add_feature(feature_id, val - features.at(feature_id));
+}
+
+void CompileCostModel::emit_features (std::ostream& stream) {
+    stream << "/*FEATURES";
+    for (int i = 0; i < MAX_FEATURE_ID; ++i)
+        stream << " " << get_feature_name(static_cast<FeatureID>(i)) << "=" << features.at(i);
+    stream << "*/";
+}
+
+std::string CompileCostModel::get_feature_name (FeatureID feature_id) {
+    switch (feature_id) {
+        case ASSIGN:         return "assign";
+        case BINARY:         return "binary";
+        case CONST:          return "const";
+        case TYPE_CAST:      return "type_cast";
+        case UNARY:          return "unary";
+        case VAR_USE:        return "var_use";
+        case MEMBER:         return "member";
+        case REFERENCE:      return "reference";
+        case DEREFERENCE:    return "dereference";
+        case DECL:           return "decl";
+        case EXPR:           return "expr";
+        case SCOPE:          return "scope";
+        case IF:             return "if";
+        case EXTERN_VAR:     return "extern_var";
+        case STRUCT_MEMBER:  return "struct_member";
+        case ARRAY_ELEM:     return "array_elem";
+        case POINTER:        return "pointer";
+        case MAX_EXPR_DEPTH: return "max_expr_depth";
+        case MAX_IF_DEPTH:   return "max_if_depth";
+        case MAX_PTR_DEPTH:  return "max_ptr_depth";
+        case FUNC_NODES_SQ:  return "func_nodes_sq";
+        case MAX_FEATURE_ID: break;
+    }
+    ERROR("bad FeatureID");
+}
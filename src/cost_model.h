@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "ir_node.h"
+
+namespace yarpgen {
+
+// Singleton class which predicts compilation time of generated test.
+// Prediction is a linear model over features of the test: number of nodes of each kind,
+// size of extern data and maximal nesting depths. Coefficients depend on compiler and its options,
+// so they are fitted by cost_model.py from timing data, collected by run_gen.py (see --cost-data option).
+// Generator uses the prediction to steer test size toward requested compilation time.
+class CompileCostModel {
+    public:
+        enum FeatureID {
+            // IR nodes
+            ASSIGN, BINARY, CONST, TYPE_CAST, UNARY, VAR_USE, MEMBER, REFERENCE, DEREFERENCE,
+            DECL, EXPR, SCOPE, IF,
+            // Extern data
+            EXTERN_VAR, STRUCT_MEMBER, ARRAY_ELEM, POINTER,
+            // Nesting
+            MAX_EXPR_DEPTH, MAX_IF_DEPTH, MAX_PTR_DEPTH,
+            // Sum of squared node counts of test functions. Optimizations are often superlinear
+            // in function size, so it is required to extrapolate to big functions.
+            FUNC_NODES_SQ,
+            MAX_FEATURE_ID
+        };
+
+        static CompileCostModel& get_instance() {
+            static CompileCostModel instance;
+            return instance;
+        }
+
+        CompileCostModel(const CompileCostModel& root) = delete;
+        CompileCostModel& operator=(const CompileCostModel&) = delete;
+
+        // Loads coefficients from file. Each line has "<feature name> <coefficient>" format,
+        // "intercept" stands for constant term. Empty lines and lines starting with '#' are skipped.
+        void load (std::string file_name);
+        bool is_loaded () { return loaded; }
+
+        void add_node (Node::NodeID node_id);
+        void add_feature (FeatureID feature_id, uint64_t count);
+        void update_max (FeatureID feature_id, uint64_t val);
+
+        // Predicted compilation time (in ms) of the whole test and of the current test function
+        double get_cost () { return intercept + cost; }
+        void start_func () { func_start_cost = cost; func_node_count = 0; }
+        double get_func_cost () { return cost - func_start_cost; }
+        // Drops collected features, but keeps loaded coefficients
+        void reset_features ();
+
+        // Prints features in "/*FEATURES <name>=<value> ...*/" format
+        void emit_features (std::ostream& stream);
+        static std::string get_feature_name (FeatureID feature_id);
+
+    private:
+        CompileCostModel ();
+
+        bool loaded;
+        double intercept;
+        std::array<double, MAX_FEATURE_ID> coef;
+        std::array<uint64_t, MAX_FEATURE_ID> features;
+        // Accumulated cost without intercept
+        double cost;
+        double func_start_cost;
+        uint64_t func_node_count;
+};
+}
@@ -17,9 +17,11 @@ limitations under the License.
 //////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include "cost_model.h"
 #include "expr.h"
 #include "ir_node.h"
 #include "gen_policy.h"
+#include "profile.h"
 #include "sym_table.h"
 #include "type.h"
 #include "util.h"
@@ -53,6 +55,10 @@ std::shared_ptr<Data> Expr::get_value () {
     ERROR("Expr::get_value() - data corruption");
 }
 
+void Expr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    ERROR("expression doesn't allow replacement of its operands (Expr)");
+}
+
 std::shared_ptr<Expr> VarUseExpr::set_value (std::shared_ptr<Expr> _expr) {
     std::shared_ptr<Data> _new_value = _expr->get_value();
     if (_new_value->get_class_id() != value->get_class_id()) {
@@ -161,6 +167,43 @@ void AssignExpr::emit (std::ostream& stream, std::string offset) {
     from->emit(stream);
 }
 
+void AssignExpr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    if (idx != 1)
+        ERROR("only rhs of assignment can be replaced (AssignExpr)");
+    from = _expr;
+}
+
+UB AssignExpr::recompute_value (bool _taken) {
+    taken = _taken;
+    UB ret = from->recompute_value(taken);
+    UB to_ub = to->recompute_value(taken);
+    if (ret == NoUB)
+        ret = to_ub;
+    value = from->get_value();
+    if (!taken)
+        return ret;
+
+    // Generator never stores value, which doesn't fit in bit-field (see MemberExpr::check_and_set_bit_field),
+    // so we treat it as UB
+    if (to->get_id() == Node::NodeID::MEMBER && to->get_value()->get_type()->get_is_bit_field()) {
+        std::shared_ptr<BitField> bit_field = std::static_pointer_cast<BitField>(to->get_value()->get_type());
+        BuiltinType::ScalarTypedVal new_val = std::static_pointer_cast<ScalarVariable>(value)->get_cur_value();
+        BuiltinType::ScalarTypedVal ovf_cmp_val = (bit_field->get_min() > new_val) || (bit_field->get_max() < new_val);
+        if (ovf_cmp_val.val.bool_val)
+            return ret != NoUB ? ret : SignOvf;
+    }
+
+    if (to->get_id() == Node::NodeID::VAR_USE)
+        std::static_pointer_cast<VarUseExpr>(to)->set_value(from);
+    else if (to->get_id() == Node::NodeID::MEMBER)
+        std::static_pointer_cast<MemberExpr>(to)->set_value(from);
+    else if (to->get_id() == Node::NodeID::DEREFERENCE)
+        std::static_pointer_cast<ExprStar>(to)->set_value(from);
+    else
+        ERROR("can assign only to variable (AssignExpr)");
+    return ret;
+}
+
 TypeCastExpr::TypeCastExpr (std::shared_ptr<Expr> _expr, std::shared_ptr<Type> _type, bool _is_implicit) :
               Expr(Node::NodeID::TYPE_CAST, nullptr, _expr->get_complexity() + 1),
               expr(_expr), to_type(_type), is_implicit(_is_implicit) {
@@ -188,6 +231,18 @@ UB TypeCastExpr::propagate_value () {
     return NoUB;
 }
 
+void TypeCastExpr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    if (idx != 0)
+        ERROR("bad operand index (TypeCastExpr)");
+    expr = _expr;
+}
+
+UB TypeCastExpr::recompute_value (bool _taken) {
+    UB ret = expr->recompute_value(_taken);
+    propagate_value();
+    return ret;
+}
+
 std::shared_ptr<TypeCastExpr> TypeCastExpr::generate (std::shared_ptr<Context> ctx, std::shared_ptr<Expr> from) {
     GenPolicy::add_to_complexity(Node::NodeID::TYPE_CAST);
     std::shared_ptr<IntegerType> to_type = IntegerType::generate(ctx);
@@ -477,6 +532,7 @@ GenPolicy ArithExpr::choose_and_apply_ssp (GenPolicy gen_policy) {
 }
 
 std::shared_ptr<Expr> ArithExpr::generate (std::shared_ptr<Context> ctx, std::vector<std::shared_ptr<Expr>> inp) {
+    PROFILE_PHASE(ARITH_GEN);
     ConstExpr::fill_const_buf(ctx);
     return gen_level(ctx, inp, 0);
 }
@@ -484,6 +540,7 @@ std::shared_ptr<Expr> ArithExpr::generate (std::shared_ptr<Context> ctx, std::ve
 // Top-level recursive function for expression tree generation.
 std::shared_ptr<Expr> ArithExpr::gen_level (std::shared_ptr<Context> ctx, std::vector<std::shared_ptr<Expr>> inp,
                                             uint32_t par_depth) {
+    CompileCostModel::get_instance().update_max(CompileCostModel::MAX_EXPR_DEPTH, par_depth);
     auto p = ctx->get_gen_policy();
     //TODO: it is a stub for testing. Rewrite it later.
     // Pick random pattern for single statement and apply it to gen_policy. Update Context with new gen_policy.
@@ -496,12 +553,13 @@ std::shared_ptr<Expr> ArithExpr::gen_level (std::shared_ptr<Context> ctx, std::v
     std::shared_ptr<Expr> ret = nullptr;
 
     // If we want to use any Data, we've reached expression tree depth limit or
-    // total Arithmetic Expression number, or we want to use CSE but don't have any,
-    // we fall into this branch.
+    // total Arithmetic Expression number, we want to use CSE but don't have any,
+    // or generation budget is exceeded, we fall into this branch.
     if (node_type == GenPolicy::ArithLeafID::Data || par_depth == p->get_max_arith_depth() ||
         (node_type == GenPolicy::ArithLeafID::CSE && p->get_cse().size() == 0) ||
         Expr::total_expr_count >= p->get_max_total_expr_count() ||
-        Expr::func_expr_count  >= p->get_max_func_expr_count()) {
+        Expr::func_expr_count  >= p->get_max_func_expr_count() ||
+        GenPolicy::is_budget_exceeded()) {
         // Pick random Data ID.
         GenPolicy::ArithDataID data_type = rand_val_gen->get_rand_id (p->get_arith_data_distr());
         // If we want to use Const or don't have any input VarUseExpr / MemberExpr, we fall into this branch.
@@ -556,6 +614,8 @@ std::shared_ptr<UnaryExpr> UnaryExpr::generate (std::shared_ptr<Context> ctx, st
 }
 
 void UnaryExpr::rebuild (UB ub) {
+    PROFILE_PHASE(UNARY_REBUILD);
+    PROFILE_REBUILD(ub);
     switch (op) {
         case UnaryExpr::PreInc:
             op = Op::PreDec;
@@ -677,6 +737,18 @@ UB UnaryExpr::propagate_value () {
     return new_val.get_ub();
 }
 
+void UnaryExpr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    if (idx != 0)
+        ERROR("bad operand index (UnaryExpr)");
+    arg = _expr;
+}
+
+UB UnaryExpr::recompute_value (bool _taken) {
+    UB ret = arg->recompute_value(_taken);
+    UB own_ub = propagate_value();
+    return ret != NoUB ? ret : own_ub;
+}
+
 // This function rebuilds Unary expression in case of UB.
 // The main idea is to replace operator by its complementary operator.
 // This trick always works for unary operations.
@@ -758,6 +830,8 @@ static uint64_t msb(uint64_t x) {
 // This works pretty well in most cases.
 // If it doesn't work, we insert child nodes to change operands.
 void BinaryExpr::rebuild (UB ub) {
+    PROFILE_PHASE(BINARY_REBUILD);
+    PROFILE_REBUILD(ub);
     //TODO: We should implement more rebuild strategies (e.g. regenerate node)
     switch (op) {
         case BinaryExpr::Add:
@@ -1065,6 +1139,24 @@ UB BinaryExpr::propagate_value () {
     return new_val.get_ub();
 }
 
+void BinaryExpr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    if (idx == 0)
+        arg0 = _expr;
+    else if (idx == 1)
+        arg1 = _expr;
+    else
+        ERROR("bad operand index (BinaryExpr)");
+}
+
+UB BinaryExpr::recompute_value (bool _taken) {
+    UB ret = arg0->recompute_value(_taken);
+    UB arg1_ub = arg1->recompute_value(_taken);
+    if (ret == NoUB)
+        ret = arg1_ub;
+    UB own_ub = propagate_value();
+    return ret != NoUB ? ret : own_ub;
+}
+
 void BinaryExpr::emit (std::ostream& stream, std::string offset) {
     stream << offset << "(";
     arg0->emit(stream);
@@ -1166,6 +1258,26 @@ UB ConditionalExpr::propagate_value() {
     return UB::NoUB;
 }
 
+void ConditionalExpr::set_operand (uint32_t idx, std::shared_ptr<Expr> _expr) {
+    if (idx == 0)
+        condition = _expr;
+    else
+        BinaryExpr::set_operand(idx - 1, _expr);
+}
+
+UB ConditionalExpr::recompute_value (bool _taken) {
+    UB ret = condition->recompute_value(_taken);
+    UB arg0_ub = arg0->recompute_value(_taken);
+    UB arg1_ub = arg1->recompute_value(_taken);
+    propagate_value();
+    std::shared_ptr<ScalarVariable> scalar_cond = std::static_pointer_cast<ScalarVariable>(condition->get_value());
+    bool cond_val = options->is_cxx() ? scalar_cond->get_cur_value().val.bool_val :
+                                        (bool) scalar_cond->get_cur_value().val.int_val;
+    if (ret == NoUB)
+        ret = cond_val ? arg0_ub : arg1_ub;
+    return ret;
+}
+
 void ConditionalExpr::emit (std::ostream& stream, std::string offset) {
     stream << offset << "((";
     condition->emit(stream);
@@ -1236,6 +1348,12 @@ UB MemberExpr::propagate_value () {
     return NoUB;
 }
 
+std::vector<std::shared_ptr<Expr>> MemberExpr::get_operands () {
+    if (member_expr != nullptr)
+        return {member_expr};
+    return {};
+}
+
 std::shared_ptr<Expr> MemberExpr::set_value (std::shared_ptr<Expr> _expr) {
     //TODO: what about struct?
     std::shared_ptr<Data> _new_value = _expr->get_value();
@@ -1371,6 +1489,14 @@ void AddressOfExpr::emit (std::ostream& stream, std::string offset) {
     stream << ")";
 }
 
+UB AddressOfExpr::recompute_value (bool _taken) {
+    UB ret = addr_of_expr->recompute_value(_taken);
+    // Only dereference can change the object, which address is taken
+    if (addr_of_expr->get_id() == Node::NodeID::DEREFERENCE)
+        value = std::make_shared<Pointer>("", addr_of_expr->get_value());
+    return ret;
+}
+
 ExprStar::ExprStar(std::shared_ptr<Expr> expr) :
         Expr(Node::NodeID::DEREFERENCE, nullptr, 1), expr_star(expr) {
     if (expr_star->get_id() != Node::NodeID::VAR_USE && expr_star->get_id() != Node::NodeID::MEMBER &&
@@ -1393,6 +1519,13 @@ std::shared_ptr<Data> ExprStar::get_value () {
     return Expr::get_value();
 }
 
+UB ExprStar::recompute_value (bool _taken) {
+    UB ret = expr_star->recompute_value(_taken);
+    // Update cached pointee, it is used by set_value
+    get_value();
+    return ret;
+}
+
 std::shared_ptr<Expr> ExprStar::set_value (std::shared_ptr<Expr> _expr) {
     std::shared_ptr<Data> _new_value = _expr->get_value();
     if (_new_value->get_class_id() != value->get_class_id())
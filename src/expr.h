@@ -40,6 +40,15 @@ class Expr : public Node {
         static void increase_expr_count(uint32_t val) { total_expr_count += val; func_expr_count += val; }
         static uint32_t get_total_expr_count () { return total_expr_count; }
         static void zero_out_func_expr_count () { func_expr_count = 0; }
+        static void zero_out_total_expr_count () { total_expr_count = 0; }
+
+        // Child nodes of expression (they are used by Reducer to walk and rewrite expression tree)
+        virtual std::vector<std::shared_ptr<Expr>> get_operands () { return {}; }
+        virtual void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        // This function recalculates values of expression tree after values of variables have changed.
+        // Unlike constructors, it doesn't eliminate UB, but reports it to the caller.
+        // "taken" indicates whether the expression is evaluated in the test (only then assignments are performed).
+        virtual UB recompute_value (bool _taken) { return propagate_value(); }
 
     protected:
         // This function does type conversions required by the language standard (implicit cast,
@@ -85,6 +94,9 @@ class AssignExpr : public Expr {
     public:
         AssignExpr (std::shared_ptr<Expr> _to, std::shared_ptr<Expr> _from, bool _taken = true);
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {to, from}; }
+        void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        UB recompute_value (bool _taken);
 
     private:
         bool propagate_type ();
@@ -106,6 +118,9 @@ class TypeCastExpr : public Expr {
     public:
         TypeCastExpr (std::shared_ptr<Expr> _expr, std::shared_ptr<Type> _type, bool _is_implicit = false);
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {expr}; }
+        void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        UB recompute_value (bool _taken);
         static std::shared_ptr<TypeCastExpr> generate (std::shared_ptr<Context> ctx, std::shared_ptr<Expr> from);
 
     private:
@@ -191,6 +206,9 @@ class UnaryExpr : public ArithExpr {
         Op get_op () { return op; }
         static std::shared_ptr<UnaryExpr> generate (std::shared_ptr<Context> ctx, std::vector<std::shared_ptr<Expr>> inp, uint32_t par_depth);
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {arg}; }
+        void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        UB recompute_value (bool _taken);
 
     private:
         bool propagate_type ();
@@ -237,6 +255,9 @@ class BinaryExpr : public ArithExpr {
         Op get_op () { return op; }
         static std::shared_ptr<BinaryExpr> generate (std::shared_ptr<Context> ctx, std::vector<std::shared_ptr<Expr>> inp, uint32_t par_depth);
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {arg0, arg1}; }
+        void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        UB recompute_value (bool _taken);
 
     protected:
         bool propagate_type ();
@@ -256,6 +277,10 @@ class ConditionalExpr : public BinaryExpr {
         ConditionalExpr (std::shared_ptr<Expr> _cond, std::shared_ptr<Expr> lhs, std::shared_ptr<Expr> rhs);
         void emit (std::ostream& stream, std::string offset = "");
         static std::shared_ptr<ConditionalExpr> generate (std::shared_ptr<Context> ctx, std::vector<std::shared_ptr<Expr>> inp, int par_depth);
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {condition, arg0, arg1}; }
+        void set_operand (uint32_t idx, std::shared_ptr<Expr> _expr);
+        // Only UB in condition and in the chosen branch is reported
+        UB recompute_value (bool _taken);
 
     private:
         UB propagate_value ();
@@ -271,7 +296,10 @@ class MemberExpr : public Expr {
         std::shared_ptr<Expr> set_value (std::shared_ptr<Expr> _expr);
         // This method provides direct access to underlying member
         std::shared_ptr<Data> get_raw_value () { return value; }
+        // Struct variable, which the chain of member accesses starts from
+        std::shared_ptr<Struct> get_base_struct () { return struct_var != nullptr ? struct_var : member_expr->get_base_struct(); }
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands ();
 
     private:
         bool propagate_type ();
@@ -288,6 +316,8 @@ class AddressOfExpr : public Expr {
     public:
         AddressOfExpr(std::shared_ptr<Expr> expr);
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {addr_of_expr}; }
+        UB recompute_value (bool _taken);
 
     private:
         bool propagate_type () { return true; }
@@ -303,6 +333,8 @@ class ExprStar : public Expr {
         std::shared_ptr<Expr> set_value (std::shared_ptr<Expr> _expr);
         std::shared_ptr<Data> get_value ();
         void emit (std::ostream& stream, std::string offset = "");
+        std::vector<std::shared_ptr<Expr>> get_operands () { return {expr_star}; }
+        UB recompute_value (bool _taken);
 
     private:
         bool propagate_type () { return true; }
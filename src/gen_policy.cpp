@@ -17,7 +17,10 @@ limitations under the License.
 //////////////////////////////////////////////////////////////////////////////
 #include <map>
 
+#include "cost_model.h"
 #include "gen_policy.h"
+#include "profile.h"
+#include "util.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -33,14 +36,27 @@ const uint32_t MAX_FUNC_EXPR_COUNT = 10000000;
 
 const uint32_t MAX_TOTAL_STMT_COUNT = 5000;
 const uint32_t MAX_FUNC_STMT_COUNT = 1000;
+// Statement count limits when compilation time is requested. Predicted cost is the main limit then,
+// but model with (almost) zero coefficients never reaches it, so the size of test is still bounded.
+const uint32_t TARGET_COMPILE_MAX_TOTAL_STMT_COUNT = 500000;
+const uint32_t TARGET_COMPILE_MAX_FUNC_STMT_COUNT = 100000;
 
 const uint32_t MIN_INP_VAR_COUNT = 20;
 const uint32_t MAX_INP_VAR_COUNT = 60;
 const uint32_t MIN_MIX_VAR_COUNT = 20;
 const uint32_t MAX_MIX_VAR_COUNT = 60;
+// Output scalar variables are not used yet (see Program::form_extern_sym_table)
+const uint32_t MIN_OUT_VAR_COUNT = 0;
+const uint32_t MAX_OUT_VAR_COUNT = 0;
 
 const uint64_t MAX_TEST_COMPLEXITY = UINT64_MAX;
 
+// Wall-clock time budget is checked only once per this number of created nodes
+const uint64_t BUDGET_TIME_CHECK_PERIOD = 1024;
+// Rough estimation of emitted text size (in bytes) for every scalar object of extern data
+// (it is emitted in declaration, definition, initialization and checksum calculation)
+const uint64_t EXTERN_SCALAR_OBJ_OUT_SIZE = 40;
+
 const uint32_t MIN_STRUCT_MEMBER_COUNT = 1;
 const uint32_t MAX_STRUCT_MEMBER_COUNT = 10;
 const uint32_t MAX_STRUCT_DEPTH = 5;
@@ -85,6 +101,28 @@ RandValGen::RandValGen (uint64_t _seed) {
     rand_gen = std::mt19937_64(seed);
 }
 
+std::string RandValGen::check_shard_coords (uint64_t campaign, uint64_t shard, uint64_t counter) {
+    if (campaign == 0 || campaign >= (1ULL << CAMPAIGN_BITS))
+        return "campaign ID should be in [1, " + std::to_string((1ULL << CAMPAIGN_BITS) - 1) + "]";
+    if (shard >= (1ULL << SHARD_BITS))
+        return "shard index should be less than " + std::to_string(1ULL << SHARD_BITS);
+    if (counter >= (1ULL << COUNTER_BITS))
+        return "seed counter should be less than " + std::to_string(1ULL << COUNTER_BITS);
+    return "";
+}
+
+uint64_t RandValGen::get_shard_seed (uint64_t campaign, uint64_t shard, uint64_t counter) {
+    std::string err = check_shard_coords(campaign, shard, counter);
+    if (!err.empty())
+        ERROR(err);
+    uint64_t index = (campaign << (SHARD_BITS + COUNTER_BITS)) | (shard << COUNTER_BITS) | counter;
+    // Finalizer of splitmix64. Every step is invertible and zero is mapped to zero,
+    // so non-zero index never gives reserved zero seed.
+    index = (index ^ (index >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    index = (index ^ (index >> 27)) * 0x94d049bb133111ebULL;
+    return index ^ (index >> 31);
+}
+
 const std::string NameHandler::common_test_func_prefix = "tf_";
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -98,6 +136,7 @@ GenPolicy::GenPolicy () {
 }
 
 void GenPolicy::init_from_config () {
+    PROFILE_PHASE(INIT_FROM_CONFIG);
     test_func_count = TEST_FUNC_COUNT;
 
     num_of_allowed_int_types = MAX_ALLOWED_INT_TYPES;
@@ -204,10 +243,22 @@ void GenPolicy::init_from_config () {
     max_total_stmt_count = MAX_TOTAL_STMT_COUNT;
     max_func_stmt_count = MAX_FUNC_STMT_COUNT;
 
+    // If compilation time is requested, predicted cost becomes the main limit of test size,
+    // so statement count limits are raised and each test function gets equal share of the time.
+    func_compile_cost_limit = 0;
+    if (options->target_compile_ms != 0) {
+        max_total_stmt_count = TARGET_COMPILE_MAX_TOTAL_STMT_COUNT;
+        max_func_stmt_count = TARGET_COMPILE_MAX_FUNC_STMT_COUNT;
+        double test_compile_cost = options->target_compile_ms - CompileCostModel::get_instance().get_cost();
+        func_compile_cost_limit = std::max(test_compile_cost, 0.0) / test_func_count;
+    }
+
     min_inp_var_count = MIN_INP_VAR_COUNT;
     max_inp_var_count = MAX_INP_VAR_COUNT;
     min_mix_var_count = MIN_MIX_VAR_COUNT;
     max_mix_var_count = MAX_MIX_VAR_COUNT;
+    min_out_var_count = MIN_OUT_VAR_COUNT;
+    max_out_var_count = MAX_OUT_VAR_COUNT;
 
     max_cse_count = options->max_cse_count;
 
@@ -322,7 +373,7 @@ void GenPolicy::init_from_config () {
     decl_stmt_gen_id_prob.emplace_back(Probability<GenPolicy::DeclStmtGenID>(GenPolicy::DeclStmtGenID::Pointer, 20));
     rand_val_gen->shuffle_prob(decl_stmt_gen_id_prob);
 
-    max_test_complexity = MAX_TEST_COMPLEXITY;
+    max_test_complexity = options->max_test_complexity != 0 ? options->max_test_complexity : MAX_TEST_COMPLEXITY;
 
     default_was_loaded = true;
 }
@@ -462,8 +513,92 @@ static const std::map<Node::NodeID, uint64_t> NodeComplexity {
     {Node::NodeID::MAX_STMT_ID, UINT64_MAX}
 };
 
+// Rough estimation of emitted text size (in bytes) for every node
+static const std::map<Node::NodeID, uint64_t> NodeOutSize {
+    {Node::NodeID::ASSIGN, 6},
+    {Node::NodeID::BINARY, 12},
+    {Node::NodeID::CONST, 20},
+    {Node::NodeID::TYPE_CAST, 36},
+    {Node::NodeID::UNARY, 6},
+    {Node::NodeID::VAR_USE, 24},
+    {Node::NodeID::MEMBER, 44},
+    {Node::NodeID::REFERENCE, 28},
+    {Node::NodeID::DEREFERENCE, 32},
+    {Node::NodeID::MAX_EXPR_ID, 0},
+    {Node::NodeID::MIN_STMT_ID, 0},
+    {Node::NodeID::DECL, 70},
+    {Node::NodeID::EXPR, 14},
+    {Node::NodeID::SCOPE, 14},
+    {Node::NodeID::IF, 22},
+    {Node::NodeID::MAX_STMT_ID, 0}
+};
+
 uint64_t GenPolicy::test_complexity = 0;
+uint64_t GenPolicy::node_count = 0;
+uint64_t GenPolicy::est_out_size = 0;
+GenPolicy::BudgetID GenPolicy::exceeded_budget = GenPolicy::NO_BUDGET;
+uint64_t GenPolicy::budget_node_count = 0;
+std::chrono::steady_clock::time_point GenPolicy::budget_start_time = std::chrono::steady_clock::now();
 
 void GenPolicy::add_to_complexity(Node::NodeID node_id) {
     test_complexity += NodeComplexity.at(node_id);
+    node_count++;
+    est_out_size += NodeOutSize.at(node_id);
+    CompileCostModel::get_instance().add_node(node_id);
+    PROFILE_NODE(node_id);
+
+    if (exceeded_budget != NO_BUDGET)
+        return;
+    if (options->max_node_count != 0 && node_count >= options->max_node_count)
+        exceed_budget(NODE_BUDGET);
+    else if (options->max_out_size != 0 && est_out_size >= options->max_out_size)
+        exceed_budget(OUT_SIZE_BUDGET);
+    else if (options->gen_time_limit != 0 && node_count % BUDGET_TIME_CHECK_PERIOD == 0) {
+        auto elapsed = std::chrono::steady_clock::now() - budget_start_time;
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >=
+            static_cast<int64_t>(options->gen_time_limit))
+            exceed_budget(TIME_BUDGET);
+    }
+}
+
+void GenPolicy::add_extern_data_to_out_size(uint64_t scalar_obj_count) {
+    est_out_size += scalar_obj_count * EXTERN_SCALAR_OBJ_OUT_SIZE;
+}
+
+// Only the first exceeded budget is recorded, because it is the one which determines the shape of the test
+void GenPolicy::exceed_budget(BudgetID budget_id) {
+    if (exceeded_budget == NO_BUDGET) {
+        exceeded_budget = budget_id;
+        budget_node_count = node_count;
+    }
+}
+
+void GenPolicy::reset() {
+    // init_from_config() appends to probability vectors, so default policy should be recreated from scratch
+    default_was_loaded = false;
+    default_gen_policy = GenPolicy();
+    test_complexity = 0;
+    node_count = 0;
+    est_out_size = 0;
+    exceeded_budget = NO_BUDGET;
+    budget_node_count = 0;
+    start_budget_clock();
+}
+
+std::string GenPolicy::get_budget_name(BudgetID budget_id) {
+    switch (budget_id) {
+        case NO_BUDGET:
+            return "none";
+        case TIME_BUDGET:
+            return "time";
+        case NODE_BUDGET:
+            return "node_count";
+        case OUT_SIZE_BUDGET:
+            return "out_size";
+        case COMPLEXITY_BUDGET:
+            return "complexity";
+        case MAX_BUDGET_ID:
+            break;
+    }
+    ERROR("bad BudgetID");
 }
@@ -18,6 +18,7 @@ limitations under the License.
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <random>
@@ -58,6 +59,16 @@ class RandValGen {
         // Zero value is reserved (it notifies RandValGen that it can choose any)
         RandValGen (uint64_t _seed);
 
+        // Seed of sharded campaign. Campaign ID, shard index and counter are packed into 64-bit index, which
+        // is mapped to the seed with bijective mixer, so seed streams of different shards never intersect
+        // and any seed can be traced back to its shard (see run_gen.py). Campaign ID 0 is reserved.
+        static const uint32_t CAMPAIGN_BITS = 16;
+        static const uint32_t SHARD_BITS = 16;
+        static const uint32_t COUNTER_BITS = 32;
+        static uint64_t get_shard_seed (uint64_t campaign, uint64_t shard, uint64_t counter);
+        // Returns description of the error, if coordinates are out of range, or empty string
+        static std::string check_shard_coords (uint64_t campaign, uint64_t shard, uint64_t counter);
+
         template<typename T>
         T get_rand_value (T from, T to) {
             // Using long long instead of T is a hack.
@@ -261,6 +272,28 @@ class GenPolicy {
         uint64_t get_max_test_complexity () { return max_test_complexity; }
         static uint64_t  get_test_complexity () { return test_complexity; }
 
+        // Budget section
+        // Budgets limit total generation effort (see Options). When one of them is exceeded,
+        // generation degrades gracefully: expressions are finished with leaves, scopes are closed
+        // and remaining test functions are left empty, so the test is still valid.
+        enum BudgetID {
+            NO_BUDGET, TIME_BUDGET, NODE_BUDGET, OUT_SIZE_BUDGET, COMPLEXITY_BUDGET, MAX_BUDGET_ID
+        };
+        static void start_budget_clock () { budget_start_time = std::chrono::steady_clock::now(); }
+        static void exceed_budget (BudgetID budget_id);
+        // Extern data isn't a part of IR, so it is accounted in estimated test size separately
+        static void add_extern_data_to_out_size (uint64_t scalar_obj_count);
+        static bool is_budget_exceeded () { return exceeded_budget != NO_BUDGET; }
+        static BudgetID get_exceeded_budget () { return exceeded_budget; }
+        static std::string get_budget_name (BudgetID budget_id);
+        static uint64_t get_node_count () { return node_count; }
+        // Number of nodes at the moment when budget was exceeded
+        static uint64_t get_budget_node_count () { return budget_node_count; }
+        static uint64_t get_est_out_size () { return est_out_size; }
+
+        // Drops default policy, complexity and budgets, so another test can be generated in the same process
+        static void reset ();
+
         // Integer types section - defines number and type (bool, char ...) of available integer types
         void rand_init_allowed_int_types ();
         void set_num_of_allowed_int_types (uint32_t _num_of_allowed_int_types) { num_of_allowed_int_types = _num_of_allowed_int_types; }
@@ -357,6 +390,7 @@ class GenPolicy {
         uint32_t get_min_out_array_count () { return min_out_array_count; }
         void set_max_out_array_count (uint32_t _max_out_array_count) { max_out_array_count = _max_out_array_count; }
         uint32_t get_max_out_array_count () { return max_out_array_count; }
+        void set_min_inp_ptr_count (uint32_t _min_inp_ptr_count) { min_inp_ptr_count = _min_inp_ptr_count; }
         uint32_t get_min_inp_ptr_count () { return min_inp_ptr_count; }
         void set_max_inp_ptr_count (uint32_t _max_inp_ptr_count) { max_inp_ptr_count = _max_inp_ptr_count; }
         uint32_t get_max_inp_ptr_count () { return max_inp_ptr_count; }
@@ -430,6 +464,9 @@ class GenPolicy {
         uint32_t get_max_total_stmt_count () { return max_total_stmt_count; }
         void set_max_func_stmt_count (uint32_t _max_func_stmt_count) { max_func_stmt_count = _max_func_stmt_count; }
         uint32_t get_max_func_stmt_count () { return max_func_stmt_count; }
+        // Limit of predicted compilation time (in ms) for single test function (see CompileCostModel)
+        void set_func_compile_cost_limit (double _limit) { func_compile_cost_limit = _limit; }
+        double get_func_compile_cost_limit () { return func_compile_cost_limit; }
         std::vector<Probability<bool>>& get_else_prob () { return else_prob; }
         void set_max_if_depth (uint32_t _max_if_depth) { max_if_depth = _max_if_depth; }
         uint32_t get_max_if_depth () { return max_if_depth; }
@@ -446,6 +483,13 @@ class GenPolicy {
         static uint64_t test_complexity;
         uint64_t max_test_complexity;
 
+        // Budgets
+        static uint64_t node_count;
+        static uint64_t est_out_size;
+        static BudgetID exceeded_budget;
+        static uint64_t budget_node_count;
+        static std::chrono::steady_clock::time_point budget_start_time;
+
         // Types
         uint32_t num_of_allowed_int_types;
         std::vector<Probability<IntegerType::IntegerTypeID>> allowed_int_types;
@@ -545,6 +589,7 @@ class GenPolicy {
         uint32_t max_scope_stmt_count;
         uint32_t max_total_stmt_count;
         uint32_t max_func_stmt_count;
+        double func_compile_cost_limit;
         std::vector<Probability<Node::NodeID>> stmt_gen_prob;
         std::vector<Probability<bool>> else_prob;
         uint32_t max_if_depth;
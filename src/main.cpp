@@ -17,6 +17,8 @@ limitations under the License.
 //////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include <cctype>
+#include <cerrno>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -24,9 +26,12 @@ limitations under the License.
 #include <iostream>
 #include <sstream>
 
+#include "cost_model.h"
 #include "gen_policy.h"
 #include "options.h"
+#include "profile.h"
 #include "program.h"
+#include "reducer.h"
 #include "sym_table.h"
 #include "type.h"
 #include "util.h"
@@ -48,6 +53,7 @@ void printVersion() {
 }
 
 extern void self_test();
+extern int run_self_checks();
 
 bool option_starts_with(char *option, const char *test) {
   return !strncmp(option, test, strlen(test));
@@ -68,6 +74,11 @@ void print_usage_and_exit(std::string error_msg = "") {
   std::cout << "\t-d, --out-dir=<out-dir>   Output directory\n";
   std::cout << "\t-s, --seed=<seed>         Predefined seed (it is accepted in "
                "form of SSS or VV_SSS)\n";
+  std::cout << "\t--campaign=<id>           Take seed from sharded seed space of "
+               "campaign (1-65535)\n";
+  std::cout << "\t--shard=<idx>             Shard of campaign (0-65535), default: 0\n";
+  std::cout << "\t--seed-counter=<num>      Number of seed in the shard, default: 0\n";
+  std::cout << "\t--self-test               Run self checks of generator and exit\n";
   std::cout << "\t-m, --bit-mode=<32/64>    Generated test's bit mode\n";
   std::cout
       << "\t--std=<standard>          Generated test's language standard\n";
@@ -86,9 +97,50 @@ void print_usage_and_exit(std::string error_msg = "") {
     all_standatds += " " + iter.first + ",";
   all_standatds.pop_back();
   std::cout << all_standatds << std::endl;
+  std::cout << "\t--gen_time_limit=<ms>      Generation wall-clock budget "
+               "(0 - unlimited)\n";
+  std::cout << "\t--max_node_count=<num>     Generation budget for IR nodes "
+               "(0 - unlimited)\n";
+  std::cout << "\t--max_out_size=<bytes>     Generation budget for estimated "
+               "test size (0 - unlimited)\n";
+  std::cout << "\t--max_test_complexity=<num> Generation budget for test "
+               "complexity (0 - unlimited)\n";
+  std::cout << "\t\t\t\t  When budget is exceeded, test is truncated and "
+               "/*BUDGET <name> <node_count> <total_node_count>*/\n";
+  std::cout << "\t\t\t\t  is printed (nodes at the moment of exceeding and "
+               "nodes of the whole test).\n";
+  std::cout << "\t\t\t\t  Other budgets don't depend on machine load, but "
+               "test truncated by time budget\n";
+  std::cout << "\t\t\t\t  is reproduced only with --gen_time_limit=0 "
+               "--max_node_count=<node_count>.\n";
+  std::cout << "\t--cost-model=<file>       Compilation cost model "
+               "coefficients (see cost_model.py)\n";
+  std::cout << "\t--target-compile-ms=<ms>  Steer test size toward requested "
+               "compilation time\n";
+  std::cout << "\t\t\t\t  (requires --cost-model)\n";
+  std::cout << "\t--print-cost-features     Print features of compilation "
+               "cost model\n";
+  std::cout << "\t--profile=<file.json>     Dump generator profile (requires "
+               "build with YARPGEN_PROFILE)\n";
+  std::cout << "\t--reduce=<script>         Reduce generated test, while the "
+               "script exits with 0 in its directory\n";
+  std::cout << "\t\t\t\t  Use the same options and budgets (see "
+               "--max_node_count), as the failing test had.\n";
+  std::cout << "\t--reduce-jobs=<num>       Reduction candidates tested in "
+               "parallel (0 - number of cores)\n";
   exit(exit_code);
 }
 
+// This function parses unsigned decimal value of option or exits with error_msg
+uint64_t parse_num(const std::string &arg, const std::string &error_msg) {
+  char *end = nullptr;
+  errno = 0;
+  uint64_t res = std::strtoull(arg.c_str(), &end, 10);
+  if (arg.empty() || !isdigit(arg[0]) || *end != '\0' || errno == ERANGE)
+    print_usage_and_exit(error_msg + ": " + arg);
+  return res;
+}
+
 // This function handles command-line options in form of "-short_arg <value>"
 // and performs action(<value>)
 bool parse_short_args(int argc, int &argv_iter, char **&argv,
@@ -133,8 +185,12 @@ bool parse_long_and_short_args(int argc, int &argv_iter, char **&argv,
 int main(int argc, char *argv[128]) {
   options = new Options;
   uint64_t seed = 0;
+  uint64_t campaign = 0;
+  uint64_t shard = 0;
+  uint64_t seed_counter = 0;
   std::string out_dir = "./";
   bool quiet = false;
+  bool self_checks = false;
 
   // Utility functions. They are necessary for copy-paste reduction. They
   // perform main actions during option parsing. Detects output directory
@@ -156,6 +212,17 @@ int main(int argc, char *argv[128]) {
     arg_ss >> seed;
   };
 
+  // Detects coordinates of seed in sharded seed space
+  auto campaign_action = [&campaign](std::string arg) {
+    campaign = parse_num(arg, "Invalid campaign ID");
+  };
+  auto shard_action = [&shard](std::string arg) {
+    shard = parse_num(arg, "Invalid shard index");
+  };
+  auto seed_counter_action = [&seed_counter](std::string arg) {
+    seed_counter = parse_num(arg, "Invalid seed counter");
+  };
+
   // Detects YARPGen bit_mode
   auto bit_mode_action = [](std::string arg) {
     size_t *pEnd = nullptr;
@@ -185,35 +252,55 @@ int main(int argc, char *argv[128]) {
   };
 
   auto max_arith_depth = [](std::string arg) {
-    options->max_arith_depth = std::stoul(arg);
+    options->max_arith_depth = parse_num(arg, "Invalid max_arith_depth");
   };
   auto min_scope_stmt_count = [](std::string arg) {
-    options->min_scope_stmt_count = std::stoul(arg);
+    options->min_scope_stmt_count = parse_num(arg, "Invalid min_scope_stmt_count");
   };
   auto max_scope_stmt_count = [](std::string arg) {
-    options->max_scope_stmt_count = std::stoul(arg);
+    options->max_scope_stmt_count = parse_num(arg, "Invalid max_scope_stmt_count");
   };
   auto max_cse_count = [](std::string arg) {
-    options->max_cse_count = std::stoul(arg);
+    options->max_cse_count = parse_num(arg, "Invalid max_cse_count");
   };
   auto max_if_depth = [](std::string arg) {
-    options->max_if_depth = std::stoul(arg);
+    options->max_if_depth = parse_num(arg, "Invalid max_if_depth");
   };
   auto enable_arrays = [](std::string arg) {
-    options->enable_arrays = std::stoul(arg) != 0;
+    options->enable_arrays = parse_num(arg, "Invalid enable_arrays") != 0;
   };
   auto enable_bit_fields = [](std::string arg) {
-    options->enable_bit_fields = std::stoul(arg) != 0;
+    options->enable_bit_fields = parse_num(arg, "Invalid enable_bit_fields") != 0;
+  };
+  auto cost_model_action = [](std::string arg) {
+    options->cost_model_file = arg;
+  };
+  auto profile_action = [](std::string arg) {
+#ifdef YARPGEN_PROFILE
+    options->profile_file = arg;
+#else
+    print_usage_and_exit("yarpgen was built without profiling support "
+                         "(YARPGEN_PROFILE), can't use --profile=" + arg);
+#endif
+  };
+  auto target_compile_ms_action = [](std::string arg) {
+    options->target_compile_ms =
+        parse_num(arg, "Invalid target compilation time");
+  };
+  auto reduce_action = [](std::string arg) { options->reduce_script = arg; };
+  auto reduce_jobs_action = [](std::string arg) {
+    options->reduce_jobs = parse_num(arg, "Invalid number of reduction jobs");
   };
   auto print_assignments = [](std::string arg) {
-    options->print_assignments = std::stoul(arg) != 0;
+    options->print_assignments = parse_num(arg, "Invalid print_assignments") != 0;
   };
 
-#define PARSE_NUM(name)                                                  \
-  else if (parse_long_args(                                              \
-               i, argv, "--" #name,                                      \
-               [](std::string arg) { options->name = std::stoul(arg); }, \
-               "Invalid " #name))
+#define PARSE_NUM(name)                                                    \
+  else if (parse_long_args(i, argv, "--" #name,                            \
+                           [](std::string arg) {                           \
+                             options->name = parse_num(arg, "Invalid " #name); \
+                           },                                              \
+                           "Invalid " #name))
 
   // Main loop for parsing command-line options
   for (int i = 0; i < argc; ++i) {
@@ -224,6 +311,21 @@ int main(int argc, char *argv[128]) {
       exit(0);
     } else if (!strcmp(argv[i], "-q")) {
       quiet = true;
+    } else if (!strcmp(argv[i], "--self-test")) {
+      self_checks = true;
+    } else if (!strcmp(argv[i], "--print-cost-features")) {
+      options->print_cost_features = true;
+    } else if (parse_long_args(i, argv, "--profile", profile_action,
+                               "Profile file wasn't specified.")) {
+    } else if (parse_long_args(i, argv, "--reduce", reduce_action,
+                               "Interestingness script wasn't specified.")) {
+    } else if (parse_long_args(i, argv, "--reduce-jobs", reduce_jobs_action,
+                               "Invalid number of reduction jobs")) {
+    } else if (parse_long_args(i, argv, "--cost-model", cost_model_action,
+                               "Cost model file wasn't specified.")) {
+    } else if (parse_long_args(i, argv, "--target-compile-ms",
+                               target_compile_ms_action,
+                               "Invalid target compilation time")) {
     } else if (parse_long_args(i, argv, "--std", standard_action,
                                "Can't recognize language standard:")) {
     } else if (parse_long_and_short_args(
@@ -232,6 +334,12 @@ int main(int argc, char *argv[128]) {
     } else if (parse_long_and_short_args(argc, i, argv, "-s", "--seed",
                                          seed_action,
                                          "Seed wasn't specified.")) {
+    } else if (parse_long_args(i, argv, "--campaign", campaign_action,
+                               "Invalid campaign ID")) {
+    } else if (parse_long_args(i, argv, "--shard", shard_action,
+                               "Invalid shard index")) {
+    } else if (parse_long_args(i, argv, "--seed-counter", seed_counter_action,
+                               "Invalid seed counter")) {
     } else if (parse_long_and_short_args(argc, i, argv, "-m", "--bit-mode",
                                          bit_mode_action,
                                          "Can't recognize bit mode:")) {
@@ -260,6 +368,10 @@ int main(int argc, char *argv[128]) {
     PARSE_NUM(max_mix_struct_count) {}
     PARSE_NUM(min_out_struct_count) {}
     PARSE_NUM(max_out_struct_count) {}
+    PARSE_NUM(gen_time_limit) {}
+    PARSE_NUM(max_node_count) {}
+    PARSE_NUM(max_out_size) {}
+    PARSE_NUM(max_test_complexity) {}
     else if (argv[i][0] == '-') {
       print_usage_and_exit("Unknown option: " + std::string(argv[i]));
     }
@@ -270,17 +382,61 @@ int main(int argc, char *argv[128]) {
     std::cerr << "For help type " << argv[0] << " -h" << std::endl;
   }
 
+  if (options->target_compile_ms != 0 && options->cost_model_file.empty())
+    print_usage_and_exit("--target-compile-ms requires --cost-model");
+  if (!options->cost_model_file.empty())
+    CompileCostModel::get_instance().load(options->cost_model_file);
+
+  if (campaign != 0) {
+    if (seed != 0)
+      print_usage_and_exit("--seed and --campaign can't be used together");
+    std::string err =
+        RandValGen::check_shard_coords(campaign, shard, seed_counter);
+    if (!err.empty())
+      print_usage_and_exit(err);
+    seed = RandValGen::get_shard_seed(campaign, shard, seed_counter);
+  } else if (shard != 0 || seed_counter != 0)
+    print_usage_and_exit("--shard and --seed-counter require --campaign");
+
+  GenPolicy::start_budget_clock();
   rand_val_gen = std::make_shared<RandValGen>(RandValGen(seed));
   default_gen_policy.init_from_config();
 
   //    self_test();
+  if (self_checks)
+    return run_self_checks() == 0 ? 0 : -1;
 
   Program mas(out_dir);
   mas.generate();
+  if (GenPolicy::is_budget_exceeded())
+    std::cout << "/*BUDGET "
+              << GenPolicy::get_budget_name(GenPolicy::get_exceeded_budget())
+              << " " << GenPolicy::get_budget_node_count() << " "
+              << GenPolicy::get_node_count() << "*/" << std::endl;
+  if (options->print_cost_features) {
+    CompileCostModel &cost_model = CompileCostModel::get_instance();
+    cost_model.emit_features(std::cout);
+    std::cout << std::endl;
+    if (cost_model.is_loaded())
+      std::cout << "/*COST " << cost_model.get_cost() << "*/" << std::endl;
+  }
+  if (!options->reduce_script.empty()) {
+    Reducer reducer(mas, out_dir, options->reduce_script, options->reduce_jobs);
+    if (!reducer.reduce()) {
+      std::cerr << "Generated test isn't interesting: " << options->reduce_script
+                << std::endl;
+      exit(-1);
+    }
+  }
   mas.emit_decl();
   mas.emit_func();
   mas.emit_main();
 
+#ifdef YARPGEN_PROFILE
+  if (!options->profile_file.empty())
+    Profiler::get_instance().dump(options->profile_file);
+#endif
+
   delete (options);
 
   return 0;
@@ -83,6 +83,36 @@ struct Options {
   bool enable_arrays = true;
   bool enable_bit_fields = false;
   bool print_assignments = false;
+
+  // Generation budgets. When any of them is exceeded, generator stops growing
+  // the test and emits what was generated so far. Zero means "no limit".
+  // Wall-clock limit for generation in milliseconds. It depends on machine
+  // load, so it is off by default and the test is determined by the seed.
+  uint64_t gen_time_limit = 0;
+  // Total number of created IR nodes
+  uint64_t max_node_count = 2000000;
+  // Estimated size of emitted test in bytes
+  uint64_t max_out_size = 32 * 1024 * 1024;
+  // Abstract complexity of execution (see NodeComplexity in gen_policy.cpp)
+  uint64_t max_test_complexity = 0;
+
+  // Requested compilation time of the test in milliseconds (0 - not set).
+  // Test size is steered toward it with the help of compilation cost model.
+  uint64_t target_compile_ms = 0;
+  // File with compilation cost model coefficients (see CompileCostModel)
+  std::string cost_model_file;
+  // Print features of compilation cost model and predicted cost
+  bool print_cost_features = false;
+
+  // File for profiling results (requires build with YARPGEN_PROFILE)
+  std::string profile_file;
+
+  // Interestingness script for reduction of generated test (see Reducer).
+  // Empty means that the test isn't reduced.
+  std::string reduce_script;
+  // Number of reduction candidates, which are tested in parallel (0 - number
+  // of cores)
+  uint32_t reduce_jobs = 0;
 };
 
 extern Options *options;
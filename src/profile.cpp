@@ -0,0 +1,163 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#include "profile.h"
+
+#ifdef YARPGEN_PROFILE
+
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#include "util.h"
+
+using namespace yarpgen;
+
+std::atomic<uint64_t> Profiler::alloc_count(0);
+
+// Global allocation counting. Array and nothrow forms of operator new use this one by default.
+void* operator new (std::size_t size) {
+    Profiler::alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size != 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete (void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+Profiler::Profiler () : start_time(std::chrono::steady_clock::now()), out_bytes(0) {
+    rebuild_count.fill(0);
+}
+
+ProfileScope::ProfileScope (Profiler::PhaseID phase_id) :
+        phase(Profiler::get_instance().get_phase(phase_id)), start_time(std::chrono::steady_clock::now()),
+        start_allocs(Profiler::alloc_count.load(std::memory_order_relaxed)) {
+    phase.calls++;
+    phase.depth++;
+}
+
+ProfileScope::~ProfileScope () {
+    phase.depth--;
+    if (phase.depth != 0)
+        return;
+    phase.time += std::chrono::steady_clock::now() - start_time;
+    phase.allocs += Profiler::alloc_count.load(std::memory_order_relaxed) - start_allocs;
+}
+
+static double to_ms (std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void Profiler::dump (std::string file_name) {
+    std::ofstream out_file(file_name);
+    if (!out_file.is_open())
+        ERROR("can't open profile file " + file_name);
+
+    out_file << "{\n";
+    out_file << "    \"total_time_ms\": " << to_ms(std::chrono::steady_clock::now() - start_time) << ",\n";
+    out_file << "    \"total_allocs\": " << alloc_count.load(std::memory_order_relaxed) << ",\n";
+
+    out_file << "    \"phases\": {\n";
+    for (int i = 0; i < MAX_PHASE_ID; ++i) {
+        out_file << "        \"" << get_phase_name(static_cast<PhaseID>(i)) << "\": {"
+                 << "\"calls\": " << phases.at(i).calls << ", "
+                 << "\"time_ms\": " << to_ms(phases.at(i).time) << ", "
+                 << "\"allocs\": " << phases.at(i).allocs << "}"
+                 << (i + 1 < MAX_PHASE_ID ? "," : "") << "\n";
+    }
+    out_file << "    },\n";
+
+    out_file << "    \"nodes\": {\n";
+    uint64_t total_nodes = 0;
+    for (const auto& i : node_count) {
+        out_file << "        \"" << get_node_name(i.first) << "\": " << i.second << ",\n";
+        total_nodes += i.second;
+    }
+    out_file << "        \"total\": " << total_nodes << "\n";
+    out_file << "    },\n";
+
+    out_file << "    \"rebuilds\": {\n";
+    for (int i = 0; i < MaxUB; ++i) {
+        out_file << "        \"" << get_ub_name(static_cast<UB>(i)) << "\": " << rebuild_count.at(i)
+                 << (i + 1 < MaxUB ? "," : "") << "\n";
+    }
+    out_file << "    },\n";
+
+    out_file << "    \"out_bytes\": " << out_bytes << "\n";
+    out_file << "}\n";
+}
+
+std::string Profiler::get_phase_name (PhaseID phase_id) {
+    switch (phase_id) {
+        case INIT_FROM_CONFIG:      return "GenPolicy::init_from_config";
+        case FORM_EXTERN_SYM_TABLE: return "Program::form_extern_sym_table";
+        case SCOPE_GEN:             return "ScopeStmt::generate";
+        case ARITH_GEN:             return "ArithExpr::generate";
+        case UNARY_REBUILD:         return "UnaryExpr::rebuild";
+        case BINARY_REBUILD:        return "BinaryExpr::rebuild";
+        case EMIT_DECL:             return "Program::emit_decl";
+        case EMIT_FUNC:             return "Program::emit_func";
+        case EMIT_MAIN:             return "Program::emit_main";
+        case MAX_PHASE_ID:          break;
+    }
+    ERROR("bad PhaseID");
+}
+
+std::string Profiler::get_node_name (Node::NodeID node_id) {
+    switch (node_id) {
+        case Node::NodeID::ASSIGN:      return "assign";
+        case Node::NodeID::BINARY:      return "binary";
+        case Node::NodeID::CONST:       return "const";
+        case Node::NodeID::TYPE_CAST:   return "type_cast";
+        case Node::NodeID::UNARY:       return "unary";
+        case Node::NodeID::VAR_USE:     return "var_use";
+        case Node::NodeID::MEMBER:      return "member";
+        case Node::NodeID::REFERENCE:   return "reference";
+        case Node::NodeID::DEREFERENCE: return "dereference";
+        case Node::NodeID::DECL:        return "decl";
+        case Node::NodeID::EXPR:        return "expr";
+        case Node::NodeID::SCOPE:       return "scope";
+        case Node::NodeID::IF:          return "if";
+        default:                        break;
+    }
+    ERROR("bad NodeID");
+}
+
+std::string Profiler::get_ub_name (UB ub) {
+    switch (ub) {
+        case NoUB:          return "NoUB";
+        case NullPtr:       return "NullPtr";
+        case SignOvf:       return "SignOvf";
+        case SignOvfMin:    return "SignOvfMin";
+        case ZeroDiv:       return "ZeroDiv";
+        case ShiftRhsNeg:   return "ShiftRhsNeg";
+        case ShiftRhsLarge: return "ShiftRhsLarge";
+        case NegShift:      return "NegShift";
+        case NoMemeber:     return "NoMemeber";
+        case MaxUB:         break;
+    }
+    ERROR("bad UB");
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "ir_node.h"
+#include "type.h"
+
+namespace yarpgen {
+
+// Generator profiling. It is enabled only if YARPGEN_PROFILE is defined at build time
+// (e.g. cmake -DYARPGEN_PROFILE=ON or "make profile"), otherwise all PROFILE_* macros expand to nothing.
+// Profiler collects wall time and number of memory allocations for generation phases, count of created nodes
+// of each kind, count of UB rebuilds of each kind and size of emitted test. Results are dumped to JSON file
+// specified by --profile option.
+#ifdef YARPGEN_PROFILE
+
+class Profiler {
+    public:
+        enum PhaseID {
+            INIT_FROM_CONFIG,
+            FORM_EXTERN_SYM_TABLE,
+            SCOPE_GEN,
+            ARITH_GEN,
+            UNARY_REBUILD,
+            BINARY_REBUILD,
+            EMIT_DECL,
+            EMIT_FUNC,
+            EMIT_MAIN,
+            MAX_PHASE_ID
+        };
+
+        struct PhaseStat {
+            uint64_t calls = 0;
+            // Recursive calls are accounted only once (in outermost call)
+            uint64_t depth = 0;
+            std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::zero();
+            uint64_t allocs = 0;
+        };
+
+        static Profiler& get_instance() {
+            static Profiler instance;
+            return instance;
+        }
+
+        Profiler(const Profiler& root) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        PhaseStat& get_phase (PhaseID phase_id) { return phases.at(phase_id); }
+        void add_node (Node::NodeID node_id) { node_count[node_id]++; }
+        void add_rebuild (UB ub) { rebuild_count.at(ub)++; }
+        void add_out_bytes (uint64_t bytes) { out_bytes += bytes; }
+
+        void dump (std::string file_name);
+
+        static std::string get_phase_name (PhaseID phase_id);
+        static std::string get_node_name (Node::NodeID node_id);
+        static std::string get_ub_name (UB ub);
+
+        // Incremented by replaced global operator new, which may be called from several threads (see Reducer)
+        static std::atomic<uint64_t> alloc_count;
+
+    private:
+        Profiler ();
+
+        std::chrono::steady_clock::time_point start_time;
+        std::array<PhaseStat, MAX_PHASE_ID> phases;
+        std::map<Node::NodeID, uint64_t> node_count;
+        std::array<uint64_t, MaxUB> rebuild_count;
+        uint64_t out_bytes;
+};
+
+// RAII helper, which accounts time and allocations of enclosing scope to specified phase
+class ProfileScope {
+    public:
+        ProfileScope (Profiler::PhaseID phase_id);
+        ~ProfileScope ();
+
+    private:
+        Profiler::PhaseStat& phase;
+        std::chrono::steady_clock::time_point start_time;
+        uint64_t start_allocs;
+};
+
+#define PROFILE_PHASE(phase_id) yarpgen::ProfileScope profile_scope(yarpgen::Profiler::phase_id)
+#define PROFILE_NODE(node_id) yarpgen::Profiler::get_instance().add_node(node_id)
+#define PROFILE_REBUILD(ub) yarpgen::Profiler::get_instance().add_rebuild(ub)
+#define PROFILE_OUT_BEGIN(stream) std::streampos profile_out_start = (stream).tellp()
+#define PROFILE_OUT_END(stream) \
+    yarpgen::Profiler::get_instance().add_out_bytes((stream).tellp() - profile_out_start)
+
+#else
+
+#define PROFILE_PHASE(phase_id)
+#define PROFILE_NODE(node_id)
+#define PROFILE_REBUILD(ub)
+#define PROFILE_OUT_BEGIN(stream)
+#define PROFILE_OUT_END(stream)
+
+#endif
+}
@@ -16,6 +16,8 @@ limitations under the License.
 
 //////////////////////////////////////////////////////////////////////////////
 
+#include "cost_model.h"
+#include "profile.h"
 #include "program.h"
 #include "util.h"
 
@@ -46,7 +48,19 @@ void Program::generate () {
         ctx.set_extern_mix_sym_table(extern_mix_sym_table.back());
         ctx.set_extern_out_sym_table(extern_out_sym_table.back());
         std::shared_ptr<Context> ctx_ptr = std::make_shared<Context>(ctx);
+        CompileCostModel& cost_model = CompileCostModel::get_instance();
+        cost_model.start_func();
         form_extern_sym_table(ctx_ptr);
+        for (const auto& sym_table : {extern_inp_sym_table.back(), extern_mix_sym_table.back(),
+                                      extern_out_sym_table.back()}) {
+            SymbolTable::DataStat data_stat = sym_table->get_data_stat();
+            GenPolicy::add_extern_data_to_out_size(data_stat.get_scalar_obj_count());
+            cost_model.add_feature(CompileCostModel::EXTERN_VAR, data_stat.var_count);
+            cost_model.add_feature(CompileCostModel::STRUCT_MEMBER, data_stat.struct_member_count);
+            cost_model.add_feature(CompileCostModel::ARRAY_ELEM, data_stat.array_elem_count);
+            cost_model.add_feature(CompileCostModel::POINTER, data_stat.ptr_count);
+            cost_model.update_max(CompileCostModel::MAX_PTR_DEPTH, data_stat.max_ptr_depth);
+        }
         functions.push_back(ScopeStmt::generate(ctx_ptr));
 
         name_handler.zero_out_counters();
@@ -55,6 +69,26 @@ void Program::generate () {
     }
 }
 
+void Program::reset_gen_state () {
+    GenPolicy::reset();
+    CompileCostModel::get_instance().reset_features();
+    NameHandler::get_instance().zero_out_counters();
+    Stmt::zero_out_total_stmt_count();
+    Stmt::zero_out_func_stmt_count();
+    Expr::zero_out_total_expr_count();
+    Expr::zero_out_func_expr_count();
+}
+
+std::vector<std::shared_ptr<SymbolTable>> Program::get_extern_sym_tables () {
+    std::vector<std::shared_ptr<SymbolTable>> ret;
+    for (unsigned int i = 0; i < functions.size(); ++i) {
+        ret.push_back(extern_inp_sym_table.at(i));
+        ret.push_back(extern_mix_sym_table.at(i));
+        ret.push_back(extern_out_sym_table.at(i));
+    }
+    return ret;
+}
+
 // Utility function which generates pointers (including nested)
 // only_invariants allows to exclude pointers to non-const members
 inline void ptr_generation (const std::shared_ptr<SymbolTable> &sym_table, uint32_t min_count,
@@ -109,6 +143,7 @@ inline void ptr_generation (const std::shared_ptr<SymbolTable> &sym_table, uint3
 
 // This function initially fills extern symbol table with inp and mix variables. It also creates type structs definitions.
 void Program::form_extern_sym_table(std::shared_ptr<Context> ctx) {
+    PROFILE_PHASE(FORM_EXTERN_SYM_TABLE);
     auto p = ctx->get_gen_policy();
     // Allow const cv-qualifier in gen_policy, pass it to new Context
     std::shared_ptr<Context> const_ctx = std::make_shared<Context>(*(ctx));
@@ -240,12 +275,19 @@ static std::string get_file_ext () {
 }
 
 void Program::emit_decl () {
+    PROFILE_PHASE(EMIT_DECL);
     std::ofstream out_file;
 	if (options->single_file)
 		out_file.open(out_folder + "/" + "single.c");
 	else
 		out_file.open(out_folder + "/" + "init.h");
-        
+    PROFILE_OUT_BEGIN(out_file);
+
+    if (GenPolicy::is_budget_exceeded()) {
+        out_file << "/*BUDGET " << GenPolicy::get_budget_name(GenPolicy::get_exceeded_budget())
+                 << " " << GenPolicy::get_budget_node_count() << " " << GenPolicy::get_node_count() << "*/\n";
+    }
+
     if (options->include_valarray) out_file << "#include <valarray>\n\n";
     if (options->include_vector) out_file << "#include <vector>\n\n";
     if (options->include_array) out_file << "#include <array>\n\n";
@@ -281,10 +323,12 @@ void Program::emit_decl () {
         out_file << "\n\n";
     }
 
+    PROFILE_OUT_END(out_file);
     out_file.close();
 }
 
 void Program::emit_func () {
+    PROFILE_PHASE(EMIT_FUNC);
     std::ofstream out_file;
 	if (options->single_file)
 		out_file.open(out_folder + "/" + "single.c", std::ofstream::app);
@@ -292,20 +336,24 @@ void Program::emit_func () {
 		out_file.open(out_folder + "/" + "func." + get_file_ext());
 		out_file << "#include \"init.h\"\n\n";
 	}
+    PROFILE_OUT_BEGIN(out_file);
     for (unsigned int i = 0; i < gen_policy.get_test_func_count(); ++i) {
         out_file << "void " << NameHandler::common_test_func_prefix << i << "_foo ()\n";
         functions.at(i)->emit(out_file);
         out_file << "\n";
     }
+    PROFILE_OUT_END(out_file);
     out_file.close();
 }
 
 void Program::emit_main () {
+    PROFILE_PHASE(EMIT_MAIN);
     std::ofstream out_file;
 	if (options->single_file)
 		out_file.open(out_folder + "/" + "single.c", std::ofstream::app);
 	else
 		out_file.open(out_folder + "/" + "driver." + get_file_ext());
+    PROFILE_OUT_BEGIN(out_file);
 
     // Headers
     //////////////////////////////////////////////////////////
@@ -412,6 +460,7 @@ void Program::emit_main () {
     out_file << "    return 0;\n";
     out_file << "}\n";
 
+    PROFILE_OUT_END(out_file);
     out_file.close();
 }
 
@@ -47,6 +47,16 @@ class Program {
         void emit_decl ();
         void emit_main ();
 
+        // Resets global state of generator, so another test can be generated in the same process.
+        // rand_val_gen should be re-initialized after it.
+        static void reset_gen_state ();
+
+        // Access to generated IR (it is used by Reducer)
+        std::vector<std::shared_ptr<ScopeStmt>>& get_functions () { return functions; }
+        // Symbol tables of all test functions in the order of their evaluation: input, mixed and output
+        std::vector<std::shared_ptr<SymbolTable>> get_extern_sym_tables ();
+        void set_out_folder (std::string _out_folder) { out_folder = _out_folder; }
+
     private:
 
         void form_extern_sym_table(std::shared_ptr<Context> ctx);
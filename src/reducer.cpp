@@ -0,0 +1,529 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include "options.h"
+#include "reducer.h"
+#include "util.h"
+
+using namespace yarpgen;
+
+namespace {
+// Place in IR, which holds expression (e.g. operand of another expression or init of declaration)
+struct ExprSlot {
+    std::function<std::shared_ptr<Expr>()> get;
+    std::function<void(std::shared_ptr<Expr>)> set;
+};
+}
+
+// Calls func for every statement of scope, including statements of nested scopes
+static void walk_stmts (std::shared_ptr<ScopeStmt> scope, std::function<void(std::shared_ptr<Stmt>)> func) {
+    for (const auto& stmt : scope->get_stmts()) {
+        func(stmt);
+        if (stmt->get_id() == Node::NodeID::IF) {
+            std::shared_ptr<IfStmt> if_stmt = std::static_pointer_cast<IfStmt>(stmt);
+            walk_stmts(if_stmt->get_if_branch(), func);
+            if (if_stmt->get_else_branch() != nullptr)
+                walk_stmts(if_stmt->get_else_branch(), func);
+        }
+        else if (stmt->get_id() == Node::NodeID::SCOPE)
+            walk_stmts(std::static_pointer_cast<ScopeStmt>(stmt), func);
+    }
+}
+
+// Top-level expressions of statement (nested scopes aren't included)
+static std::vector<std::shared_ptr<Expr>> get_stmt_exprs (std::shared_ptr<Stmt> stmt) {
+    std::vector<std::shared_ptr<Expr>> ret;
+    if (stmt->get_id() == Node::NodeID::DECL) {
+        std::shared_ptr<Expr> init = std::static_pointer_cast<DeclStmt>(stmt)->get_init();
+        if (init != nullptr)
+            ret.push_back(init);
+    }
+    else if (stmt->get_id() == Node::NodeID::EXPR)
+        ret.push_back(std::static_pointer_cast<ExprStmt>(stmt)->get_expr());
+    else if (stmt->get_id() == Node::NodeID::IF)
+        ret.push_back(std::static_pointer_cast<IfStmt>(stmt)->get_cond());
+    return ret;
+}
+
+// Collects data, which is referenced by expression tree
+static void collect_data (std::shared_ptr<Expr> expr, std::vector<std::shared_ptr<Data>>& ret) {
+    if (expr->get_id() == Node::NodeID::VAR_USE)
+        ret.push_back(std::static_pointer_cast<VarUseExpr>(expr)->get_raw_value());
+    else if (expr->get_id() == Node::NodeID::MEMBER)
+        ret.push_back(std::static_pointer_cast<MemberExpr>(expr)->get_base_struct());
+    for (const auto& operand : expr->get_operands())
+        collect_data(operand, ret);
+}
+
+// Expression can be replaced with constant of its value
+static bool is_reducible (std::shared_ptr<Expr> expr) {
+    if (expr->get_id() != Node::NodeID::UNARY && expr->get_id() != Node::NodeID::BINARY &&
+        expr->get_id() != Node::NodeID::TYPE_CAST)
+        return false;
+    // There are no bool literals in C
+    return !(options->is_c() && expr->get_value()->get_type()->get_int_type_id() == Type::IntegerTypeID::BOOL);
+}
+
+// Collects names of struct type and types of its members (struct types are compared by name, because cv-qualifiers
+// are kept in the type itself)
+static void collect_struct_types (std::shared_ptr<Type> type, std::set<std::string>& ret) {
+    if (type->is_array_type())
+        type = std::static_pointer_cast<ArrayType>(type)->get_base_type();
+    if (!type->is_struct_type() || !ret.insert(type->get_simple_name()).second)
+        return;
+    std::shared_ptr<StructType> struct_type = std::static_pointer_cast<StructType>(type);
+    for (uint32_t i = 0; i < struct_type->get_member_count(); ++i)
+        collect_struct_types(struct_type->get_member(i)->get_type(), ret);
+}
+
+// Collects global data of the test, including elements of arrays
+static void collect_global_data (Program& program, std::set<std::shared_ptr<Data>>& ret) {
+    std::function<void(std::shared_ptr<Data>)> add_data = [&ret, &add_data] (std::shared_ptr<Data> data) {
+        ret.insert(data);
+        if (data->get_class_id() == Data::VarClassID::ARRAY)
+            for (const auto& elem : std::static_pointer_cast<Array>(data)->get_elements())
+                add_data(elem);
+    };
+    for (const auto& sym_table : program.get_extern_sym_tables())
+        for (const auto& data : sym_table->get_all_data())
+            add_data(data);
+}
+
+static uint64_t count_stmts (Program& program) {
+    uint64_t ret = 0;
+    for (const auto& func : program.get_functions())
+        walk_stmts(func, [&ret] (std::shared_ptr<Stmt> stmt) {
+            if (stmt->get_id() != Node::NodeID::SCOPE)
+                ret++;
+        });
+    return ret;
+}
+
+Reducer::Reducer (Program& _program, std::string _work_dir, std::string _script, uint32_t _jobs) :
+                  program(_program), work_dir(_work_dir), script(_script), jobs(_jobs),
+                  tested_count(0), rejected_count(0), accepted_count(0) {
+    if (jobs == 0)
+        jobs = std::max(std::thread::hardware_concurrency(), 1U);
+    is_interesting = [this] (std::string dir) { return run_script(dir); };
+
+    // Script is launched in directories of candidates, so its relative path is resolved against current directory
+    std::string script_path = script.substr(0, script.find(' '));
+    if (!script_path.empty() && std::filesystem::path(script_path).is_relative() &&
+        script_path.find('/') != std::string::npos)
+        script = (std::filesystem::current_path() / script).string();
+
+    for (uint32_t i = 0; i < jobs; ++i) {
+        std::error_code err;
+        std::filesystem::create_directories(get_job_dir(i), err);
+        if (err)
+            ERROR("can't create directory " + get_job_dir(i) + ": " + err.message() + " (Reducer)");
+    }
+
+    for (const auto& func : program.get_functions())
+        walk_stmts(func, [this] (std::shared_ptr<Stmt> stmt) {
+            if (stmt->get_id() == Node::NodeID::DECL)
+                local_data.insert(std::static_pointer_cast<DeclStmt>(stmt)->get_data());
+        });
+    collect_global_data(program, global_data);
+}
+
+bool Reducer::reduce () {
+    uint64_t orig_stmt_count = count_stmts(program);
+    if (!is_valid())
+        ERROR("values of generated test can't be recomputed without UB (Reducer)");
+    // Job directory is left for investigation of the script failure
+    emit(get_job_dir(0));
+    if (!is_interesting(get_job_dir(0)))
+        return false;
+
+    bool progress = true;
+    while (progress) {
+        progress = reduce_stmts();
+        progress |= reduce_exprs();
+        progress |= reduce_data();
+    }
+
+    program.set_out_folder(work_dir);
+    for (uint32_t i = 0; i < jobs; ++i) {
+        std::error_code err;
+        std::filesystem::remove_all(get_job_dir(i), err);
+        if (err)
+            ERROR("can't remove directory " + get_job_dir(i) + ": " + err.message() + " (Reducer)");
+    }
+    std::cerr << "Reduction: statements " << orig_stmt_count << " -> " << count_stmts(program)
+              << ", tested candidates: " << tested_count << ", rejected: " << rejected_count
+              << ", accepted: " << accepted_count << std::endl;
+    return true;
+}
+
+bool Reducer::reduce_stmts () {
+    bool ret = false;
+    std::vector<std::shared_ptr<ScopeStmt>> scopes = program.get_functions();
+    // Scopes are processed top-down, so nested scopes of removed statements are skipped
+    for (size_t i = 0; i < scopes.size(); ++i) {
+        std::shared_ptr<ScopeStmt> scope = scopes.at(i);
+        std::vector<std::shared_ptr<Stmt>> orig_stmts = scope->get_stmts();
+        ret |= ddmin(orig_stmts.size(), [scope, orig_stmts] (const Config& keep) {
+            scope->get_stmts().clear();
+            for (size_t j = 0; j < orig_stmts.size(); ++j)
+                if (keep.at(j))
+                    scope->get_stmts().push_back(orig_stmts.at(j));
+        });
+
+        // If statement is replaced with its evaluated branch. It doesn't change the values of the test.
+        orig_stmts = scope->get_stmts();
+        std::vector<size_t> if_idx;
+        std::vector<std::shared_ptr<Stmt>> branches;
+        for (size_t j = 0; j < orig_stmts.size(); ++j) {
+            if (orig_stmts.at(j)->get_id() != Node::NodeID::IF)
+                continue;
+            std::shared_ptr<IfStmt> if_stmt = std::static_pointer_cast<IfStmt>(orig_stmts.at(j));
+            if_idx.push_back(j);
+            branches.push_back(if_stmt->get_taken() ? if_stmt->get_if_branch() : if_stmt->get_else_branch());
+        }
+        ret |= ddmin(if_idx.size(), [scope, orig_stmts, if_idx, branches] (const Config& keep) {
+            std::vector<std::shared_ptr<Stmt>> new_stmts = orig_stmts;
+            for (size_t j = 0; j < if_idx.size(); ++j)
+                if (!keep.at(j))
+                    new_stmts.at(if_idx.at(j)) = branches.at(j);
+            scope->get_stmts().clear();
+            for (const auto& stmt : new_stmts)
+                if (stmt != nullptr)
+                    scope->get_stmts().push_back(stmt);
+        });
+
+        for (const auto& stmt : scope->get_stmts()) {
+            if (stmt->get_id() == Node::NodeID::IF) {
+                std::shared_ptr<IfStmt> if_stmt = std::static_pointer_cast<IfStmt>(stmt);
+                scopes.push_back(if_stmt->get_if_branch());
+                if (if_stmt->get_else_branch() != nullptr)
+                    scopes.push_back(if_stmt->get_else_branch());
+            }
+            else if (stmt->get_id() == Node::NodeID::SCOPE)
+                scopes.push_back(std::static_pointer_cast<ScopeStmt>(stmt));
+        }
+    }
+    return ret;
+}
+
+bool Reducer::reduce_exprs () {
+    std::vector<ExprSlot> slots;
+    for (const auto& func : program.get_functions())
+        walk_stmts(func, [&slots] (std::shared_ptr<Stmt> stmt) {
+            if (stmt->get_id() == Node::NodeID::DECL) {
+                std::shared_ptr<DeclStmt> decl = std::static_pointer_cast<DeclStmt>(stmt);
+                slots.push_back({[decl] () { return decl->get_init(); },
+                                 [decl] (std::shared_ptr<Expr> expr) { decl->set_init(expr); }});
+            }
+            else if (stmt->get_id() == Node::NodeID::EXPR) {
+                std::shared_ptr<Expr> assign = std::static_pointer_cast<ExprStmt>(stmt)->get_expr();
+                if (assign->get_id() != Node::NodeID::ASSIGN)
+                    return;
+                slots.push_back({[assign] () { return assign->get_operands().at(1); },
+                                 [assign] (std::shared_ptr<Expr> expr) { assign->set_operand(1, expr); }});
+            }
+            else if (stmt->get_id() == Node::NodeID::IF) {
+                std::shared_ptr<IfStmt> if_stmt = std::static_pointer_cast<IfStmt>(stmt);
+                slots.push_back({[if_stmt] () { return if_stmt->get_cond(); },
+                                 [if_stmt] (std::shared_ptr<Expr> expr) { if_stmt->set_cond(expr); }});
+            }
+        });
+
+    // Expression trees are processed top-down: operands are tried only if the whole subtree can't be replaced.
+    // Operands of shared subtrees (e.g. CSE) are tried only once.
+    bool ret = false;
+    std::set<std::pair<Expr*, uint32_t>> visited;
+    while (!slots.empty()) {
+        std::vector<ExprSlot> level;
+        std::vector<std::shared_ptr<Expr>> orig_exprs;
+        std::vector<std::shared_ptr<Expr>> const_exprs;
+        for (const auto& slot : slots) {
+            std::shared_ptr<Expr> expr = slot.get();
+            if (expr == nullptr || !is_reducible(expr))
+                continue;
+            level.push_back(slot);
+            orig_exprs.push_back(expr);
+            std::shared_ptr<ScalarVariable> expr_val = std::static_pointer_cast<ScalarVariable>(expr->get_value());
+            const_exprs.push_back(std::make_shared<ConstExpr>(expr_val->get_cur_value()));
+        }
+        ret |= ddmin(level.size(), [level, orig_exprs, const_exprs] (const Config& keep) {
+            for (size_t i = 0; i < level.size(); ++i)
+                level.at(i).set(keep.at(i) ? orig_exprs.at(i) : const_exprs.at(i));
+        });
+
+        slots.clear();
+        for (size_t i = 0; i < level.size(); ++i) {
+            std::shared_ptr<Expr> expr = orig_exprs.at(i);
+            if (level.at(i).get() != expr)
+                continue;
+            for (uint32_t j = 0; j < expr->get_operands().size(); ++j)
+                if (visited.insert(std::make_pair(expr.get(), j)).second)
+                    slots.push_back({[expr, j] () { return expr->get_operands().at(j); },
+                                     [expr, j] (std::shared_ptr<Expr> new_expr) { expr->set_operand(j, new_expr); }});
+        }
+    }
+    return ret;
+}
+
+bool Reducer::reduce_data () {
+    std::vector<std::shared_ptr<SymbolTable>> sym_tables = program.get_extern_sym_tables();
+    // Global data, which owns elements of arrays (and structs in them)
+    std::map<std::shared_ptr<Data>, std::shared_ptr<Data>> owners;
+    std::map<std::shared_ptr<Data>, std::shared_ptr<Expr>> ptr_inits;
+    std::function<void(std::shared_ptr<Data>, std::shared_ptr<Data>)> add_owner =
+        [&owners, &add_owner] (std::shared_ptr<Data> data, std::shared_ptr<Data> owner) {
+            owners[data] = owner;
+            if (data->get_class_id() == Data::VarClassID::ARRAY)
+                for (const auto& elem : std::static_pointer_cast<Array>(data)->get_elements())
+                    add_owner(elem, owner);
+        };
+    for (const auto& sym_table : sym_tables) {
+        for (const auto& data : sym_table->get_all_data())
+            add_owner(data, data);
+        for (size_t i = 0; i < sym_table->get_pointers().size(); ++i)
+            ptr_inits[sym_table->get_pointers().at(i)] = sym_table->get_ptr_init_exprs().at(i);
+    }
+
+    // Data is used if test functions reference it directly or through initialization of used pointers
+    std::vector<std::shared_ptr<Data>> refs;
+    for (const auto& func : program.get_functions())
+        walk_stmts(func, [&refs] (std::shared_ptr<Stmt> stmt) {
+            for (const auto& expr : get_stmt_exprs(stmt))
+                collect_data(expr, refs);
+        });
+    std::set<std::shared_ptr<Data>> used;
+    while (!refs.empty()) {
+        std::shared_ptr<Data> data = refs.back();
+        refs.pop_back();
+        auto owner = owners.find(data);
+        if (owner == owners.end() || !used.insert(owner->second).second)
+            continue;
+        auto ptr_init = ptr_inits.find(owner->second);
+        if (ptr_init != ptr_inits.end())
+            collect_data(ptr_init->second, refs);
+    }
+
+    std::vector<std::shared_ptr<Data>> unused;
+    std::vector<SymbolTable> orig_sym_tables;
+    for (const auto& sym_table : sym_tables) {
+        for (const auto& data : sym_table->get_all_data())
+            if (used.count(data) == 0)
+                unused.push_back(data);
+        orig_sym_tables.push_back(*sym_table);
+    }
+    // Global data, which is referenced by initialization of unused pointers
+    std::map<std::shared_ptr<Data>, std::set<std::shared_ptr<Data>>> pointees;
+    for (const auto& data : unused) {
+        auto ptr_init = ptr_inits.find(data);
+        if (ptr_init == ptr_inits.end())
+            continue;
+        std::vector<std::shared_ptr<Data>> ptr_refs;
+        collect_data(ptr_init->second, ptr_refs);
+        for (const auto& ref : ptr_refs) {
+            auto owner = owners.find(ref);
+            if (owner != owners.end())
+                pointees[data].insert(owner->second);
+        }
+    }
+    return ddmin(unused.size(), [sym_tables, orig_sym_tables, unused, pointees] (const Config& keep) {
+        std::set<std::shared_ptr<Data>> removed;
+        for (size_t i = 0; i < unused.size(); ++i)
+            if (!keep.at(i))
+                removed.insert(unused.at(i));
+        // Pointers are removed together with their pointees (including pointers to removed pointers)
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto& ptr : pointees)
+                if (removed.count(ptr.first) == 0 &&
+                    std::any_of(ptr.second.begin(), ptr.second.end(),
+                                [&removed] (std::shared_ptr<Data> data) { return removed.count(data) != 0; })) {
+                    removed.insert(ptr.first);
+                    changed = true;
+                }
+        }
+        for (size_t i = 0; i < sym_tables.size(); ++i) {
+            *sym_tables.at(i) = orig_sym_tables.at(i);
+            sym_tables.at(i)->remove_data(removed);
+        }
+        // Struct types are shared by input, mixed and output symbol tables of the test function.
+        // Types without remaining objects are removed too.
+        for (size_t i = 0; i < sym_tables.size(); i += 3) {
+            std::set<std::string> used_types;
+            for (size_t j = i; j < i + 3; ++j)
+                for (const auto& data : sym_tables.at(j)->get_all_data())
+                    collect_struct_types(data->get_type(), used_types);
+            for (size_t j = i; j < i + 3; ++j) {
+                auto& struct_types = sym_tables.at(j)->get_struct_types();
+                struct_types.erase(std::remove_if(struct_types.begin(), struct_types.end(),
+                                                  [&used_types] (std::shared_ptr<StructType> type) {
+                                                      return used_types.count(type->get_simple_name()) == 0;
+                                                  }), struct_types.end());
+            }
+        }
+    });
+}
+
+// It is a variant of ddmin, which tests only complements: candidates remove one of "granularity" chunks
+// of kept elements. The first candidate removes everything.
+bool Reducer::ddmin (size_t count, SetConfigFunc set_config) {
+    Config keep (count, true);
+    bool ret = false;
+    size_t granularity = 1;
+    while (true) {
+        std::vector<size_t> kept_idx;
+        for (size_t i = 0; i < count; ++i)
+            if (keep.at(i))
+                kept_idx.push_back(i);
+        if (kept_idx.empty())
+            break;
+        granularity = std::min(granularity, kept_idx.size());
+
+        std::vector<Config> candidates;
+        for (size_t i = 0; i < granularity; ++i) {
+            Config candidate = keep;
+            for (size_t j = kept_idx.size() * i / granularity; j < kept_idx.size() * (i + 1) / granularity; ++j)
+                candidate.at(kept_idx.at(j)) = false;
+            candidates.push_back(candidate);
+        }
+
+        int64_t found = find_interesting(candidates, set_config);
+        if (found >= 0) {
+            keep = candidates.at(found);
+            ret = true;
+            accepted_count++;
+            granularity = std::max(granularity - 1, static_cast<size_t>(1));
+        }
+        else if (granularity == kept_idx.size())
+            break;
+        else
+            granularity = std::min(granularity * 2, kept_idx.size());
+    }
+    set_config(keep);
+    // Values of the test are used by the next reduction steps, so they should correspond to accepted candidate
+    if (!is_valid())
+        ERROR("accepted candidate is invalid (Reducer)");
+    return ret;
+}
+
+// Candidates are checked and emitted sequentially (they share IR), but scripts are launched in parallel.
+// The first interesting candidate is chosen, so the result doesn't depend on the number of jobs.
+int64_t Reducer::find_interesting (const std::vector<Config>& candidates, SetConfigFunc set_config) {
+    for (size_t start = 0; start < candidates.size(); start += jobs) {
+        std::vector<size_t> batch;
+        for (size_t i = start; i < std::min(start + jobs, candidates.size()); ++i) {
+            set_config(candidates.at(i));
+            if (!is_valid()) {
+                rejected_count++;
+                continue;
+            }
+            emit(get_job_dir(batch.size()));
+            batch.push_back(i);
+        }
+
+        std::vector<char> results(batch.size(), false);
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < batch.size(); ++i)
+            threads.emplace_back([this, i, &results] () { results.at(i) = is_interesting(get_job_dir(i)); });
+        for (auto& thread : threads)
+            thread.join();
+        tested_count += batch.size();
+
+        for (size_t i = 0; i < batch.size(); ++i)
+            if (results.at(i))
+                return batch.at(i);
+    }
+    return -1;
+}
+
+bool Reducer::is_valid () {
+    for (const auto& sym_table : program.get_extern_sym_tables())
+        sym_table->reset_values();
+    for (const auto& func : program.get_functions())
+        if (func->recompute_value(true) != NoUB)
+            return false;
+
+    // Initialization of pointers can reference only remaining global data
+    std::set<std::shared_ptr<Data>> visible;
+    collect_global_data(program, visible);
+    for (const auto& sym_table : program.get_extern_sym_tables())
+        for (const auto& init : sym_table->get_ptr_init_exprs()) {
+            std::vector<std::shared_ptr<Data>> refs;
+            collect_data(init, refs);
+            for (const auto& data : refs)
+                if (global_data.count(data) != 0 && visible.count(data) == 0)
+                    return false;
+        }
+
+    for (const auto& func : program.get_functions())
+        if (!check_decls(func, visible))
+            return false;
+    return true;
+}
+
+// Checks that local variables are used only in the scope of their declarations and that used global data
+// hasn't been removed. Visible data contains remaining global data and local variables of enclosing scopes.
+bool Reducer::check_decls (std::shared_ptr<ScopeStmt> scope, std::set<std::shared_ptr<Data>>& visible) {
+    std::vector<std::shared_ptr<Data>> declared;
+    bool ret = true;
+    for (const auto& stmt : scope->get_stmts()) {
+        std::vector<std::shared_ptr<Data>> refs;
+        for (const auto& expr : get_stmt_exprs(stmt))
+            collect_data(expr, refs);
+        for (const auto& data : refs)
+            if ((local_data.count(data) != 0 || global_data.count(data) != 0) && visible.count(data) == 0)
+                ret = false;
+
+        if (stmt->get_id() == Node::NodeID::DECL) {
+            std::shared_ptr<Data> data = std::static_pointer_cast<DeclStmt>(stmt)->get_data();
+            visible.insert(data);
+            declared.push_back(data);
+        }
+        else if (stmt->get_id() == Node::NodeID::IF) {
+            std::shared_ptr<IfStmt> if_stmt = std::static_pointer_cast<IfStmt>(stmt);
+            ret = ret && check_decls(if_stmt->get_if_branch(), visible);
+            if (if_stmt->get_else_branch() != nullptr)
+                ret = ret && check_decls(if_stmt->get_else_branch(), visible);
+        }
+        else if (stmt->get_id() == Node::NodeID::SCOPE)
+            ret = ret && check_decls(std::static_pointer_cast<ScopeStmt>(stmt), visible);
+        if (!ret)
+            break;
+    }
+    for (const auto& data : declared)
+        visible.erase(data);
+    return ret;
+}
+
+void Reducer::emit (std::string dir) {
+    program.set_out_folder(dir);
+    program.emit_decl();
+    program.emit_func();
+    program.emit_main();
+}
+
+bool Reducer::run_script (std::string dir) {
+    return std::system(("cd \"" + dir + "\" && " + script + " > interestingness.log 2>&1").c_str()) == 0;
+}
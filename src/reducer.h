@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2017, Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "program.h"
+
+namespace yarpgen {
+
+// Reducer shrinks generated test, while it stays "interesting" (e.g. it still triggers a compiler bug).
+// Unlike text-based reducers (e.g. creduce), it works on IR of the test, which is regenerated from the seed,
+// so it knows statements, scopes, branches of if statements, expression trees and their values.
+// It performs delta debugging over:
+// 1) statements of every scope (if statements are also replaced with their evaluated branch);
+// 2) arithmetic subtrees, which are replaced with constants of their values;
+// 3) global variables, structs, arrays and pointers, which aren't used by test functions anymore
+//    (pointers are removed together with their pointees).
+// Values of the whole test are recomputed for every candidate (see Expr::recompute_value). Candidates with UB
+// in evaluated code, with uses of removed local variables or with uses of removed global data (including
+// initialization of pointers) are rejected without testing.
+//
+// Interestingness test is an external shell command. It is launched in the directory with emitted candidate
+// and should exit with 0 if the candidate is interesting (the same convention as creduce uses).
+// Candidates are tested in parallel, every job has its own directory inside of work directory.
+class Reducer {
+    public:
+        Reducer (Program& _program, std::string _work_dir, std::string _script, uint32_t _jobs);
+        // Reduces the test in place. After it, the test can be emitted with emit methods of Program.
+        // Returns false if the test isn't interesting from the very beginning.
+        bool reduce ();
+
+    private:
+        friend class ReducerSelfTest;
+
+        // Mask of elements, which are kept in the candidate
+        using Config = std::vector<bool>;
+        using SetConfigFunc = std::function<void(const Config&)>;
+
+        bool reduce_stmts ();
+        bool reduce_exprs ();
+        bool reduce_data ();
+
+        // Delta debugging over count elements. set_config applies the mask to IR.
+        // Returns true if any element was removed.
+        bool ddmin (size_t count, SetConfigFunc set_config);
+        // Returns index of the first interesting candidate or -1
+        int64_t find_interesting (const std::vector<Config>& candidates, SetConfigFunc set_config);
+        // Recomputes values of the test and checks that it is still correct
+        bool is_valid ();
+        bool check_decls (std::shared_ptr<ScopeStmt> scope, std::set<std::shared_ptr<Data>>& visible);
+        void emit (std::string dir);
+        bool run_script (std::string dir);
+        std::string get_job_dir (uint32_t job) { return work_dir + "/reduce_job_" + std::to_string(job); }
+
+        Program& program;
+        std::string work_dir;
+        std::string script;
+        uint32_t jobs;
+        // Interestingness test of the candidate, which is emitted to the directory. It launches the script,
+        // but it is replaced by self checks (see self-test.cpp).
+        std::function<bool(std::string)> is_interesting;
+        // Local variables of the original test
+        std::set<std::shared_ptr<Data>> local_data;
+        // Global data (including elements of arrays) of the original test
+        std::set<std::shared_ptr<Data>> global_data;
+        // Statistics
+        uint64_t tested_count;
+        uint64_t rejected_count;
+        uint64_t accepted_count;
+};
+}
@@ -16,11 +16,16 @@ limitations under the License.
 
 //////////////////////////////////////////////////////////////////////////////
 
+#include <filesystem>
 #include <iostream>
+#include <unistd.h>
 
 #include "expr.h"
 #include "ir_node.h"
 #include "gen_policy.h"
+#include "options.h"
+#include "program.h"
+#include "reducer.h"
 #include "stmt.h"
 #include "sym_table.h"
 #include "type.h"
@@ -424,3 +429,132 @@ void self_test () {
     ptr_to_ptr_1_deref_deref->get_value()->get_type()->dbg_dump();
 
 }
+
+// Self checks, which are run by "yarpgen --self-test" (see tests/CMakeLists.txt).
+// Every failed check is reported, the function returns their number.
+static int failed_checks = 0;
+
+static void check (bool cond, const std::string &what) {
+    if (!cond) {
+        std::cerr << "Self check failed: " << what << std::endl;
+        failed_checks++;
+    }
+}
+
+// Seeds of sharded campaign are also computed by run_gen.py (common.get_shard_seed), so they should never change
+static void check_shard_seed () {
+    check(RandValGen::get_shard_seed(5, 3, 7) == 14546205496067815340ULL, "shard seed of (5, 3, 7)");
+    check(RandValGen::get_shard_seed(1, 0, 0) != RandValGen::get_shard_seed(1, 0, 1), "shard seeds of different counters");
+    check(RandValGen::check_shard_coords(5, 3, 7).empty(), "valid shard coordinates");
+    check(!RandValGen::check_shard_coords(0, 0, 0).empty(), "reserved campaign ID");
+    check(!RandValGen::check_shard_coords(1ULL << RandValGen::CAMPAIGN_BITS, 0, 0).empty(), "campaign ID range");
+    check(!RandValGen::check_shard_coords(1, 1ULL << RandValGen::SHARD_BITS, 0).empty(), "shard index range");
+    check(!RandValGen::check_shard_coords(1, 0, 1ULL << RandValGen::COUNTER_BITS).empty(), "seed counter range");
+}
+
+namespace yarpgen {
+// Checks of Reducer. Interestingness test is replaced, so no script is launched.
+class ReducerSelfTest {
+    public:
+        static void run ();
+
+    private:
+        static void check_ddmin (Reducer& reducer);
+        static void check_is_valid (Program& program, Reducer& reducer);
+        static void check_reduce (Program& program, Reducer& reducer);
+};
+}
+
+void ReducerSelfTest::run () {
+    std::string work_dir = (std::filesystem::temp_directory_path() /
+                            ("yarpgen_self_test_" + std::to_string(getpid()))).string();
+    // Small test, so every candidate is emitted fast
+    uint64_t max_node_count = options->max_node_count;
+    options->max_node_count = 3000;
+    Program::reset_gen_state();
+    rand_val_gen = std::make_shared<RandValGen>(RandValGen(1));
+    default_gen_policy.init_from_config();
+    Program program (work_dir);
+    program.generate();
+    options->max_node_count = max_node_count;
+
+    {
+        Reducer reducer (program, work_dir, "false", 1);
+        check_ddmin(reducer);
+        check_is_valid(program, reducer);
+        check_reduce(program, reducer);
+    }
+    std::filesystem::remove_all(work_dir);
+}
+
+void ReducerSelfTest::check_ddmin (Reducer& reducer) {
+    Reducer::Config config;
+    reducer.is_interesting = [&config] (std::string) { return config.at(3) && config.at(7); };
+    bool removed = reducer.ddmin(16, [&config] (const Reducer::Config& keep) { config = keep; });
+    Reducer::Config expected (16, false);
+    expected.at(3) = expected.at(7) = true;
+    check(removed && config == expected, "ddmin finds minimal interesting configuration");
+
+    reducer.is_interesting = [] (std::string) { return false; };
+    removed = reducer.ddmin(16, [&config] (const Reducer::Config& keep) { config = keep; });
+    check(!removed && config == Reducer::Config(16, true), "ddmin keeps everything, if nothing is interesting");
+}
+
+void ReducerSelfTest::check_is_valid (Program& program, Reducer& reducer) {
+    check(reducer.is_valid(), "generated test is valid");
+
+    std::vector<std::shared_ptr<SymbolTable>> sym_tables = program.get_extern_sym_tables();
+    std::vector<SymbolTable> orig_sym_tables;
+    for (const auto& sym_table : sym_tables)
+        orig_sym_tables.push_back(*sym_table);
+    std::vector<std::vector<std::shared_ptr<Stmt>>> orig_stmts;
+    for (const auto& func : program.get_functions()) {
+        orig_stmts.push_back(func->get_stmts());
+        func->get_stmts().clear();
+    }
+    check(reducer.is_valid(), "test with empty functions is valid");
+
+    // Pointers are kept, while all other global data is removed
+    std::set<std::shared_ptr<Data>> removed;
+    bool has_pointers = false;
+    for (const auto& sym_table : sym_tables) {
+        has_pointers |= !sym_table->get_pointers().empty();
+        for (const auto& data : sym_table->get_all_data())
+            if (data->get_class_id() != Data::VarClassID::POINTER)
+                removed.insert(data);
+    }
+    for (const auto& sym_table : sym_tables)
+        sym_table->remove_data(removed);
+    check(has_pointers, "generated test has pointers");
+    check(!reducer.is_valid(), "pointers to removed data are rejected");
+
+    for (size_t i = 0; i < program.get_functions().size(); ++i)
+        program.get_functions().at(i)->get_stmts() = orig_stmts.at(i);
+    check(!reducer.is_valid(), "uses of removed data are rejected");
+
+    for (size_t i = 0; i < sym_tables.size(); ++i)
+        *sym_tables.at(i) = orig_sym_tables.at(i);
+    check(reducer.is_valid(), "restored test is valid");
+}
+
+// Every candidate is interesting, so everything is removed
+void ReducerSelfTest::check_reduce (Program& program, Reducer& reducer) {
+    reducer.is_interesting = [] (std::string) { return true; };
+    check(reducer.reduce(), "reduction of interesting test");
+    size_t data_count = 0;
+    for (const auto& sym_table : program.get_extern_sym_tables())
+        data_count += sym_table->get_all_data().size();
+    size_t stmt_count = 0;
+    for (const auto& func : program.get_functions())
+        stmt_count += func->get_stmts().size();
+    check(data_count == 0 && stmt_count == 0, "reduction removes everything, which isn't interesting");
+    check(reducer.is_valid(), "reduced test is valid");
+}
+
+int run_self_checks () {
+    check_shard_seed();
+    ReducerSelfTest::run();
+    if (failed_checks == 0)
+        std::cout << "All self checks passed" << std::endl;
+    return failed_checks;
+}
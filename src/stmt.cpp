@@ -16,6 +16,8 @@ limitations under the License.
 
 //////////////////////////////////////////////////////////////////////////////
 
+#include "cost_model.h"
+#include "profile.h"
 #include "stmt.h"
 #include "sym_table.h"
 #include "util.h"
@@ -61,6 +63,21 @@ DeclStmt::DeclStmt (std::shared_ptr<Data> _data, std::shared_ptr<Expr> _init, bo
         ERROR("can init only ScalarVariable or Pointer in DeclStmt");
 }
 
+// Unlike constructor, it doesn't create TypeCastExpr, because value of init was already computed
+UB DeclStmt::recompute_value (bool _taken) {
+    if (init == nullptr || is_extern || is_cxx03_and_special_arr_kind(data))
+        return NoUB;
+    UB ret = init->recompute_value(_taken);
+    if (data->get_class_id() == Data::VarClassID::VAR) {
+        std::shared_ptr<ScalarVariable> data_var = std::static_pointer_cast<ScalarVariable>(data);
+        BuiltinType::ScalarTypedVal init_val = std::static_pointer_cast<ScalarVariable>(init->get_value())->get_cur_value();
+        data_var->set_init_value(init_val.cast_type(data_var->get_type()->get_int_type_id()));
+    }
+    else if (data->get_class_id() == Data::VarClassID::POINTER)
+        std::static_pointer_cast<Pointer>(data)->set_pointee(std::static_pointer_cast<Pointer>(init->get_value())->get_pointee());
+    return _taken ? ret : NoUB;
+}
+
 // This function randomly creates new ScalarVariable, its initializing arithmetic expression and
 // adds new variable to local_sym_table of parent Context
 std::shared_ptr<DeclStmt> DeclStmt::generate (std::shared_ptr<Context> ctx,
@@ -232,6 +249,7 @@ static std::shared_ptr<ExprStar> deep_deref_expr_from_nest_ptr(std::shared_ptr<E
 // It acts as a top-level dispatcher for other statement generation functions.
 // Also it initially fills extern symbol table.
 std::shared_ptr<ScopeStmt> ScopeStmt::generate (std::shared_ptr<Context> ctx) {
+    PROFILE_PHASE(SCOPE_GEN);
     GenPolicy::add_to_complexity(Node::NodeID::SCOPE);
 
     std::shared_ptr<ScopeStmt> ret = std::make_shared<ScopeStmt>();
@@ -243,12 +261,26 @@ std::shared_ptr<ScopeStmt> ScopeStmt::generate (std::shared_ptr<Context> ctx) {
     auto p = ctx->get_gen_policy();
     uint32_t scope_stmt_count = rand_val_gen->get_rand_value(p->get_min_scope_stmt_count(),
                                                              p->get_max_scope_stmt_count());
+    // If compilation time is requested, top-level scope of test function grows until it reaches its share
+    // of the time (generation budgets still apply). It can't outgrow the function's statement limit,
+    // so generation stays bounded even if predicted cost never reaches the share.
+    if (options->target_compile_ms != 0 && ctx->get_parent_ctx() == nullptr)
+        scope_stmt_count = p->get_max_func_stmt_count();
 
     for (uint32_t i = 0; i < scope_stmt_count; ++i) {
+        if (GenPolicy::get_test_complexity() >= p->get_max_test_complexity())
+            GenPolicy::exceed_budget(GenPolicy::COMPLEXITY_BUDGET);
+
+        // If any of generation budgets is exceeded, we close the scope. All enclosing scopes will do the same,
+        // so the test will consist of everything that was generated before.
         if (Stmt::total_stmt_count >= p->get_max_total_stmt_count() ||
-            Stmt::func_stmt_count  >= p->get_max_func_stmt_count())
-            //TODO: Can we somehow eliminate compiler timeout with the help of this?
-            //GenPolicy::get_test_complexity() >= p->get_max_test_complexity())
+            Stmt::func_stmt_count  >= p->get_max_func_stmt_count() ||
+            GenPolicy::is_budget_exceeded())
+            break;
+
+        // Each test function gets equal share of requested compilation time
+        if (options->target_compile_ms != 0 &&
+            CompileCostModel::get_instance().get_func_cost() >= p->get_func_compile_cost_limit())
             break;
 
         // Randomly decide if we want to create a new CSE
@@ -511,6 +543,15 @@ void ScopeStmt::emit (std::ostream& stream, std::string offset) {
     stream << offset + "}\n";
 }
 
+UB ScopeStmt::recompute_value (bool _taken) {
+    for (const auto &i : scope) {
+        UB ret = i->recompute_value(_taken);
+        if (ret != NoUB)
+            return ret;
+    }
+    return NoUB;
+}
+
 // This function randomly creates new AssignExpr and wraps it to ExprStmt.
 std::shared_ptr<ExprStmt> ExprStmt::generate (std::shared_ptr<Context> ctx,
                                               std::vector<std::shared_ptr<Expr>> inp,
@@ -540,6 +581,11 @@ void ExprStmt::emit (std::ostream& stream, std::string offset) {
     stream << ";";
 }
 
+UB ExprStmt::recompute_value (bool _taken) {
+    UB ret = expr->recompute_value(_taken);
+    return _taken ? ret : NoUB;
+}
+
 bool IfStmt::count_if_taken (std::shared_ptr<Expr> cond) {
     std::shared_ptr<TypeCastExpr> cond_to_bool = std::make_shared<TypeCastExpr> (cond, IntegerType::init(Type::IntegerTypeID::BOOL), true);
     if (cond_to_bool->get_value()->get_class_id() != Data::VarClassID::VAR) {
@@ -563,6 +609,7 @@ std::shared_ptr<IfStmt> IfStmt::generate (std::shared_ptr<Context> ctx,
                                           bool count_up_total) {
     Stmt::increase_stmt_count();
     GenPolicy::add_to_complexity(Node::NodeID::IF);
+    CompileCostModel::get_instance().update_max(CompileCostModel::MAX_IF_DEPTH, ctx->get_if_depth());
     std::shared_ptr<Expr> cond = ArithExpr::generate(ctx, inp);
     if (count_up_total)
         Expr::increase_expr_count(cond->get_complexity());
@@ -585,3 +632,14 @@ void IfStmt::emit (std::ostream& stream, std::string offset) {
         else_branch->emit(stream, offset);
     }
 }
+
+UB IfStmt::recompute_value (bool _taken) {
+    UB ret = cond->recompute_value(_taken);
+    if (_taken && ret != NoUB)
+        return ret;
+    taken = count_if_taken(cond);
+    ret = if_branch->recompute_value(_taken && taken);
+    if (ret != NoUB || else_branch == nullptr)
+        return ret;
+    return else_branch->recompute_value(_taken && !taken);
+}
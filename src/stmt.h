@@ -37,6 +37,11 @@ class Stmt : public Node {
 
         static void increase_stmt_count() { total_stmt_count++; func_stmt_count++; }
         static void zero_out_func_stmt_count () { func_stmt_count = 0; }
+        static void zero_out_total_stmt_count () { total_stmt_count = 0; }
+
+        // This function recalculates values of all expressions in statement (see Expr::recompute_value).
+        // It reports UB only if it happens in evaluated ("taken") code.
+        virtual UB recompute_value (bool _taken) = 0;
 
     protected:
         // Count of statements over all test program
@@ -54,7 +59,10 @@ class DeclStmt : public Stmt {
         DeclStmt (std::shared_ptr<Data> _data, std::shared_ptr<Expr> _init, bool _is_extern = false);
         void set_is_extern (bool _is_extern) { is_extern = _is_extern; }
         std::shared_ptr<Data> get_data () { return data; }
+        std::shared_ptr<Expr> get_init () { return init; }
+        void set_init (std::shared_ptr<Expr> _init) { init = _init; }
         void emit (std::ostream& stream, std::string offset = "");
+        UB recompute_value (bool _taken);
         // count_up_total determines whether to increase Expr::total_expr_count or not (used for CSE)
         static std::shared_ptr<DeclStmt> generate (std::shared_ptr<Context> ctx,
                                                    std::vector<std::shared_ptr<Expr>> inp,
@@ -72,7 +80,9 @@ class DeclStmt : public Stmt {
 class ExprStmt : public Stmt {
     public:
         ExprStmt (std::shared_ptr<Expr> _expr) : Stmt(Node::NodeID::EXPR), expr(_expr) {}
+        std::shared_ptr<Expr> get_expr () { return expr; }
         void emit (std::ostream& stream, std::string offset = "");
+        UB recompute_value (bool _taken);
         // For info about count_up_total see note above
         static std::shared_ptr<ExprStmt> generate (std::shared_ptr<Context> ctx,
                                                    std::vector<std::shared_ptr<Expr>> inp,
@@ -93,7 +103,9 @@ class ScopeStmt : public Stmt {
     public:
         ScopeStmt () : Stmt(Node::NodeID::SCOPE) {}
         void add_stmt (std::shared_ptr<Stmt> stmt) { scope.push_back(stmt); }
+        std::vector<std::shared_ptr<Stmt>>& get_stmts () { return scope; }
         void emit (std::ostream& stream, std::string offset = "");
+        UB recompute_value (bool _taken);
         static std::shared_ptr<ScopeStmt> generate (std::shared_ptr<Context> ctx);
 
     private:
@@ -119,7 +131,13 @@ class IfStmt : public Stmt {
         IfStmt (std::shared_ptr<Expr> cond, std::shared_ptr<ScopeStmt> if_branch,
                 std::shared_ptr<ScopeStmt> else_branch);
         static bool count_if_taken (std::shared_ptr<Expr> cond);
+        std::shared_ptr<Expr> get_cond () { return cond; }
+        void set_cond (std::shared_ptr<Expr> _cond) { cond = _cond; }
+        bool get_taken () { return taken; }
+        std::shared_ptr<ScopeStmt> get_if_branch () { return if_branch; }
+        std::shared_ptr<ScopeStmt> get_else_branch () { return else_branch; }
         void emit (std::ostream& stream, std::string offset = "");
+        UB recompute_value (bool _taken);
         // For info about count_up_total see note above
         static std::shared_ptr<IfStmt> generate (std::shared_ptr<Context> ctx,
                                                  std::vector<std::shared_ptr<Expr>> inp,
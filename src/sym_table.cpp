@@ -16,6 +16,7 @@ limitations under the License.
 
 //////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
@@ -87,6 +88,102 @@ void SymbolTable::add_array (std::shared_ptr<Array> _array) {
             form_struct_member_expr(members_in_arrays, nullptr, std::static_pointer_cast<Struct>(_array->get_element(i)));
 }
 
+// Counts scalar members of struct or scalar elements of array
+static uint64_t count_scalar_objs (std::shared_ptr<Data> data) {
+    if (data == nullptr)
+        return 0;
+    uint64_t ret = 0;
+    if (data->get_class_id() == Data::VarClassID::STRUCT) {
+        std::shared_ptr<Struct> struct_var = std::static_pointer_cast<Struct>(data);
+        for (uint32_t i = 0; i < struct_var->get_member_count(); ++i)
+            ret += count_scalar_objs(struct_var->get_member(i));
+    }
+    else if (data->get_class_id() == Data::VarClassID::ARRAY) {
+        std::shared_ptr<Array> array_var = std::static_pointer_cast<Array>(data);
+        for (const auto& elem : array_var->get_elements())
+            ret += count_scalar_objs(elem);
+    }
+    else
+        ret = 1;
+    return ret;
+}
+
+SymbolTable::DataStat SymbolTable::get_data_stat () {
+    DataStat ret;
+    ret.var_count = variable.size();
+    for (const auto& i : structs)
+        ret.struct_member_count += count_scalar_objs(i);
+    for (const auto& i : array)
+        ret.array_elem_count += count_scalar_objs(i);
+    ret.ptr_count = pointers.ptr.size();
+    for (const auto& i : pointers.ptr) {
+        uint64_t depth = 1;
+        std::shared_ptr<Data> pointee = i->get_pointee();
+        while (pointee != nullptr && pointee->get_class_id() == Data::VarClassID::POINTER) {
+            pointee = std::static_pointer_cast<Pointer>(pointee)->get_pointee();
+            depth++;
+        }
+        ret.max_ptr_depth = std::max(ret.max_ptr_depth, depth);
+    }
+    return ret;
+}
+
+// Sets current values of scalar objects in data to their initial values
+static void reset_data_values (std::shared_ptr<Data> data) {
+    if (data->get_class_id() == Data::VarClassID::VAR) {
+        std::shared_ptr<ScalarVariable> scalar_var = std::static_pointer_cast<ScalarVariable>(data);
+        scalar_var->set_init_value(scalar_var->get_init_value());
+    }
+    else if (data->get_class_id() == Data::VarClassID::STRUCT) {
+        std::shared_ptr<Struct> struct_var = std::static_pointer_cast<Struct>(data);
+        for (uint32_t i = 0; i < struct_var->get_member_count(); ++i)
+            reset_data_values(struct_var->get_member(i));
+    }
+    else if (data->get_class_id() == Data::VarClassID::ARRAY) {
+        for (const auto& elem : std::static_pointer_cast<Array>(data)->get_elements())
+            reset_data_values(elem);
+    }
+}
+
+void SymbolTable::reset_values () {
+    for (const auto& i : variable)
+        reset_data_values(i);
+    for (const auto& i : structs)
+        reset_data_values(i);
+    for (const auto& i : array)
+        reset_data_values(i);
+    // Pointers are initialized with the address of their init expression (see emit_ptr_def)
+    for (unsigned int i = 0; i < pointers.ptr.size(); ++i) {
+        pointers.init_expr.at(i)->recompute_value(true);
+        std::shared_ptr<Pointer> init_ptr = std::static_pointer_cast<Pointer>(pointers.init_expr.at(i)->get_value());
+        pointers.ptr.at(i)->set_pointee(init_ptr->get_pointee());
+    }
+}
+
+std::vector<std::shared_ptr<Data>> SymbolTable::get_all_data () {
+    std::vector<std::shared_ptr<Data>> ret;
+    ret.insert(ret.end(), variable.begin(), variable.end());
+    ret.insert(ret.end(), structs.begin(), structs.end());
+    ret.insert(ret.end(), array.begin(), array.end());
+    ret.insert(ret.end(), pointers.ptr.begin(), pointers.ptr.end());
+    return ret;
+}
+
+void SymbolTable::remove_data (const std::set<std::shared_ptr<Data>>& removed) {
+    auto is_removed = [&removed] (std::shared_ptr<Data> data) { return removed.count(data) != 0; };
+    variable.erase(std::remove_if(variable.begin(), variable.end(), is_removed), variable.end());
+    structs.erase(std::remove_if(structs.begin(), structs.end(), is_removed), structs.end());
+    array.erase(std::remove_if(array.begin(), array.end(), is_removed), array.end());
+    PointersInfo new_pointers;
+    for (unsigned int i = 0; i < pointers.ptr.size(); ++i) {
+        if (is_removed(pointers.ptr.at(i)))
+            continue;
+        new_pointers.ptr.push_back(pointers.ptr.at(i));
+        new_pointers.init_expr.push_back(pointers.init_expr.at(i));
+        new_pointers.deref_expr.push_back(pointers.deref_expr.at(i));
+    }
+    pointers = new_pointers;
+}
 
 std::shared_ptr<ExprStar> SymbolTable::deep_deref_expr_from_nest_ptr(std::shared_ptr<ExprStar> expr) {
     if (!expr->get_value()->get_type()->is_ptr_type())
@@ -18,6 +18,7 @@ limitations under the License.
 #pragma once
 
 #include <memory>
+#include <set>
 
 #include "gen_policy.h"
 #include "variable.h"
@@ -65,6 +66,28 @@ class SymbolTable {
 
         ExprStarVector& get_deref_exprs() { return pointers.deref_expr; }
 
+        // Number of scalar objects (variables, struct members, array elements and pointers) in symbol table
+        // and maximal depth of pointer chains. It is used to estimate test size and compilation cost.
+        struct DataStat {
+            uint64_t var_count = 0;
+            uint64_t struct_member_count = 0;
+            uint64_t array_elem_count = 0;
+            uint64_t ptr_count = 0;
+            uint64_t max_ptr_depth = 0;
+            uint64_t get_scalar_obj_count () { return var_count + struct_member_count + array_elem_count + ptr_count; }
+        };
+        DataStat get_data_stat ();
+
+        // Reducer support (see Reducer)
+        // Returns values of all data to their initial values (as at the start of the test)
+        void reset_values ();
+        // All variables, structs, arrays and pointers of symbol table
+        std::vector<std::shared_ptr<Data>> get_all_data ();
+        // Removes data from symbol table, so it is neither emitted nor used in checksum
+        void remove_data (const std::set<std::shared_ptr<Data>>& removed);
+        PointerVector& get_pointers () { return pointers.ptr; }
+        ExprVector& get_ptr_init_exprs () { return pointers.init_expr; }
+
         auto& get_members_in_structs() { return std::get<ALL>(members_in_structs); }
         auto& get_const_members_in_structs() { return std::get<CONST>(members_in_structs); }
         void del_member_in_structs(size_t idx);
@@ -200,6 +200,9 @@ std::shared_ptr<StructType> StructType::generate (std::shared_ptr<Context> ctx,
                                                            p->get_max_struct_member_count());
     int member_count = 0;
     for (int i = 0; i < struct_member_count; ++i) {
+        // Every member needs its own Type object, because cv-qualifier and static specifier are set below
+        primary_type = IntegerType::init(int_type_id);
+
         if (p->get_allow_mix_cv_qual_in_struct())
             primary_cv_qual = rand_val_gen->get_rand_elem(p->get_allowed_cv_qual());
 
@@ -0,0 +1,121 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Tests for calibration of compilation cost model (see cost_model.py).
+"""
+###############################################################################
+
+import json
+import logging
+import os
+import random
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import common
+import cost_model
+
+###############################################################################
+
+
+class CostModelTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        common.setup_logger(None, logging.ERROR)
+
+    # Features differ by orders of magnitude, like real ones (node counts vs. nesting depth)
+    def make_rows(self, coef, count, noise=0.0):
+        rnd = random.Random(42)
+        x_rows = []
+        y = []
+        for i in range(count):
+            row = [1.0, float(rnd.randint(0, 100000)), float(rnd.randint(0, 10)), float(rnd.randint(0, 1000))]
+            x_rows.append(row)
+            y.append(cost_model.predict(coef, row) * (1 + rnd.uniform(-noise, noise)))
+        return x_rows, y
+
+    def test_fit_recovers_coefficients(self):
+        coef = [50.0, 0.02, 30.0, 1.5]
+        x_rows, y = self.make_rows(coef, 200)
+        fitted = cost_model.fit(x_rows, y, len(coef))
+        for expected, actual in zip(coef, fitted):
+            self.assertAlmostEqual(expected, actual, delta=1e-3 * expected)
+
+    def test_fit_coefficients_are_not_negative(self):
+        # Compilation time doesn't decrease when test grows, so negative coefficient is replaced with zero
+        # and the rest of them is still fitted
+        coef = [50.0, 0.02, -30.0, 1.5]
+        x_rows, y = self.make_rows(coef, 200)
+        fitted = cost_model.fit(x_rows, y, len(coef))
+        self.assertEqual(fitted[2], 0.0)
+        for c in fitted:
+            self.assertGreaterEqual(c, 0.0)
+        self.assertAlmostEqual(fitted[1], coef[1], delta=0.1 * coef[1])
+
+    def test_fit_with_noise(self):
+        coef = [50.0, 0.02, 30.0, 1.5]
+        x_rows, y = self.make_rows(coef, 500, noise=0.05)
+        fitted = cost_model.fit(x_rows, y, len(coef))
+        for row, y_val in zip(x_rows, y):
+            self.assertAlmostEqual(cost_model.predict(fitted, row), y_val, delta=0.15 * y_val)
+
+    def test_fit_dependent_features(self):
+        # Linearly dependent columns must not break the solver
+        x_rows = [[1.0, float(i), float(2 * i)] for i in range(50)]
+        y = [10.0 + 3.0 * i for i in range(50)]
+        fitted = cost_model.fit(x_rows, y, 3)
+        for row, y_val in zip(x_rows, y):
+            self.assertAlmostEqual(cost_model.predict(fitted, row), y_val, delta=1e-3 * y_val)
+
+    def test_calibrate(self):
+        coef = {"intercept": 100.0, "expr": 0.5, "stmt": 2.0}
+        rnd = random.Random(1)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            data_file_name = os.path.join(tmp_dir, "cost_data.jsonl")
+            with open(data_file_name, "w") as data_file:
+                for i in range(50):
+                    features = {"expr": rnd.randint(0, 1000), "stmt": rnd.randint(0, 100)}
+                    build_time = (coef["intercept"] + coef["expr"] * features["expr"] +
+                                  coef["stmt"] * features["stmt"]) / 1000
+                    data_file.write(json.dumps({"seed": str(i), "target": "gcc_opt", "build_time": build_time,
+                                                "features": features}) + "\n")
+                    # Records of other targets are ignored
+                    data_file.write(json.dumps({"seed": str(i), "target": "clang_opt", "build_time": 1000.0,
+                                                "features": features}) + "\n")
+            model_file_name = os.path.join(tmp_dir, "gcc_opt.model")
+            cost_model.calibrate(data_file_name, "gcc_opt", model_file_name)
+
+            # Model file has the format, which is read by CompileCostModel::load
+            fitted = {}
+            with open(model_file_name) as model_file:
+                for line in model_file:
+                    if line.startswith("#"):
+                        continue
+                    name, value = line.split()
+                    fitted[name] = float(value)
+        self.assertEqual(set(fitted), set(coef))
+        for name in coef:
+            self.assertAlmostEqual(fitted[name], coef[name], delta=1e-3 * coef[name])
+
+###############################################################################
+
+if __name__ == '__main__':
+    unittest.main()
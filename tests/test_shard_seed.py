@@ -0,0 +1,86 @@
+#!/usr/bin/python3
+###############################################################################
+#
+# Copyright (c) 2017, Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+###############################################################################
+"""
+Tests for sharded seed space: seeds of common.get_shard_seed() should be the same, as seeds of yarpgen --campaign.
+Path to yarpgen is the first argument, tests of yarpgen are skipped without it.
+"""
+###############################################################################
+
+import logging
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import common
+
+###############################################################################
+
+yarpgen_bin = sys.argv.pop(1) if len(sys.argv) > 1 else None
+seed_pattern = re.compile(r"/\*SEED [0-9]+_([0-9]+)\*/")
+
+
+class ShardSeedTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        common.setup_logger(None, logging.ERROR)
+
+    def run_yarpgen(self, args):
+        with tempfile.TemporaryDirectory() as out_dir:
+            return subprocess.run([yarpgen_bin, "-q", "--out-dir=" + out_dir] + args, stdout=subprocess.PIPE,
+                                  stderr=subprocess.PIPE, universal_newlines=True, timeout=60)
+
+    def test_known_seed(self):
+        self.assertEqual(common.get_shard_seed(5, 3, 7), 14546205496067815340)
+
+    def test_coords_are_restored(self):
+        for coords in [(1, 0, 0), (5, 3, 7), (65535, 65535, 4294967295)]:
+            self.assertEqual(common.get_shard_coords(common.get_shard_seed(*coords)), coords)
+
+    def test_out_of_range(self):
+        for coords in [(0, 0, 0), (65536, 0, 0), (1, 65536, 0), (1, 0, 4294967296)]:
+            self.assertRaises(ValueError, common.get_shard_seed, *coords)
+
+    @unittest.skipIf(yarpgen_bin is None, "yarpgen isn't specified")
+    def test_yarpgen_seed(self):
+        for coords in [(1, 0, 0), (5, 3, 7), (65535, 65535, 4294967295)]:
+            res = self.run_yarpgen(["--campaign=" + str(coords[0]), "--shard=" + str(coords[1]),
+                                    "--seed-counter=" + str(coords[2])])
+            self.assertEqual(res.returncode, 0, res.stderr)
+            match = seed_pattern.search(res.stdout)
+            self.assertIsNotNone(match, res.stdout)
+            self.assertEqual(int(match.group(1)), common.get_shard_seed(*coords))
+
+    @unittest.skipIf(yarpgen_bin is None, "yarpgen isn't specified")
+    def test_yarpgen_invalid_coords(self):
+        for args in [["--campaign=abc"], ["--campaign=0x5"], ["--campaign=-1"], ["--campaign=65536"],
+                     ["--campaign=1", "--shard=65536"], ["--campaign=1", "--seed-counter=99999999999999999999"],
+                     ["--shard=1"]]:
+            res = self.run_yarpgen(args)
+            # Invalid options are reported with usage, yarpgen shouldn't be killed by exception
+            self.assertEqual(res.returncode, 255, str(args) + ": " + res.stderr)
+
+
+###############################################################################
+
+if __name__ == '__main__':
+    unittest.main()